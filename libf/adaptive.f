@@ -0,0 +1,16 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// Adaptive sampling, included by the renderers in libf that accumulate
+// samples. The host tracks how far each pixel is from convergence with
+// moments.f, and passes its output as iMoments. Pixels flagged as
+// converged are not shaded again: the renderer adds nothing to them,
+// which is why compose.f divides each pixel by its own sample count.
+
+uniform sampler2D iMoments;
+uniform int       iAdaptive; // 1: skip converged pixels
+
+bool isConverged()
+{
+    return iAdaptive == 1 && texelFetch(iMoments, ivec2(iFragCoord), 0).a > 0.5;
+}
@@ -8,10 +8,19 @@ uniform mat4      iView;
 uniform int       iSamples;
 out vec4          fragColor;
 
+// Defaults (can be overridden with fraktal_link_define)
+#ifndef EPSILON
 #define EPSILON 0.0001
+#endif
+#ifndef STEPS
 #define STEPS 512
+#endif
+#ifndef DENOISE
 #define DENOISE 1
+#endif
+#ifndef MAX_DISTANCE
 #define MAX_DISTANCE 100.0
+#endif
 #define MAX_AO_DISTANCE 1.0
 #define M_PI 3.1415926535897932384626433832795
 
@@ -20,7 +29,7 @@ float model(vec3 p); // forward-declaration
 #if DENOISE
 vec2 seed = vec2(-1,1)*(iSamples*(1.0/12.0) + 1.0);
 #else
-vec2 seed = (vec2(-1.0) + 2.0*gl_FragCoord.xy/iResolution.xy)*(iSamples*(1.0/12.0) + 1.0);
+vec2 seed = (vec2(-1.0) + 2.0*iFragCoord/iResolution.xy)*(iSamples*(1.0/12.0) + 1.0);
 #endif
 vec2 noise2f()
 {
@@ -44,7 +53,7 @@ vec3 cosineWeightedSample(vec3 normal)
 
 vec3 rayPinhole(vec2 fragOffset)
 {
-    vec2 uv = vec2(gl_FragCoord.x, iResolution.y - gl_FragCoord.y) + fragOffset - iCameraCenter;
+    vec2 uv = vec2(iFragCoord.x, iResolution.y - iFragCoord.y) + fragOffset - iCameraCenter;
     float d = 1.0/length(vec3(uv, iCameraF));
     return vec3(uv*d, -iCameraF*d);
 }
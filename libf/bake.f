@@ -0,0 +1,46 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// This shader bakes the brick cache described in brick.f, and is linked
+// with the model. The host runs it twice:
+//
+// With iBakePass = 0 over an array laid out like iBrickGrid, it outputs
+// for each cell whether it needs a brick (r: 1 or -1), and the distance at
+// the cell center (g). A cell needs a brick if the surface may be within
+// one cell size of it. The host then numbers the bricks and uploads the
+// grid with the brick indices in place of the flags.
+//
+// With iBakePass = 1 over the atlas, it outputs the distance samples of
+// each brick. iBrickCells holds the cell of each brick (xyz), with one
+// texel per tile of the atlas.
+
+uniform int       iBakePass (specialize);
+uniform sampler2D iBrickCells;
+out vec4          fragColor;
+
+float model(vec3 p); // forward-declaration
+
+#include "brick.f"
+
+void main()
+{
+    ivec2 texel = ivec2(iFragCoord);
+    if (iBakePass == 0)
+    {
+        ivec3 cell = ivec3(texel.x, texel.y % iBrickGridSize, texel.y / iBrickGridSize);
+        vec3 center = iBrickMin + (vec3(cell) + 0.5)*iBrickCell;
+        float d = model(center);
+        float radius = 0.866*iBrickCell;
+        fragColor = vec4(abs(d) <= radius + iBrickCell ? 1.0 : -1.0, d, 0.0, 0.0);
+    }
+    else
+    {
+        ivec2 tile_size = ivec2(BRICK_SAMPLES*BRICK_SAMPLES, BRICK_SAMPLES);
+        ivec2 tile = texel / tile_size;
+        ivec2 local = texel - tile*tile_size;
+        ivec3 s = ivec3(local.x % BRICK_SAMPLES, local.y, local.x / BRICK_SAMPLES);
+        vec3 cell = texelFetch(iBrickCells, tile, 0).xyz;
+        vec3 p = iBrickMin + (cell + vec3(s)/float(BRICK_SAMPLES - 1))*iBrickCell;
+        fragColor = vec4(model(p));
+    }
+}
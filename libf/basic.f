@@ -1,26 +1,37 @@
 // Developed by Simen Haugo.
 // See LICENSE.txt for copyright and licensing details (standard MIT License).
 
-uniform vec2      iLowResolution;
 uniform vec2      iResolution;
 uniform vec2      iCameraCenter;
 uniform float     iCameraF;
 uniform float     iGroundHeight;
 uniform mat4      iView;
 uniform int       iSamples;
-uniform sampler2D iChannel0;
-uniform int       iMode;
+uniform int       iDepthPass (specialize); // 1: output the depth of each pixel center instead of rendering
 out vec4          fragColor;
 
+// Defaults (can be overridden with fraktal_link_define)
+#ifndef EPSILON
 #define EPSILON 0.0007
+#endif
+#ifndef STEPS
 #define STEPS 512
+#endif
+#ifndef MAX_DISTANCE
 #define MAX_DISTANCE 100.0
+#endif
 #define INFINITY (9999999999.0)
 #define MAX_AO_DISTANCE 1.0
 #define M_PI 3.1415926535897932384626433832795
 
 float model(vec3 p); // forward-declaration
 
+#define CONE_GROUND iGroundHeight
+#define CONE_MARGIN 0.5
+#include "cone.f"
+#include "trace.f"
+#include "adaptive.f"
+
 // lumina.sourceforge.net/Tutorials/Noise.html
 vec2 seed = vec2(-1,1)*(iSamples*(1.0/12.0) + 1.0);
 vec2 noise2f()
@@ -43,15 +54,8 @@ vec3 normalModel(vec3 p)
 
 float traceModel(vec3 ro, vec3 rd, float t)
 {
-    for (int i = ZERO; i < STEPS; i++)
-    {
-        vec3 p = ro + t*rd;
-        float d = model(p);
-        if (d <= EPSILON) return t;
-        t += d;
-        if (t > MAX_DISTANCE) return INFINITY;
-    }
-    return INFINITY;
+    t = sphereTrace(ro, rd, t, MAX_DISTANCE);
+    return t < 0.0 ? INFINITY : t;
 }
 
 float traceGround(vec3 ro, vec3 rd)
@@ -139,65 +143,29 @@ vec3 render(vec3 ro, vec3 rd, float t)
 
 void main()
 {
-    if (iMode == 1)
+    vec3 ro = (iView * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+    if (iConePass == 1)
     {
-        vec2 scale = iResolution.xy/iLowResolution.xy;
-        vec2 fragCoord = gl_FragCoord.xy*scale;
-        vec2 uv = vec2(fragCoord.x, iResolution.y - fragCoord.y) - iCameraCenter;
-        vec3 rd = normalize(vec3(uv, -iCameraF));
-        vec3 ro = (iView * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
-
-        #if 0
-        // Conservative cone angle calculation
-        float a_all = 2.0*atan(0.5*iResolution.y/iCameraF);
-        float fudge_factor = 1.3;
-        float a_this = fudge_factor*a_all/(iResolution.y*iScaling);
-        float sin_alpha_half = sin(a_this/2.0);
-        float cos_alpha_half = sqrt(1.0 - sin_alpha_half*sin_alpha_half);
-        #else
-        // Exact bound cone angle calculation
-        float cos_alpha_half = dot(rd, normalize(vec3(uv + vec2(0.5, 0.5)*scale, -iCameraF)));
-        float sin_alpha_half = sqrt(1.0 - cos_alpha_half*cos_alpha_half);
-        #endif
-
-        rd = normalize((iView * vec4(rd, 0.0)).xyz);
-
-        // Initial step is shared for *all* rays
-        float t = model(ro);
-
-        int i;
-        for (i = ZERO; i < STEPS; i++)
-        {
-            vec3 p = ro + t*rd;
-            float d = min(p.y - iGroundHeight, model(p));
-            if (d <= sin_alpha_half*t + EPSILON) break;
-
-            #if 0
-            // Conservative step, results in more iterations but is cheaper to compute
-            // Note: EPSILON in the termination condition is necessary as this iteration scheme
-            // converges towards d = sin_alpha_half*t, which causes numerical instability in an
-            // exact comparison.
-            t = (t + d)/(1.0 + sin_alpha_half);
-            #else
-            // Tight step, results in fewer iterations
-            // Note: if this is used the EPSILON in the termination condition above is unecessary.
-            t = t*cos_alpha_half + sqrt(d*d - sin_alpha_half*sin_alpha_half*t*t);
-            #endif
-
-            if (t > MAX_DISTANCE) break;
-        }
-
-        fragColor = vec4(t);
+        fragColor = vec4(coneTrace(ro, iView));
+        return;
     }
-    else
+    if (iDepthPass == 1)
     {
-        vec2 uv = vec2(gl_FragCoord.x, iResolution.y - gl_FragCoord.y) + (noise2f() - vec2(0.5)) - iCameraCenter;
+        // Distance to the first surface, or 0 if there is none (see reproject.f)
+        vec2 uv = vec2(iFragCoord.x, iResolution.y - iFragCoord.y) - iCameraCenter;
         vec3 rd = normalize((iView * vec4(uv, -iCameraF, 0.0)).xyz);
-        vec3 ro = (iView * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
-
-        float t0 = texelFetch(iChannel0, ivec2(gl_FragCoord.xy*iLowResolution.xy/iResolution.xy), 0).r;
-        fragColor.rgb = render(ro, rd, t0);
-        // fragColor.rgb = vec3(t0)/4.0;
-        fragColor.a = 1.0;
+        float t = min(traceGround(ro, rd), traceModel(ro, rd, coneStart(ivec2(iFragCoord))));
+        fragColor = vec4(t < INFINITY ? t : 0.0);
+        return;
+    }
+    if (isConverged())
+    {
+        fragColor = vec4(0.0);
+        return;
     }
+
+    vec2 uv = vec2(iFragCoord.x, iResolution.y - iFragCoord.y) + (noise2f() - vec2(0.5)) - iCameraCenter;
+    vec3 rd = normalize((iView * vec4(uv, -iCameraF, 0.0)).xyz);
+    fragColor.rgb = render(ro, rd, coneStart(ivec2(iFragCoord)));
+    fragColor.a = 1.0;
 }
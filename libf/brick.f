@@ -0,0 +1,82 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// Sparse brick cache of the model's distance field, used by trace.f so
+// that expensive models are not evaluated at every step of a ray. The
+// host bakes the cache with bake.f (see bake_brick_cache in gui.cpp).
+//
+// A box, split into iBrickGridSize^3 cubic cells, is laid over the model.
+// Cells that the surface may pass near get a brick of BRICK_SAMPLES^3
+// distance samples, from corner to corner of the cell, which are stored
+// in the 2D array iBrickAtlas (a tile of BRICK_SAMPLES^2 x BRICK_SAMPLES
+// texels per brick, with its z-slices side by side). iBrickGrid holds,
+// for each cell, the index of its brick (or -1 if it has none) and the
+// distance at the cell center, in a 2D array of iBrickGridSize x
+// iBrickGridSize^2 texels (z-slices stacked vertically).
+
+uniform int       iBrickCache (specialize); // 1: trace with the cache
+uniform sampler2D iBrickGrid;
+uniform sampler2D iBrickAtlas;
+uniform vec3      iBrickMin;      // lower corner of the box
+uniform float     iBrickCell;     // side length of a cell
+uniform int       iBrickGridSize; // cells per side of the box
+
+// The layout of the atlas, which the host must match
+#define BRICK_SAMPLES 8
+#define BRICK_TILES_X 64
+
+ivec2 brickGridTexel(ivec3 cell)
+{
+    return ivec2(cell.x, cell.y + cell.z*iBrickGridSize);
+}
+
+ivec2 brickAtlasTexel(int brick, ivec3 s)
+{
+    ivec2 tile = ivec2(brick % BRICK_TILES_X, brick / BRICK_TILES_X);
+    return tile*ivec2(BRICK_SAMPLES*BRICK_SAMPLES, BRICK_SAMPLES) + ivec2(s.x + s.z*BRICK_SAMPLES, s.y);
+}
+
+float brickSample(int brick, ivec3 s)
+{
+    return texelFetch(iBrickAtlas, brickAtlasTexel(brick, s), 0).r;
+}
+
+// Returns a lower bound on the distance to the surface, like model, but
+// from the cache where that is cheaper. The exact model is used outside
+// the box, and near the surface, so that hits are as accurate as without
+// the cache.
+//
+// Inside a brick, the bound is the nearest sample less the distance to
+// it, which holds for any model that is a distance bound itself, and
+// costs one fetch. (Trilinear interpolation would give a tighter value,
+// but needs eight fetches as arrays are not filtered, and must then also
+// subtract its error to remain a bound.)
+float cachedModel(vec3 p)
+{
+    if (iBrickCache == 0)
+        return model(p);
+
+    vec3 u = (p - iBrickMin)/iBrickCell;
+    ivec3 cell = ivec3(floor(u));
+    if (any(lessThan(cell, ivec3(0))) || any(greaterThanEqual(cell, ivec3(iBrickGridSize))))
+        return model(p);
+
+    // Cells without a brick are far enough from the surface that the
+    // distance at their center, less the distance to it, is a bound of at
+    // least one cell size anywhere in the cell.
+    vec4 grid = texelFetch(iBrickGrid, brickGridTexel(cell), 0);
+    if (grid.r < 0.0)
+    {
+        vec3 center = iBrickMin + (vec3(cell) + 0.5)*iBrickCell;
+        return sign(grid.g)*(abs(grid.g) - length(p - center));
+    }
+
+    // Within a sample spacing of the surface, the model itself is used.
+    float h = iBrickCell/float(BRICK_SAMPLES - 1);
+    vec3 f = (u - vec3(cell))*float(BRICK_SAMPLES - 1);
+    ivec3 s = clamp(ivec3(floor(f + 0.5)), ivec3(0), ivec3(BRICK_SAMPLES - 1));
+    float bound = brickSample(int(grid.r), s) - length(f - vec3(s))*h;
+    if (bound < h)
+        return model(p);
+    return bound;
+}
@@ -2,17 +2,34 @@
 // See LICENSE.txt for copyright and licensing details (standard MIT License).
 
 // This shader calculates the mean of accumulated sample images and applies
-// gamma correction to the output.
+// gamma correction to the output. It runs either as a separate kernel over
+// the accumulated image, or as the epilogue of the kernel that renders the
+// samples (see fraktal_add_link_epilogue). Each sample has an alpha of 1,
+// so the alpha of the sum is the number of samples accumulated in that
+// pixel, which can differ between pixels with adaptive sampling.
 
+vec4 compose(vec4 sum, float samples)
+{
+    vec4 color = sum / samples;
+    color.rgb = sqrt(color.rgb);
+    color.a = 1.0;
+    return color;
+}
+
+#ifdef FRAKTAL_EPILOGUE
+vec4 epilogue(vec4 sum)
+{
+    return compose(sum, sum.a);
+}
+#else
 uniform vec2      iResolution;
 uniform sampler2D iChannel0;
-uniform int       iSamples;
 out vec4          fragColor;
 
 void main()
 {
-    vec2 uv = gl_FragCoord.xy / iResolution.xy;
-    fragColor = texture(iChannel0, uv) / float(iSamples);
-    fragColor.rgb = sqrt(fragColor.rgb);
-    fragColor.a = 1.0;
+    vec2 uv = iFragCoord / iResolution.xy;
+    vec4 sum = texture(iChannel0, uv);
+    fragColor = compose(sum, max(sum.a, 1.0));
 }
+#endif
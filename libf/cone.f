@@ -0,0 +1,88 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// Hierarchical cone tracing pre-pass, included by the renderers in libf.
+// Before rendering, the host runs the renderer with iConePass = 1 over a
+// sequence of increasingly fine levels (1/16 and then 1/4 of the output
+// resolution in gui.cpp, see render_cone_levels). Each texel of a level
+// marches one cone that encloses every ray through its block of
+// iConeCell x iConeCell pixels, and stores the distance at which the cone
+// first comes within reach of the scene. No ray in the block can hit the
+// scene before that distance, so the next level, and finally the render
+// pass, starts its rays there instead of at the camera.
+//
+// The renderer must declare iResolution, iCameraCenter and iCameraF, and
+// define STEPS, EPSILON and MAX_DISTANCE, before including this file.
+// Renderers with an opaque ground plane define CONE_GROUND as its height,
+// so that the cones also stop at the ground. If iConeInputCell is zero
+// (the default) there is no coarser level and rays start at the camera,
+// which is also what instanced renders must use.
+
+uniform int       iConePass (specialize); // 1: run the pre-pass instead of rendering
+uniform int       iConeCell;              // pixels per texel side of the level being rendered
+uniform int       iConeInputCell;         // pixels per texel side of iConeDistance (0: none)
+uniform sampler2D iConeDistance;          // distances of the previous (coarser) level
+
+// Pixels by which the render pass may offset its rays (e.g. for antialiasing)
+#ifndef CONE_MARGIN
+#define CONE_MARGIN 1.0
+#endif
+
+float coneScene(vec3 p)
+{
+    #ifdef CONE_GROUND
+    return min(p.y - CONE_GROUND, model(p));
+    #else
+    return model(p);
+    #endif
+}
+
+// Returns the distance at which rays through the given pixel (in output
+// resolution) can start tracing.
+float coneStart(ivec2 pixel)
+{
+    if (iConeInputCell <= 0)
+        return 0.0;
+    return texelFetch(iConeDistance, pixel/iConeInputCell, 0).r;
+}
+
+// Returns the camera-space direction through a point on the image.
+vec3 coneDirection(vec2 pixel)
+{
+    vec2 uv = vec2(pixel.x, iResolution.y - pixel.y) - iCameraCenter;
+    return normalize(vec3(uv, -iCameraF));
+}
+
+float coneTrace(vec3 ro, mat4 view)
+{
+    // The block of pixels covered by this texel, widened by the margin.
+    // Since blocks are square in pixels, the cone is correct for any
+    // aspect ratio, and it contains the cones of the finer levels as long
+    // as their cell size divides this one.
+    vec2 lo = floor(iFragCoord)*float(iConeCell) - vec2(CONE_MARGIN);
+    vec2 hi = lo + vec2(float(iConeCell) + 2.0*CONE_MARGIN);
+
+    // The half-angle is that of the corner furthest from the axis, as
+    // the cone must contain the whole block and not only the inscribed
+    // circle.
+    vec3 axis = coneDirection(0.5*(lo + hi));
+    float cos_a = min(min(dot(axis, coneDirection(lo)), dot(axis, coneDirection(hi))),
+                      min(dot(axis, coneDirection(vec2(lo.x, hi.y))), dot(axis, coneDirection(vec2(hi.x, lo.y)))));
+    float sin_a = sqrt(max(0.0, 1.0 - cos_a*cos_a));
+    vec3 rd = normalize((view * vec4(axis, 0.0)).xyz);
+
+    float t = coneStart(ivec2(lo + vec2(CONE_MARGIN)));
+    for (int i = ZERO; i < STEPS; i++)
+    {
+        float d = coneScene(ro + t*rd);
+        if (d <= sin_a*t + EPSILON)
+            break;
+
+        // Step to where the cone's boundary leaves the sphere of radius d,
+        // which every ray inside the cone reaches no earlier.
+        t = t*cos_a + sqrt(d*d - sin_a*sin_a*t*t);
+        if (t > MAX_DISTANCE)
+            break;
+    }
+    return t;
+}
@@ -0,0 +1,101 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// This shader is one pass of an edge-avoiding a-trous wavelet filter
+// (Dammertz et al. 2010, "Edge-Avoiding A-Trous Wavelet Transform for
+// fast Global Illumination Filtering"), which removes the noise from a
+// render that has few samples. The host runs it between the render pass
+// and compose.f, a few times with iStep = 1, 2, 4, ..., each pass over
+// the output of the previous one. The 5x5 taps of each pass are iStep
+// pixels apart, so the filter widens without needing more taps.
+//
+// Neighbors are weighted down the more their surface differs from the
+// pixel's, by the normals in iGBuffer (the DRAW_MODE_GBUFFER output of
+// geometry.f) and the distances in iDepth (see iDepthPass in the
+// renderers, which unlike geometry.f also covers the ground). They are
+// also weighted down the more their color differs, compared to the noise
+// that the pixel's sample moments (see moments.f) predict. That noise goes
+// down as samples accumulate, so the filter fades out as the render
+// converges.
+//
+// iChannel0 holds sums of samples, with the number of samples in alpha.
+// The output is the filtered mean, with an alpha of 1, so that it can go
+// to the next pass or to compose.f.
+
+uniform sampler2D iChannel0;
+uniform sampler2D iGBuffer;
+uniform sampler2D iDepth;
+uniform sampler2D iMoments;
+uniform int       iStep;
+out vec4          fragColor;
+
+#define NORMAL_SIGMA 0.1 // difference in the normals' xy in iGBuffer ([0,1] per unit)
+#define DEPTH_SIGMA  1.0 // difference in depth relative to the local slope
+#define COLOR_SIGMA  4.0 // difference in luminance relative to the standard error
+
+float luminance(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+vec3 fetchMean(ivec2 p)
+{
+    vec4 sum = texelFetch(iChannel0, p, 0);
+    return sum.rgb/max(sum.a, 1.0);
+}
+
+float fetchDepth(ivec2 p, ivec2 size)
+{
+    return texelFetch(iDepth, clamp(p, ivec2(0), size - 1), 0).r;
+}
+
+void main()
+{
+    ivec2 size = textureSize(iChannel0, 0);
+    ivec2 p = ivec2(iFragCoord);
+    vec3 color = fetchMean(p);
+    vec2 normal = texelFetch(iGBuffer, p, 0).rg;
+    float depth = fetchDepth(p, size);
+    float lum = luminance(color);
+
+    // The change in depth per pixel, from the smaller of the one-sided
+    // differences so that it is not inflated next to an edge.
+    vec2 slope = vec2(
+        min(abs(fetchDepth(p + ivec2(1,0), size) - depth), abs(depth - fetchDepth(p - ivec2(1,0), size))),
+        min(abs(fetchDepth(p + ivec2(0,1), size) - depth), abs(depth - fetchDepth(p - ivec2(0,1), size))));
+
+    // Standard error of the pixel's mean luminance, which is unknown (and
+    // so does not limit the filter) with fewer than two samples. Later
+    // passes see a smoother image, and compare colors more strictly.
+    vec4 m = texelFetch(iMoments, p, 0);
+    float n = max(m.b, 1.0);
+    float error = 1e9;
+    if (m.b >= 2.0)
+    {
+        float mean = m.r/n;
+        error = sqrt(max(m.g/n - mean*mean, 0.0)/(n - 1.0));
+    }
+    float color_scale = COLOR_SIGMA*error/float(iStep) + 1e-4;
+
+    const float h[3] = float[3](3.0/8.0, 1.0/4.0, 1.0/16.0);
+    vec3 sum = vec3(0.0);
+    float weights = 0.0;
+    for (int y = -2; y <= 2; y++)
+    for (int x = -2; x <= 2; x++)
+    {
+        ivec2 offset = ivec2(x, y)*iStep;
+        ivec2 q = clamp(p + offset, ivec2(0), size - 1);
+        vec3 color_q = fetchMean(q);
+        vec2 normal_q = texelFetch(iGBuffer, q, 0).rg;
+        float depth_q = fetchDepth(q, size);
+
+        vec2 dn = normal_q - normal;
+        float w_normal = exp(-dot(dn, dn)/(NORMAL_SIGMA*NORMAL_SIGMA));
+        float w_depth = exp(-abs(depth_q - depth)/(DEPTH_SIGMA*dot(slope, abs(vec2(offset))) + 1e-3*depth + 1e-6));
+        float w_color = exp(-abs(luminance(color_q) - lum)/color_scale);
+        float w = h[abs(x)]*h[abs(y)]*w_normal*w_depth*w_color;
+        sum += w*color_q;
+        weights += w;
+    }
+    fragColor = vec4(sum/weights, 1.0);
+}
@@ -4,8 +4,7 @@
 uniform vec2      iResolution;
 uniform vec2      iCameraCenter;
 uniform float     iCameraF;
-uniform mat4      iView;
-uniform int       iDrawMode;
+uniform int       iDrawMode (specialize);
 uniform float     iMinDistance;
 uniform float     iMaxDistance;
 uniform float     iMinThickness;
@@ -14,24 +13,37 @@ uniform sampler1D iColormap;
 uniform int       iApplyColormap;
 out vec4 fragColor;
 
+// Defaults (can be overridden with fraktal_link_define)
+#ifndef EPSILON
 #define EPSILON 0.0001
+#endif
+#ifndef STEPS
 #define STEPS 512
+#endif
+#ifndef MAX_DISTANCE
 #define MAX_DISTANCE 100.0
+#endif
 
 #define DRAW_MODE_NORMALS   0
 #define DRAW_MODE_DEPTH     1
 #define DRAW_MODE_THICKNESS 2
 #define DRAW_MODE_GBUFFER   3
 
+#include "views.f"
+
 vec3 rayPinhole(vec2 fragOffset)
 {
-    vec2 uv = vec2(gl_FragCoord.x, iResolution.y - gl_FragCoord.y) + fragOffset - iCameraCenter;
+    vec2 uv = vec2(iFragCoord.x, iResolution.y - iFragCoord.y) + fragOffset - iCameraCenter;
     float d = 1.0/length(vec3(uv, iCameraF));
     return vec3(uv*d, -iCameraF*d);
 }
 
 float model(vec3 p); // forward-declaration
 
+#define CONE_MARGIN 0.0
+#include "cone.f"
+#include "trace.f"
+
 // Adapted from Inigo Quilez
 // Source: http://iquilezles.org/www/articles/normalsSDF/normalsSDF.htm
 vec3 normal(vec3 p)
@@ -67,29 +79,27 @@ float calcThickness(vec3 ro, vec3 rd)
     return thickness;
 }
 
-float traceModel(vec3 ro, vec3 rd)
+float traceModel(vec3 ro, vec3 rd, float t)
 {
-    float t = 0.0;
-    for (int i = ZERO; i < STEPS; i++)
-    {
-        vec3 p = ro + t*rd;
-        float d = model(p);
-        if (d <= EPSILON) return t;
-        t += d;
-        if (t > MAX_DISTANCE) break;
-    }
-    return -1.0;
+    return sphereTrace(ro, rd, t, MAX_DISTANCE);
 }
 
 void main()
 {
+    mat4 view = getView();
+    vec3 ro = (view * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+    if (iConePass == 1)
+    {
+        fragColor = vec4(coneTrace(ro, view));
+        return;
+    }
+
     vec3 rd = rayPinhole(vec2(0.0));
-    vec3 ro = (iView * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
-    rd = normalize((iView * vec4(rd, 0.0)).xyz);
+    rd = normalize((view * vec4(rd, 0.0)).xyz);
 
     fragColor = vec4(0.0);
 
-    float t = traceModel(ro, rd);
+    float t = traceModel(ro, rd, coneStart(ivec2(iFragCoord)));
     if (t > 0.0)
     {
         vec3 p = ro + t*rd;
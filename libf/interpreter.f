@@ -0,0 +1,158 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// Evaluates signed distance programs encoded on the host with
+// fraktal_create_sdf_program (see fraktal.h), so that new models can
+// be evaluated without compiling a new kernel. This file is used in
+// place of a model, and like a model it expects hg_sdf.f to be
+// prepended to its source (see load_render_shader in gui.cpp).
+//
+// Each row of iProgram holds one program, where instruction i is
+// stored in the texels (2i, 2i+1) as (opcode, arg0, arg1, arg2) and
+// (arg3, arg4, arg5, arg6). The program is a stack machine: primitives
+// push a distance, operators pop two distances and push the result,
+// and domain operators transform the point.
+//
+// model(p) evaluates the program in row iProgramOffset + iInstance.
+
+uniform sampler2D iProgram;
+uniform int       iProgramOffset;
+
+// Must match the fSdfOp enum in fraktal.h
+#define SDF_END                  0
+#define SDF_SPHERE               1
+#define SDF_BOX                  2
+#define SDF_CYLINDER             3
+#define SDF_CAPSULE              4
+#define SDF_TORUS                5
+#define SDF_PLANE                6
+#define SDF_CONE                 7
+#define SDF_HEXAGON              8
+#define SDF_OCTAHEDRON           9
+#define SDF_DODECAHEDRON         10
+#define SDF_ICOSAHEDRON          11
+#define SDF_UNION                12
+#define SDF_INTERSECTION         13
+#define SDF_DIFFERENCE           14
+#define SDF_UNION_ROUND          15
+#define SDF_INTERSECTION_ROUND   16
+#define SDF_DIFFERENCE_ROUND     17
+#define SDF_UNION_CHAMFER        18
+#define SDF_INTERSECTION_CHAMFER 19
+#define SDF_DIFFERENCE_CHAMFER   20
+#define SDF_UNION_SOFT           21
+#define SDF_UNION_STAIRS         22
+#define SDF_UNION_COLUMNS        23
+#define SDF_PIPE                 24
+#define SDF_ENGRAVE              25
+#define SDF_GROOVE               26
+#define SDF_TONGUE               27
+#define SDF_PUSH_POINT           28
+#define SDF_POP_POINT            29
+#define SDF_TRANSLATE            30
+#define SDF_ROTATE_X             31
+#define SDF_ROTATE_Y             32
+#define SDF_ROTATE_Z             33
+#define SDF_MOD1                 34
+#define SDF_MIRROR               35
+#define SDF_MOD_POLAR            36
+#define SDF_ROUND                37
+
+#define SDF_MAX_INSTRUCTIONS     256
+#define SDF_MAX_STACK            8  // must match FRAKTAL_SDF_MAX_STACK in fraktal.h
+
+float interpret(int row, vec3 p)
+{
+    float stack[SDF_MAX_STACK];
+    vec3 points[SDF_MAX_STACK];
+    int sp = 0;
+    int pp = 0;
+    for (int pc = ZERO; pc < SDF_MAX_INSTRUCTIONS; pc++)
+    {
+        vec4 t0 = texelFetch(iProgram, ivec2(2*pc, row), 0);
+        int op = int(t0.x);
+        if (op == SDF_END)
+            break;
+        vec4 t1 = texelFetch(iProgram, ivec2(2*pc + 1, row), 0);
+        vec3 a = t0.yzw;
+
+        if (op <= SDF_ICOSAHEDRON)
+        {
+            float d = 0.0;
+            if      (op == SDF_SPHERE)       d = fSphere(p, a.x);
+            else if (op == SDF_BOX)          d = fBox(p, a);
+            else if (op == SDF_CYLINDER)     d = fCylinder(p, a.x, a.y);
+            else if (op == SDF_CAPSULE)      d = fCapsule(p, a.x, a.y);
+            else if (op == SDF_TORUS)        d = fTorus(p, a.x, a.y);
+            else if (op == SDF_PLANE)        d = fPlane(p, a, t1.x);
+            else if (op == SDF_CONE)         d = fCone(p, a.x, a.y);
+            else if (op == SDF_HEXAGON)      d = fHexagonCircumcircle(p, a.xy);
+            else if (op == SDF_OCTAHEDRON)   d = fOctahedron(p, a.x);
+            else if (op == SDF_DODECAHEDRON) d = fDodecahedron(p, a.x);
+            else if (op == SDF_ICOSAHEDRON)  d = fIcosahedron(p, a.x);
+            stack[sp] = d;
+            sp++;
+        }
+        else if (op <= SDF_TONGUE)
+        {
+            sp--;
+            float d1 = stack[sp];
+            float d0 = stack[sp - 1];
+            float d = 0.0;
+            if      (op == SDF_UNION)                d = min(d0, d1);
+            else if (op == SDF_INTERSECTION)         d = max(d0, d1);
+            else if (op == SDF_DIFFERENCE)           d = max(d0, -d1);
+            else if (op == SDF_UNION_ROUND)          d = fOpUnionRound(d0, d1, a.x);
+            else if (op == SDF_INTERSECTION_ROUND)   d = fOpIntersectionRound(d0, d1, a.x);
+            else if (op == SDF_DIFFERENCE_ROUND)     d = fOpDifferenceRound(d0, d1, a.x);
+            else if (op == SDF_UNION_CHAMFER)        d = fOpUnionChamfer(d0, d1, a.x);
+            else if (op == SDF_INTERSECTION_CHAMFER) d = fOpIntersectionChamfer(d0, d1, a.x);
+            else if (op == SDF_DIFFERENCE_CHAMFER)   d = fOpDifferenceChamfer(d0, d1, a.x);
+            else if (op == SDF_UNION_SOFT)           d = fOpUnionSoft(d0, d1, a.x);
+            else if (op == SDF_UNION_STAIRS)         d = fOpUnionStairs(d0, d1, a.x, a.y);
+            else if (op == SDF_UNION_COLUMNS)        d = fOpUnionColumns(d0, d1, a.x, a.y);
+            else if (op == SDF_PIPE)                 d = fOpPipe(d0, d1, a.x);
+            else if (op == SDF_ENGRAVE)              d = fOpEngrave(d0, d1, a.x);
+            else if (op == SDF_GROOVE)               d = fOpGroove(d0, d1, a.x, a.y);
+            else if (op == SDF_TONGUE)               d = fOpTongue(d0, d1, a.x, a.y);
+            stack[sp - 1] = d;
+        }
+        else if (op == SDF_PUSH_POINT) { points[pp] = p; pp++; }
+        else if (op == SDF_POP_POINT)  { pp--; p = points[pp]; }
+        else if (op == SDF_TRANSLATE)  p -= a;
+        else if (op == SDF_ROTATE_X)   pR(p.yz, a.x);
+        else if (op == SDF_ROTATE_Y)   pR(p.xz, a.x);
+        else if (op == SDF_ROTATE_Z)   pR(p.xy, a.x);
+        else if (op == SDF_MOD1)
+        {
+            int axis = int(a.x);
+            if      (axis == 0) pMod1(p.x, a.y);
+            else if (axis == 1) pMod1(p.y, a.y);
+            else                pMod1(p.z, a.y);
+        }
+        else if (op == SDF_MIRROR)
+        {
+            int axis = int(a.x);
+            if      (axis == 0) pMirror(p.x, a.y);
+            else if (axis == 1) pMirror(p.y, a.y);
+            else                pMirror(p.z, a.y);
+        }
+        else if (op == SDF_MOD_POLAR)
+        {
+            int axis = int(a.x);
+            if      (axis == 0) pModPolar(p.yz, a.y);
+            else if (axis == 1) pModPolar(p.xz, a.y);
+            else                pModPolar(p.xy, a.y);
+        }
+        else if (op == SDF_ROUND)
+        {
+            stack[sp - 1] -= a.x;
+        }
+    }
+    return sp > 0 ? stack[sp - 1] : 1.0e10;
+}
+
+float model(vec3 p)
+{
+    return interpret(iProgramOffset + iInstance, p);
+}
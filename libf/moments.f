@@ -0,0 +1,75 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// This shader tracks per-pixel moments of the samples accumulated by a
+// renderer, to estimate how far each pixel is from convergence (see
+// adaptive.f). It runs after each accumulation pass with the sum of the
+// samples (iChannel0) and its own previous output (iChannel1), and
+// outputs
+//     r: luminance of the sum
+//     g: sum of the squared luminance of each sample
+//     b: number of samples
+//     a: 1 if the pixel has converged, 0 otherwise
+// The luminance of the latest sample is the difference between the
+// luminance of the sum and that of the previous sum. Each sample is
+// expected to have an alpha of 1, so the alpha of the sum is the number
+// of samples.
+
+uniform sampler2D iChannel0;
+uniform sampler2D iChannel1;
+uniform float     iErrorThreshold; // largest error of a converged pixel, in displayed intensity
+uniform int       iMinSamples;     // samples needed before a pixel can converge
+out vec4          fragColor;
+
+float luminance(vec3 c)
+{
+    return dot(c, vec3(0.2126, 0.7152, 0.0722));
+}
+
+void main()
+{
+    ivec2 p = ivec2(iFragCoord);
+    vec4 sum = texelFetch(iChannel0, p, 0);
+    vec4 m = texelFetch(iChannel1, p, 0);
+    if (sum.a > m.b)
+    {
+        float l = luminance(sum.rgb);
+        float x = l - m.r;
+        m.r = l;
+        m.g += x*x;
+        m.b = sum.a;
+    }
+
+    // The variance is estimated over the 3x3 neighborhood, from this
+    // pixel's moments and the previous moments of its neighbors. A pixel
+    // on an edge can get the same value from all of its first samples,
+    // and its own variance would then say it has converged, but the
+    // difference from its neighbors says otherwise.
+    float n = max(m.b, 1.0);
+    float mean = m.r/n;
+    float mean_sum = 0.0;
+    float square_sum = 0.0;
+    float count = 0.0;
+    ivec2 size = textureSize(iChannel1, 0);
+    for (int y = -1; y <= 1; y++)
+    for (int x = -1; x <= 1; x++)
+    {
+        vec4 q = (x == 0 && y == 0) ? m : texelFetch(iChannel1, clamp(p + ivec2(x, y), ivec2(0), size - 1), 0);
+        if (q.b > 0.0)
+        {
+            mean_sum += q.r/q.b;
+            square_sum += q.g/q.b;
+            count += 1.0;
+        }
+    }
+    count = max(count, 1.0);
+    float variance = max(square_sum/count - (mean_sum/count)*(mean_sum/count), 0.0)*n/max(n - 1.0, 1.0);
+
+    // The error is the standard error of the mean luminance after the
+    // square root in compose.f, so that the threshold is uniform across
+    // bright and dark pixels as they are displayed.
+    float deviation = sqrt(variance/n);
+    float error = sqrt(max(mean, 0.0) + deviation) - sqrt(max(mean, 0.0));
+    m.a = (m.b >= float(iMinSamples) && error <= iErrorThreshold) ? 1.0 : 0.0;
+    fragColor = m;
+}
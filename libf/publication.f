@@ -5,8 +5,8 @@ uniform vec2      iResolution;
 uniform int       iFrame;
 uniform vec2      iCameraCenter;
 uniform float     iCameraF;
-uniform mat4      iView;
 uniform int       iSamples;
+uniform int       iDepthPass (specialize); // 1: output the depth of each pixel center instead of rendering
 uniform vec3      iToSun;
 uniform vec3      iSunStrength;
 uniform float     iCosSunSize;
@@ -15,20 +15,27 @@ uniform vec3      iIsolineColor;
 uniform float     iIsolineThickness;
 uniform float     iIsolineSpacing;
 uniform float     iIsolineMax;
-uniform int       iMaterialGlossy;
+uniform int       iMaterialGlossy (specialize);
 uniform float     iMaterialSpecularExponent;
 uniform vec3      iMaterialSpecularAlbedo;
 uniform vec3      iMaterialAlbedo;
-uniform int       iGroundReflective;
+uniform int       iGroundReflective (specialize);
 uniform float     iGroundHeight;
 uniform float     iGroundSpecularExponent;
 uniform float     iGroundReflectivity;
 out vec4          fragColor;
 
+// Defaults (can be overridden with fraktal_link_define)
+#ifndef EPSILON
 #define EPSILON 0.0007
+#endif
+#ifndef STEPS
 #define STEPS 512
+#endif
 #define M_PI 3.1415926535897932384626433832795
+#ifndef MAX_DISTANCE
 #define MAX_DISTANCE 100.0
+#endif
 #define MAX_DISTANCE_VISIBILITY_TEST 10.0
 
 float model(vec3 p); // forward declaration
@@ -42,9 +49,16 @@ vec2 noise2f()
                 fract(cos(dot(seed.xy, vec2(4.898, 7.23))) * 23421.631));
 }
 
+#include "views.f"
+
+#define CONE_GROUND iGroundHeight
+#include "cone.f"
+#include "trace.f"
+#include "adaptive.f"
+
 vec3 rayPinhole(vec2 fragOffset)
 {
-    vec2 uv = vec2(gl_FragCoord.x, iResolution.y - gl_FragCoord.y) + fragOffset - iCameraCenter;
+    vec2 uv = vec2(iFragCoord.x, iResolution.y - iFragCoord.y) + fragOffset - iCameraCenter;
     float d = 1.0/length(vec3(uv, iCameraF));
     return vec3(uv*d, -iCameraF*d);
 }
@@ -68,18 +82,9 @@ float traceGround(vec3 ro, vec3 rd)
     else return (iGroundHeight - ro.y)/rd.y;
 }
 
-float traceModel(vec3 ro, vec3 rd)
+float traceModel(vec3 ro, vec3 rd, float t)
 {
-    float t = 0.0;
-    for (int i = ZERO; i < STEPS; i++)
-    {
-        vec3 p = ro + t*rd;
-        float d = model(p);
-        if (d <= EPSILON) return t;
-        t += d;
-        if (t > MAX_DISTANCE) break;
-    }
-    return -1.0;
+    return sphereTrace(ro, rd, t, MAX_DISTANCE);
 }
 
 bool isVisible(vec3 ro, vec3 rd)
@@ -87,17 +92,7 @@ bool isVisible(vec3 ro, vec3 rd)
     float tGround = traceGround(ro, rd);
     if (tGround > EPSILON)
         return false;
-    float t = 0.0;
-    for (int i = ZERO; i < STEPS; i++)
-    {
-        float d = model(ro + t*rd);
-        t += d;
-        if (d <= EPSILON)
-            return false;
-        if (t > MAX_DISTANCE_VISIBILITY_TEST)
-            break;
-    }
-    return true;
+    return sphereTrace(ro, rd, 0.0, MAX_DISTANCE_VISIBILITY_TEST) < 0.0;
 }
 
 vec3 cosineWeightedSample(vec3 normal)
@@ -192,7 +187,7 @@ vec3 colorGround(vec3 p, vec3 ro)
     {
         vec3 w_s = v - 2.0*dot(n, v)*n;
         rd = phongWeightedSample(w_s, iGroundSpecularExponent);
-        float tModel = traceModel(ro, rd);
+        float tModel = traceModel(ro, rd, 0.0);
         if (tModel > 0.0)
             result = mix(result, colorModel(ro + tModel*rd, ro), iGroundReflectivity);
     }
@@ -202,12 +197,35 @@ vec3 colorGround(vec3 p, vec3 ro)
 
 void main()
 {
+    mat4 view = getView();
+    vec3 ro = (view * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
+    if (iConePass == 1)
+    {
+        fragColor = vec4(coneTrace(ro, view));
+        return;
+    }
+    if (iDepthPass == 1)
+    {
+        // Distance to the first surface, or 0 if there is none (see reproject.f)
+        vec3 rd = normalize((view * vec4(rayPinhole(vec2(0.0)), 0.0)).xyz);
+        float t = max(traceModel(ro, rd, coneStart(ivec2(iFragCoord))), 0.0);
+        float tGround = traceGround(ro, rd);
+        if (tGround > 0.0 && (t == 0.0 || tGround < t))
+            t = tGround;
+        fragColor = vec4(t);
+        return;
+    }
+    if (isConverged())
+    {
+        fragColor = vec4(0.0);
+        return;
+    }
+
     vec3 rd = rayPinhole(2.0*(noise2f() - vec2(0.5)));
-    vec3 ro = (iView * vec4(0.0, 0.0, 0.0, 1.0)).xyz;
-    rd = normalize((iView * vec4(rd, 0.0)).xyz);
+    rd = normalize((view * vec4(rd, 0.0)).xyz);
 
     fragColor.rgb = vec3(1.0);
-    float tModel = traceModel(ro, rd);
+    float tModel = traceModel(ro, rd, coneStart(ivec2(iFragCoord)));
     float tGround = traceGround(ro, rd);
     if (tGround > 0.0 && ((tModel > 0.0 && tGround < tModel) || tModel < 0.0))
         fragColor.rgb = colorGround(ro + rd*tGround, ro);
@@ -0,0 +1,26 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// This shader sums each block of iBlock x iBlock texels of iChannel0, so
+// that a statistic of a large array can be read back to the CPU from a
+// small one (e.g. the number of converged pixels in the output of
+// moments.f).
+
+uniform sampler2D iChannel0;
+uniform int       iBlock;
+out vec4          fragColor;
+
+void main()
+{
+    ivec2 size = textureSize(iChannel0, 0);
+    ivec2 p0 = ivec2(iFragCoord)*iBlock;
+    vec4 sum = vec4(0.0);
+    for (int y = ZERO; y < iBlock; y++)
+    for (int x = ZERO; x < iBlock; x++)
+    {
+        ivec2 p = p0 + ivec2(x, y);
+        if (p.x < size.x && p.y < size.y)
+            sum += texelFetch(iChannel0, p, 0);
+    }
+    fragColor = sum;
+}
@@ -0,0 +1,72 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// This shader reprojects a sum of accumulated samples (iChannel0), which
+// was rendered from a previous camera, into the current camera, so that
+// the GUI can keep accumulating samples while the camera moves instead of
+// starting over. iDepth and iPrevDepth hold the distance to the first
+// surface along the ray through each pixel center, or 0 if there is none,
+// in the current and the previous camera (see iDepthPass in the
+// renderers).
+//
+// Each pixel finds the point it sees in the previous image. The sum there
+// is kept if the previous camera saw the same point, and dropped if the
+// point was occluded or outside that image, with a smooth transition in
+// between. The sum is also scaled down to at most iHistory samples, so
+// that the error from taking the nearest previous pixel does not build
+// up over many moves. Since
+// the sum is only scaled, its mean is unchanged, and any array of sums
+// can be reprojected, given the channel that counts the samples.
+
+uniform vec2      iResolution;
+uniform vec2      iCameraCenter;
+uniform float     iCameraF;
+uniform mat4      iView;
+uniform vec2      iPrevCameraCenter;
+uniform float     iPrevCameraF;
+uniform mat4      iPrevView;
+uniform sampler2D iChannel0;
+uniform sampler2D iDepth;
+uniform sampler2D iPrevDepth;
+uniform int       iCountChannel; // channel of iChannel0 that holds the number of samples
+uniform float     iHistory;      // largest number of samples kept
+out vec4          fragColor;
+
+// Relative difference in depth at which the previous sample is kept fully,
+// and at which it is dropped.
+#define DEPTH_KEEP 0.01
+#define DEPTH_DROP 0.05
+
+void main()
+{
+    fragColor = vec4(0.0);
+
+    vec2 uv = vec2(iFragCoord.x, iResolution.y - iFragCoord.y) - iCameraCenter;
+    vec3 rd = (iView * vec4(normalize(vec3(uv, -iCameraF)), 0.0)).xyz;
+    vec3 ro = iView[3].xyz;
+    float depth = texelFetch(iDepth, ivec2(iFragCoord), 0).r;
+
+    // The view matrices are rigid transforms from camera to world, so the
+    // inverse rotation is the transpose. Pixels that see nothing are
+    // reprojected by their direction alone.
+    mat3 to_prev = transpose(mat3(iPrevView));
+    vec3 q = depth > 0.0 ? to_prev*(ro + depth*rd - iPrevView[3].xyz) : to_prev*rd;
+    if (q.z >= 0.0)
+        return;
+    vec2 prev_uv = q.xy*(iPrevCameraF/(-q.z)) + iPrevCameraCenter;
+    vec2 prev = vec2(prev_uv.x, iResolution.y - prev_uv.y);
+    if (any(lessThan(prev, vec2(0.0))) || any(greaterThanEqual(prev, iResolution)))
+        return;
+
+    ivec2 prev_pixel = ivec2(prev);
+    float prev_depth = texelFetch(iPrevDepth, prev_pixel, 0).r;
+    float confidence;
+    if (depth > 0.0 && prev_depth > 0.0)
+        confidence = 1.0 - smoothstep(DEPTH_KEEP, DEPTH_DROP, abs(prev_depth - length(q))/length(q));
+    else
+        confidence = (depth > 0.0 || prev_depth > 0.0) ? 0.0 : 1.0;
+
+    vec4 sum = texelFetch(iChannel0, prev_pixel, 0);
+    float samples = sum[iCountChannel];
+    fragColor = sum*confidence*min(1.0, iHistory/max(samples, 1.0));
+}
@@ -0,0 +1,48 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// Sphere tracing routine shared by the renderers in libf. The renderer
+// must define STEPS and EPSILON before including this file. The model is
+// evaluated through the brick cache in brick.f, if the host has baked one.
+
+#include "brick.f"
+
+// Over-relaxation factor of the steps, which can be overridden per kernel
+// with fraktal_link_define. 1.0 gives plain sphere tracing.
+#ifndef OMEGA
+#define OMEGA 1.3
+#endif
+
+// Traces the model from ro + t*rd and returns the distance of the first
+// hit, or -1.0 if there is none within t_max.
+//
+// Steps are over-relaxed (step = OMEGA*d), which converges much faster
+// along rays that graze a surface. An over-relaxed step is only safe if
+// the unbounding spheres at its two ends overlap. If they do not, the
+// step may have skipped past the surface, so the trace goes back and
+// continues with plain steps (Keinert et al. 2014, "Enhanced Sphere
+// Tracing").
+float sphereTrace(vec3 ro, vec3 rd, float t, float t_max)
+{
+    float omega = OMEGA;
+    float prev_t = t;
+    float prev_d = 0.0;
+    for (int i = ZERO; i < STEPS; i++)
+    {
+        float d = cachedModel(ro + t*rd);
+        if (omega > 1.0 && d + prev_d < t - prev_t)
+        {
+            t = prev_t + prev_d;
+            omega = 1.0;
+            continue;
+        }
+        if (d <= EPSILON)
+            return t <= t_max ? t : -1.0;
+        prev_t = t;
+        prev_d = d;
+        if (t + d > t_max)
+            break;
+        t += omega*d;
+    }
+    return -1.0;
+}
@@ -0,0 +1,22 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+// Camera view, included by the renderers in libf. The view is iView,
+// unless iUseViews is 1, in which case each instance takes its view
+// from row iInstance of iViews (see fraktal_run_kernel_instanced).
+
+uniform mat4      iView;
+uniform sampler2D iViews;    // per-instance view matrices (one per row, column-major)
+uniform int       iUseViews; // 1: use iViews (see fraktal_run_kernel_instanced)
+
+mat4 getView()
+{
+    if (iUseViews == 1)
+    {
+        return mat4(texelFetch(iViews, ivec2(0, iInstance), 0),
+                    texelFetch(iViews, ivec2(1, iInstance), 0),
+                    texelFetch(iViews, ivec2(2, iInstance), 0),
+                    texelFetch(iViews, ivec2(3, iInstance), 0));
+    }
+    return iView;
+}
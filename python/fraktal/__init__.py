@@ -50,6 +50,11 @@ CLAMP_TO_EDGE = 4
 REPEAT        = 5
 LINEAR        = 6
 NEAREST       = 7
+MODEL_PER_INSTANCE = 8
+MODEL_PER_ROW      = 9
+VALIDATION_OFF     = 10
+VALIDATION_ERRORS  = 11
+VALIDATION_FULL    = 12
 
 class FraktalError(Exception):
     def __init__(self, message):
@@ -131,11 +136,21 @@ _fraktal.fraktal_create_link.argtypes = []
 def create_link():
     return _fraktal.fraktal_create_link()
 
+_fraktal.fraktal_create_deferred_link.restype = ctypes.c_void_p
+_fraktal.fraktal_create_deferred_link.argtypes = []
+def create_deferred_link():
+    return _fraktal.fraktal_create_deferred_link()
+
 _fraktal.fraktal_destroy_link.restype = None
 _fraktal.fraktal_destroy_link.argtypes = [ctypes.c_void_p]
 def destroy_link(link):
     return _fraktal.fraktal_destroy_link(link)
 
+_fraktal.fraktal_link_define.restype = ctypes.c_bool
+_fraktal.fraktal_link_define.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_char_p]
+def link_define(link, name, value=None):
+    return _fraktal.fraktal_link_define(link, _to_char_p(name), _to_char_p(str(value)) if value is not None else None)
+
 _fraktal.fraktal_add_link_data.restype = None
 _fraktal.fraktal_add_link_data.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_size_t, ctypes.c_char_p]
 def add_link_data(link, data, size, name):
@@ -146,6 +161,22 @@ _fraktal.fraktal_add_link_file.argtypes = [ctypes.c_void_p, ctypes.c_char_p]
 def add_link_file(link, path):
     return _fraktal.fraktal_add_link_file(link, _to_char_p(path))
 
+_fraktal.fraktal_add_link_models.restype = ctypes.c_bool
+_fraktal.fraktal_add_link_models.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_int, ctypes.c_int, ctypes.c_char_p]
+def add_link_models(link, models, dispatch, name=None):
+    sources = (ctypes.c_char_p*len(models))(*[_to_char_p(m) for m in models])
+    return _fraktal.fraktal_add_link_models(link, sources, len(models), dispatch, _to_char_p(name) if name else None)
+
+_fraktal.fraktal_add_link_epilogue.restype = ctypes.c_bool
+_fraktal.fraktal_add_link_epilogue.argtypes = [ctypes.c_void_p, ctypes.c_char_p, ctypes.c_uint, ctypes.c_char_p]
+def add_link_epilogue(link, data, name=None):
+    return _fraktal.fraktal_add_link_epilogue(link, _to_char_p(data), 0, _to_char_p(name) if name else None)
+
+_fraktal.fraktal_link_kernel.restype = ctypes.c_void_p
+_fraktal.fraktal_link_kernel.argtypes = [ctypes.c_void_p]
+def link_kernel(link):
+    return _fraktal.fraktal_link_kernel(link)
+
 _fraktal.fraktal_destroy_kernel.restype = None
 _fraktal.fraktal_destroy_kernel.argtypes = [ctypes.c_void_p]
 def destroy_kernel(kernel):
@@ -156,6 +187,51 @@ _fraktal.fraktal_load_kernel.argtypes = [ctypes.c_char_p]
 def load_kernel(filename):
     return _fraktal.fraktal_load_kernel(_to_char_p(filename))
 
+_fraktal.fraktal_freeze_kernel.restype = ctypes.c_void_p
+_fraktal.fraktal_freeze_kernel.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p), ctypes.c_int]
+def freeze_kernel(kernel, names=None):
+    names = names or []
+    c_names = (ctypes.c_char_p*len(names))(*[_to_char_p(n) for n in names])
+    return _fraktal.fraktal_freeze_kernel(kernel, c_names, len(names))
+
+_fraktal.fraktal_set_kernel_cache.restype = None
+_fraktal.fraktal_set_kernel_cache.argtypes = [ctypes.c_int]
+def set_kernel_cache(max_kernels):
+    _fraktal.fraktal_set_kernel_cache(max_kernels)
+
+_fraktal.fraktal_get_kernel_cache_stats.restype = None
+_fraktal.fraktal_get_kernel_cache_stats.argtypes = [ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int), ctypes.POINTER(ctypes.c_int)]
+def get_kernel_cache_stats():
+    hits = ctypes.c_int(0)
+    misses = ctypes.c_int(0)
+    count = ctypes.c_int(0)
+    _fraktal.fraktal_get_kernel_cache_stats(ctypes.pointer(hits), ctypes.pointer(misses), ctypes.pointer(count))
+    return hits.value, misses.value, count.value
+
+# Callbacks of queued links, keyed by the 'user' value passed to
+# fraktal_queue_link, are kept here until the link has been run.
+_link_callback_type = ctypes.CFUNCTYPE(None, ctypes.c_void_p, ctypes.c_void_p)
+_link_callbacks = {}
+_link_callback_id = 0
+def _link_done(kernel, user):
+    done = _link_callbacks.pop(user)
+    if done:
+        done(kernel)
+_link_done_c = _link_callback_type(_link_done)
+
+_fraktal.fraktal_queue_link.restype = None
+_fraktal.fraktal_queue_link.argtypes = [ctypes.c_void_p, _link_callback_type, ctypes.c_void_p]
+def queue_link(link, done=None):
+    global _link_callback_id
+    _link_callback_id += 1
+    _link_callbacks[_link_callback_id] = done
+    _fraktal.fraktal_queue_link(link, _link_done_c, _link_callback_id)
+
+_fraktal.fraktal_run_link_queue.restype = ctypes.c_int
+_fraktal.fraktal_run_link_queue.argtypes = [ctypes.c_int]
+def run_link_queue(max_links=0):
+    return _fraktal.fraktal_run_link_queue(max_links)
+
 _fraktal.fraktal_use_kernel.restype = None
 _fraktal.fraktal_use_kernel.argtypes = [ctypes.c_void_p]
 def use_kernel(kernel):
@@ -166,6 +242,21 @@ _fraktal.fraktal_run_kernel.argtypes = [ctypes.c_void_p]
 def run_kernel(array):
     _fraktal.fraktal_run_kernel(array)
 
+_fraktal.fraktal_run_kernel_instanced.restype = None
+_fraktal.fraktal_run_kernel_instanced.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+def run_kernel_instanced(array, count, tile_width, tile_height):
+    _fraktal.fraktal_run_kernel_instanced(array, count, tile_width, tile_height)
+
+_fraktal.fraktal_run_kernel_fused.restype = None
+_fraktal.fraktal_run_kernel_fused.argtypes = [ctypes.c_void_p, ctypes.c_void_p]
+def run_kernel_fused(array, epilogue_array):
+    _fraktal.fraktal_run_kernel_fused(array, epilogue_array)
+
+_fraktal.fraktal_set_compute_tile.restype = ctypes.c_bool
+_fraktal.fraktal_set_compute_tile.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int]
+def set_compute_tile(kernel, tile_width, tile_height):
+    return _fraktal.fraktal_set_compute_tile(kernel, tile_width, tile_height)
+
 ############################################################
 # §4 Parameters
 ############################################################
@@ -235,6 +326,21 @@ _fraktal.fraktal_param_array.argtypes = [ctypes.c_int, ctypes.c_void_p]
 def param_array(offset, array):
     return _fraktal.fraktal_param_array(offset, array)
 
+_fraktal.fraktal_get_param_vector_layout.restype = ctypes.c_int
+_fraktal.fraktal_get_param_vector_layout.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_char_p), ctypes.POINTER(ctypes.c_int), ctypes.c_int]
+def get_param_vector_layout(kernel):
+    count = _fraktal.fraktal_get_param_vector_layout(kernel, None, None, 0)
+    names = (ctypes.c_char_p*count)()
+    components = (ctypes.c_int*count)()
+    _fraktal.fraktal_get_param_vector_layout(kernel, names, components, count)
+    return [(names[i].decode('utf-8'), components[i]) for i in range(count)]
+
+_fraktal.fraktal_set_param_vector.restype = None
+_fraktal.fraktal_set_param_vector.argtypes = [ctypes.c_void_p, ctypes.POINTER(ctypes.c_float), ctypes.c_int]
+def set_param_vector(kernel, x):
+    values = (ctypes.c_float*len(x))(*x)
+    _fraktal.fraktal_set_param_vector(kernel, values, len(x))
+
 
 ############################################################
 # §5 Context management
@@ -259,3 +365,172 @@ _fraktal.fraktal_pop_current_context.restype = None
 _fraktal.fraktal_pop_current_context.argtypes = []
 def pop_current_context():
     _fraktal.fraktal_pop_current_context()
+
+_fraktal.fraktal_set_exclusive_context.restype = None
+_fraktal.fraktal_set_exclusive_context.argtypes = [ctypes.c_bool]
+def set_exclusive_context(exclusive):
+    _fraktal.fraktal_set_exclusive_context(exclusive)
+
+_fraktal.fraktal_set_validation.restype = None
+_fraktal.fraktal_set_validation.argtypes = [ctypes.c_int]
+def set_validation(level):
+    _fraktal.fraktal_set_validation(level)
+
+############################################################
+# §6 Command lists
+############################################################
+
+_fraktal.fraktal_create_command_list.restype = ctypes.c_void_p
+_fraktal.fraktal_create_command_list.argtypes = []
+def create_command_list():
+    return _fraktal.fraktal_create_command_list()
+
+_fraktal.fraktal_destroy_command_list.restype = None
+_fraktal.fraktal_destroy_command_list.argtypes = [ctypes.c_void_p]
+def destroy_command_list(command_list):
+    _fraktal.fraktal_destroy_command_list(command_list)
+
+_fraktal.fraktal_begin_command_list.restype = None
+_fraktal.fraktal_begin_command_list.argtypes = [ctypes.c_void_p]
+def begin_command_list(command_list):
+    _fraktal.fraktal_begin_command_list(command_list)
+
+_fraktal.fraktal_end_command_list.restype = None
+_fraktal.fraktal_end_command_list.argtypes = []
+def end_command_list():
+    _fraktal.fraktal_end_command_list()
+
+_fraktal.fraktal_patch_param.restype = ctypes.c_int
+_fraktal.fraktal_patch_param.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_void_p]
+def patch_param(command_list, kernel, offset, values, is_int=False):
+    """
+    'values' is a sequence of numbers matching the recorded call,
+    e.g. three numbers for param_3f, or a flattened column major
+    matrix for param_matrix4f.
+    """
+    data_type = (ctypes.c_int if is_int else ctypes.c_float) * len(values)
+    pdata = data_type(*values)
+    return _fraktal.fraktal_patch_param(command_list, kernel, offset, pdata)
+
+def patch_param_array(command_list, kernel, offset, array):
+    parray = ctypes.c_void_p(array)
+    return _fraktal.fraktal_patch_param(command_list, kernel, offset, ctypes.byref(parray))
+
+_fraktal.fraktal_run_command_list.restype = None
+_fraktal.fraktal_run_command_list.argtypes = [ctypes.c_void_p]
+def run_command_list(command_list):
+    _fraktal.fraktal_run_command_list(command_list)
+
+############################################################
+# §7 SDF programs
+############################################################
+
+# Operations (see fSdfOp in fraktal.h for their arguments)
+SDF_END                  = 0
+SDF_SPHERE               = 1
+SDF_BOX                  = 2
+SDF_CYLINDER             = 3
+SDF_CAPSULE              = 4
+SDF_TORUS                = 5
+SDF_PLANE                = 6
+SDF_CONE                 = 7
+SDF_HEXAGON              = 8
+SDF_OCTAHEDRON           = 9
+SDF_DODECAHEDRON         = 10
+SDF_ICOSAHEDRON          = 11
+SDF_UNION                = 12
+SDF_INTERSECTION         = 13
+SDF_DIFFERENCE           = 14
+SDF_UNION_ROUND          = 15
+SDF_INTERSECTION_ROUND   = 16
+SDF_DIFFERENCE_ROUND     = 17
+SDF_UNION_CHAMFER        = 18
+SDF_INTERSECTION_CHAMFER = 19
+SDF_DIFFERENCE_CHAMFER   = 20
+SDF_UNION_SOFT           = 21
+SDF_UNION_STAIRS         = 22
+SDF_UNION_COLUMNS        = 23
+SDF_PIPE                 = 24
+SDF_ENGRAVE              = 25
+SDF_GROOVE               = 26
+SDF_TONGUE               = 27
+SDF_PUSH_POINT           = 28
+SDF_POP_POINT            = 29
+SDF_TRANSLATE            = 30
+SDF_ROTATE_X             = 31
+SDF_ROTATE_Y             = 32
+SDF_ROTATE_Z             = 33
+SDF_MOD1                 = 34
+SDF_MIRROR               = 35
+SDF_MOD_POLAR            = 36
+SDF_ROUND                = 37
+
+_fraktal.fraktal_create_sdf_program.restype = ctypes.c_void_p
+_fraktal.fraktal_create_sdf_program.argtypes = []
+def create_sdf_program():
+    return _fraktal.fraktal_create_sdf_program()
+
+_fraktal.fraktal_destroy_sdf_program.restype = None
+_fraktal.fraktal_destroy_sdf_program.argtypes = [ctypes.c_void_p]
+def destroy_sdf_program(program):
+    _fraktal.fraktal_destroy_sdf_program(program)
+
+_fraktal.fraktal_add_sdf_op.restype = ctypes.c_bool
+_fraktal.fraktal_add_sdf_op.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_void_p, ctypes.c_int]
+def add_sdf_op(program, op, *args):
+    data_type = ctypes.c_float * len(args)
+    pdata = data_type(*args) if len(args) > 0 else None
+    return _fraktal.fraktal_add_sdf_op(program, op, pdata, len(args))
+
+_fraktal.fraktal_create_sdf_array.restype = ctypes.c_void_p
+_fraktal.fraktal_create_sdf_array.argtypes = [ctypes.c_void_p, ctypes.c_int]
+def create_sdf_array(programs):
+    data_type = ctypes.c_void_p * len(programs)
+    pdata = data_type(*programs)
+    return _fraktal.fraktal_create_sdf_array(pdata, len(programs))
+
+############################################################
+# §8 Graphs
+############################################################
+
+_fraktal.fraktal_create_graph.restype = ctypes.c_void_p
+_fraktal.fraktal_create_graph.argtypes = []
+def create_graph():
+    return _fraktal.fraktal_create_graph()
+
+_fraktal.fraktal_destroy_graph.restype = None
+_fraktal.fraktal_destroy_graph.argtypes = [ctypes.c_void_p]
+def destroy_graph(graph):
+    _fraktal.fraktal_destroy_graph(graph)
+
+_fraktal.fraktal_create_graph_array.restype = ctypes.c_void_p
+_fraktal.fraktal_create_graph_array.argtypes = [ctypes.c_void_p, ctypes.c_int, ctypes.c_int, ctypes.c_int, ctypes.c_int]
+def create_graph_array(graph, width, height, channels, format):
+    return _fraktal.fraktal_create_graph_array(graph, width, height, channels, format)
+
+_fraktal.fraktal_begin_graph_pass.restype = None
+_fraktal.fraktal_begin_graph_pass.argtypes = [ctypes.c_void_p]
+def begin_graph_pass(graph):
+    _fraktal.fraktal_begin_graph_pass(graph)
+
+_fraktal.fraktal_end_graph_pass.restype = None
+_fraktal.fraktal_end_graph_pass.argtypes = []
+def end_graph_pass():
+    _fraktal.fraktal_end_graph_pass()
+
+_fraktal.fraktal_compile_graph.restype = None
+_fraktal.fraktal_compile_graph.argtypes = [ctypes.c_void_p]
+def compile_graph(graph):
+    _fraktal.fraktal_compile_graph(graph)
+
+_fraktal.fraktal_patch_graph_param.restype = ctypes.c_int
+_fraktal.fraktal_patch_graph_param.argtypes = [ctypes.c_void_p, ctypes.c_void_p, ctypes.c_int, ctypes.c_void_p]
+def patch_graph_param(graph, kernel, offset, values, is_int=False):
+    data_type = (ctypes.c_int if is_int else ctypes.c_float) * len(values)
+    pdata = data_type(*values)
+    return _fraktal.fraktal_patch_graph_param(graph, kernel, offset, pdata)
+
+_fraktal.fraktal_run_graph.restype = None
+_fraktal.fraktal_run_graph.argtypes = [ctypes.c_void_p]
+def run_graph(graph):
+    _fraktal.fraktal_run_graph(graph)
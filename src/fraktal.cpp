@@ -42,11 +42,16 @@ or #define them directly if you do a unity build.
 #include <GL/gl3w.c>
 #endif
 
-#define fraktal_check_gl_error() fraktal_assert(glGetError() == GL_NO_ERROR)
+// Polls for OpenGL errors at FRAKTAL_VALIDATION_FULL (see fraktal_set_validation)
+#define fraktal_check_gl_error() do { if (fraktal_validation == FRAKTAL_VALIDATION_FULL) fraktal_poll_gl_error(__FILE__, __LINE__); } while (0)
 
 #include "fraktal_types.h"
+#include "fraktal_state.h"
 #include "fraktal_context.h"
+#include "fraktal_command.h"
 #include "fraktal_array.h"
 #include "fraktal_kernel.h"
 #include "fraktal_parse.h"
 #include "fraktal_link.h"
+#include "fraktal_sdf.h"
+#include "fraktal_graph.h"
@@ -20,21 +20,59 @@ Index of this file:
 ....fraktal_get_gl_handle
 §3 Kernels
 ....fraktal_create_link
+....fraktal_create_deferred_link
 ....fraktal_destroy_link
+....fraktal_link_define
 ....fraktal_add_link_data
+....fraktal_add_link_models
+....fraktal_add_link_epilogue
 ....fraktal_link_kernel
 ....fraktal_destroy_kernel
 ....fraktal_load_kernel
+....fraktal_freeze_kernel
+....fraktal_set_kernel_cache
+....fraktal_get_kernel_cache_stats
+....fraktal_queue_link
+....fraktal_run_link_queue
 ....fraktal_use_kernel
 ....fraktal_run_kernel
+....fraktal_run_kernel_instanced
+....fraktal_run_kernel_fused
+....fraktal_set_compute_tile
 §4 Parameters
 ....fraktal_get_param_offset
 ....fraktal_param_...
+....fraktal_get_param_vector_layout
+....fraktal_set_param_vector
 §5 Context management
 ....fraktal_create_context
 ....fraktal_destroy_context
 ....fraktal_push_current_context
 ....fraktal_pop_current_context
+....fraktal_set_exclusive_context
+....fraktal_set_validation
+§6 Command lists
+....fraktal_create_command_list
+....fraktal_destroy_command_list
+....fraktal_begin_command_list
+....fraktal_end_command_list
+....fraktal_patch_param
+....fraktal_run_command_list
+§7 SDF programs
+....fSdfOp
+....fraktal_create_sdf_program
+....fraktal_destroy_sdf_program
+....fraktal_add_sdf_op
+....fraktal_create_sdf_array
+§8 Graphs
+....fraktal_create_graph
+....fraktal_destroy_graph
+....fraktal_create_graph_array
+....fraktal_begin_graph_pass
+....fraktal_end_graph_pass
+....fraktal_compile_graph
+....fraktal_patch_graph_param
+....fraktal_run_graph
 */
 
 #pragma once
@@ -78,11 +116,23 @@ enum fEnum_
     // Texture filter modes
     FRAKTAL_LINEAR,
     FRAKTAL_NEAREST,
+
+    // Model dispatch modes (see fraktal_add_link_models)
+    FRAKTAL_MODEL_PER_INSTANCE,
+    FRAKTAL_MODEL_PER_ROW,
+
+    // Validation levels (see fraktal_set_validation)
+    FRAKTAL_VALIDATION_OFF,
+    FRAKTAL_VALIDATION_ERRORS,
+    FRAKTAL_VALIDATION_FULL,
 };
 
 struct fArray;
 struct fKernel;
 struct fLinkState;
+struct fCommandList;
+struct fSdfProgram;
+struct fGraph;
 
 //-----------------------------------------------------------------------------
 // §2 Arrays
@@ -179,6 +229,17 @@ FRAKTALAPI unsigned int fraktal_get_gl_handle(fArray *a);
 */
 FRAKTALAPI fLinkState *fraktal_create_link();
 
+/*
+    Creates a link that can be prepared on any thread. The link's
+    sources are parsed when they are added, as usual, but are compiled
+    by fraktal_link_kernel instead, which must be called on the thread
+    that owns the context (e.g. through fraktal_queue_link).
+
+    Different threads can prepare different links at the same time,
+    but a link should only be used by one thread at a time.
+*/
+FRAKTALAPI fLinkState *fraktal_create_deferred_link();
+
 /*
     Frees memory associated with a linking operation. On return, the
     fLinkState handle is invalidated and should not be used anywhere.
@@ -187,6 +248,21 @@ FRAKTALAPI fLinkState *fraktal_create_link();
 */
 FRAKTALAPI void fraktal_destroy_link(fLinkState *link);
 
+/*
+    Defines a preprocessor macro for the sources that are added to the
+    link after this call, as if each source began with
+        #define <name> <value>
+    'value' is optional (NULL defines an empty macro) and cannot span
+    multiple lines. This can be used to compile one set of sources into
+    several kernels, e.g. a preview and a final renderer:
+        fraktal_link_define(link, "STEPS", "128");
+
+    Sources should guard the macros they allow to be overridden with
+    #ifndef, as the files in libf do for STEPS, EPSILON, MAX_DISTANCE
+    and DENOISE. Returns false if 'name' is not a valid macro name.
+*/
+FRAKTALAPI bool fraktal_link_define(fLinkState *link, const char *name, const char *value);
+
 /*
     'link': Obtained from fraktal_create_link.
     'data': A pointer to a buffer containing kernel source. Must
@@ -196,6 +272,18 @@ FRAKTALAPI void fraktal_destroy_link(fLinkState *link);
     'name': An optional name for this input in log messages.
 
     No references are kept to 'data' (it can safely be freed afterward).
+
+    Library sources can be included with a directive on its own line:
+        #include "libf/hg_sdf.f"
+    The path is relative to the directory of 'name', or else to the
+    working directory. Each file is included once per source, and is
+    only read and parsed again if it has been modified since the last
+    time it was included. Errors in included files are reported with
+    the file's source string number, which is listed after 'name'.
+
+    Functions and constants of included files that the source does not
+    use are removed before it is compiled, so they cannot be called from
+    other sources in the link (those sources should include the file).
 */
 FRAKTALAPI bool fraktal_add_link_data(
     fLinkState *link,
@@ -212,6 +300,58 @@ FRAKTALAPI bool fraktal_add_link_data(
 */
 FRAKTALAPI bool fraktal_add_link_file(fLinkState *link, const char *path);
 
+/*
+    Adds many model sources to a link at once, so that they are compiled
+    and linked into a single program, e.g. to evaluate a population of
+    candidate models in one fraktal_run_kernel call.
+
+    'models'  : An array of 'count' NULL-terminated sources, each of
+                which must define 'float model(vec3 p)'.
+    'dispatch': Which model() evaluates. With FRAKTAL_MODEL_PER_INSTANCE
+                it is the model with index iInstance (see
+                fraktal_run_kernel_instanced), and with FRAKTAL_MODEL_PER_ROW
+                it is the model with index equal to the output row. The
+                index is clamped to the number of models.
+    'name'    : An optional name for the models in log messages.
+
+    The functions, global variables and structs of model i are renamed
+    with the suffix _i (e.g. model_3), so models may reuse names. Only
+    the model's own uses of these names are renamed: names after a '.'
+    (swizzles and struct fields) and the field names of struct
+    declarations are left as they are, even if spelled the same as a
+    renamed name, and so are the files that a model includes (which
+    must not define a name that the models also define). Uniforms are
+    shared by all models. Errors are reported with the model index as
+    the source string number (e.g. "3:12(5): error: ...").
+*/
+FRAKTALAPI bool fraktal_add_link_models(
+    fLinkState *link,
+    const char **models,
+    int count,
+    fEnum dispatch,
+    const char *name);
+
+/*
+    Adds a pointwise epilogue to a link, which is fused into the kernel
+    so that it runs in the same pass (see fraktal_run_kernel_fused)
+    instead of as a separate kernel over the kernel's output.
+
+    'data' must define 'vec4 epilogue(vec4 value)', which is called with
+    the value of each output element after the kernel's result has been
+    added to it. The source is compiled with FRAKTAL_EPILOGUE defined,
+    such that one file can be used both as an epilogue and as a separate
+    kernel (see libf/compose.f). Uniforms declared by the epilogue are
+    parameters of the linked kernel.
+
+    A link can have one epilogue. Fusing requires OpenGL 4.2; if it is
+    unavailable, false is returned and the link is unchanged.
+*/
+FRAKTALAPI bool fraktal_add_link_epilogue(
+    fLinkState *link,
+    const char *data,
+    unsigned int size,
+    const char *name);
+
 /*
     On success, the method returns a fKernel handle required in all
     kernel-specific operations, such as execution, setting parameters,
@@ -219,6 +359,8 @@ FRAKTALAPI bool fraktal_add_link_file(fLinkState *link, const char *path);
 
     If the call is successful, the caller owns the returned fKernel,
     which should eventually be destroyed with fraktal_destroy_kernel.
+    If the kernel cache is enabled, the kernel may be shared with
+    other callers (see fraktal_set_kernel_cache).
 */
 FRAKTALAPI fKernel *fraktal_link_kernel(fLinkState *link);
 
@@ -240,6 +382,83 @@ FRAKTALAPI void fraktal_destroy_kernel(fKernel *f);
 */
 FRAKTALAPI fKernel *fraktal_load_kernel(const char *path);
 
+/*
+    Links a new kernel from the sources of 'f' in which the parameters
+    named in 'names' are declared as constants with their current value
+    in 'f' (as set by fraktal_param_*), instead of as uniforms. This lets
+    the shader compiler fold the arithmetic that depends on them, e.g.
+    to render a fitted model faster once its parameters are final.
+
+    'names' : Array of 'count' parameter names. If 'count' is 0, every
+              parameter except arrays is frozen.
+
+    The frozen parameters are not parameters of the returned kernel
+    (fraktal_get_param_offset returns -1 for them). The other parameters
+    keep their mean and scale, but their values must be set again. The
+    caller owns the returned kernel, which is NULL on failure.
+*/
+FRAKTALAPI fKernel *fraktal_freeze_kernel(fKernel *f, const char **names, int count);
+
+/*
+    Enables a cache of linked kernels, so that linking the same sources
+    again returns a kernel that was linked before instead of compiling
+    a new one. Pass 0 to disable the cache (the default).
+
+    'max_kernels': Maximum number of kernels kept in the cache. Kernels
+    are kept after being destroyed with fraktal_destroy_kernel, and the
+    least recently used are freed when the cache is full. Kernels that
+    are in use are never freed, even if this means that the cache holds
+    more than 'max_kernels'.
+
+    A kernel that is returned more than once must be destroyed once for
+    each time, and the holders share its parameter values and compute
+    tile (see fraktal_set_compute_tile).
+
+    Sources that belong to a cached kernel are not compiled when they
+    are added to a link, unless the link then misses the cache.
+
+    Kernels do not survive their context, and should be destroyed before
+    it. fraktal_destroy_context empties the cache, but keeps 'max_kernels'
+    and the statistics, so that no kernel of a destroyed context is
+    returned by a later link.
+*/
+FRAKTALAPI void fraktal_set_kernel_cache(int max_kernels);
+
+/*
+    'hits': Number of fraktal_link_kernel calls that returned a cached kernel.
+    'misses': Number of fraktal_link_kernel calls that linked a new kernel.
+    'count': Number of kernels in the cache (in use or not).
+
+    The statistics count calls made while the cache was enabled, and
+    are reset when it is disabled. NULL can be passed for any of them.
+*/
+FRAKTALAPI void fraktal_get_kernel_cache_stats(int *hits, int *misses, int *count);
+
+typedef void (*fLinkCallback)(fKernel *kernel, void *user);
+
+/*
+    Queues a link to be linked by fraktal_run_link_queue. This can be
+    called from any thread, and is intended for links that have been
+    prepared on another thread (see fraktal_create_deferred_link).
+
+    The queue takes ownership of 'link'. When it has been linked, 'done'
+    is called on the thread running the queue with the result of
+    fraktal_link_kernel (NULL on failure) and 'user'. The callback owns
+    the kernel. 'done' may be NULL, in which case the kernel is leaked
+    unless the kernel cache is enabled.
+*/
+FRAKTALAPI void fraktal_queue_link(fLinkState *link, fLinkCallback done, void *user);
+
+/*
+    Links queued links in the order they were queued, and returns the
+    number of links that were processed. This must be called on the
+    thread that owns the context.
+
+    'max_links': Maximum number of links to process, e.g. to bound the
+    time spent per frame. Pass 0 to process every queued link.
+*/
+FRAKTALAPI int fraktal_run_link_queue(int max_links);
+
 /*
     Calling this function modifies the GPU state of the current context
     as required by fraktal_run_kernel and fraktal_param* functions. The
@@ -253,6 +472,12 @@ FRAKTALAPI fKernel *fraktal_load_kernel(const char *path);
       fraktal_run_kernel(b);
       fraktal_use_kernel(NULL);
     runs two kernels 'a' and 'b' and properly restores the GPU state.
+
+    fraktal keeps track of the GPU state it has set while a kernel is in
+    use, and skips binds (of kernels, output arrays, array parameters and
+    so on) that are already current. If fraktal has exclusive ownership
+    of the context (see fraktal_set_exclusive_context), the GPU state is
+    not backed up or restored at all.
 */
 FRAKTALAPI void fraktal_use_kernel(fKernel *f);
 
@@ -272,6 +497,71 @@ FRAKTALAPI void fraktal_use_kernel(fKernel *f);
 */
 FRAKTALAPI void fraktal_run_kernel(fArray *out);
 
+/*
+    Launches 'count' instances of the current kernel in a single call,
+    where each instance runs a 2D grid of threads of dimensions
+    ('tile_width', 'tile_height'), and adds the results to a tile of
+    'out' (used as an atlas).
+
+    The tiles are laid out in rows of (width of 'out') / 'tile_width'
+    columns, such that instance i writes to the tile at column
+    i % columns and row i / columns. 'out' must be large enough to
+    hold all the tiles.
+
+    Kernels can access the following built-ins:
+      int  iInstance:  The index of the instance (0 if not instanced).
+      vec2 iFragCoord: The thread index within the tile (equal to
+                       gl_FragCoord.xy if not instanced).
+
+    Per-instance parameters (such as a camera matrix for each view) can
+    be passed as an array parameter, where row i holds the parameters
+    of instance i, and fetched inside the kernel, e.g.:
+      texelFetch(iViews, ivec2(column, iInstance), 0);
+*/
+FRAKTALAPI void fraktal_run_kernel_instanced(fArray *out, int count, int tile_width, int tile_height);
+
+/*
+    Runs a kernel that was linked with an epilogue (see
+    fraktal_add_link_epilogue). This is equivalent to running the kernel
+    into 'out' and then running the epilogue over 'out' as a separate
+    kernel into 'epilogue_out', but makes one pass instead of two:
+
+    * The results of the kernel are **added** to 'out', which must be a
+      2D, 4-channel FRAKTAL_FLOAT array.
+
+    * The results of the epilogue are **added** to 'epilogue_out', which
+      must have the same dimensions as 'out'.
+
+    Kernels linked with an epilogue can only be run with this function,
+    and always use the fragment pipeline.
+*/
+FRAKTALAPI void fraktal_run_kernel_fused(fArray *out, fArray *epilogue_out);
+
+/*
+    Makes fraktal_run_kernel run 'f' as a compute shader, with workgroups
+    of dimensions ('tile_width', 'tile_height'), instead of drawing it
+    through the fragment pipeline. Pass 0 to go back to the fragment
+    pipeline. Requires OpenGL 4.3; if unavailable, false is returned and
+    the kernel keeps running through the fragment pipeline.
+
+    The kernel is compiled as a compute shader for each output format
+    on first use. If compilation fails (e.g. the kernel uses dFdx or
+    discard, which do not exist in compute shaders) an error is logged
+    and the kernel falls back to the fragment pipeline.
+
+    The kernel source is unchanged: gl_FragCoord and iFragCoord hold
+    the thread index (plus 0.5), and the output variable is added to
+    'out'. FRAKTAL_COMPUTE is defined, so that a kernel can also use
+    compute-only features, such as shared variables, barrier() and
+    gl_LocalInvocationID. Every thread of a workgroup runs the kernel
+    (so barrier() is safe to use), but results of threads outside
+    the array are discarded.
+
+    fraktal_run_kernel_instanced and fraktal_run_kernel_fused always use
+    the fragment pipeline.
+*/
+FRAKTALAPI bool fraktal_set_compute_tile(fKernel *f, int tile_width, int tile_height);
+
 //-----------------------------------------------------------------------------
 // §4 Parameters
 //-----------------------------------------------------------------------------
@@ -279,6 +569,15 @@ FRAKTALAPI void fraktal_run_kernel(fArray *out);
 /*
     The value -1 is returned if 'name' refers to a non-existent
     or unused parameter.
+
+    Integer parameters can be declared with the 'specialize' flag, e.g.
+        uniform int iDrawMode (specialize);
+    The kernel is then compiled once for each distinct value that the
+    parameter is set to, with the parameter as a compile-time constant,
+    so that branches on it are removed by the compiler. Setting the
+    parameter selects the matching program; the values of the other
+    parameters are carried over. Use this for parameters that switch
+    between a few modes, as each new value costs a shader compile.
 */
 FRAKTALAPI int fraktal_get_param_offset(fKernel *f, const char *name);
 
@@ -310,6 +609,44 @@ FRAKTALAPI void fraktal_param_array(int offset, fArray *a);
 FRAKTALAPI void fraktal_param_matrix4f(int offset, float m[4*4]);
 FRAKTALAPI void fraktal_param_transpose_matrix4f(int offset, float m[4*4]);
 
+/*
+    The parameter vector of a kernel is the concatenation of its float
+    and int parameters (scalars, vectors and mat4), in declaration order,
+    excluding specialized parameters. mat2 and mat3 are excluded, since
+    no fraktal_param_* function can set them. It is meant
+    for optimizers, which can search over a flat vector of normalized
+    values instead of setting each parameter (see fraktal_set_param_vector).
+
+    Returns the number of parameters in the vector. If 'names' and
+    'components' are non-NULL, the name and number of elements of each
+    of the first 'max_count' parameters are written to them. The names
+    are valid for as long as 'f' exists.
+*/
+FRAKTALAPI int fraktal_get_param_vector_layout(fKernel *f, const char **names, int *components, int max_count);
+
+/*
+    Sets every parameter in the parameter vector of the current kernel
+    from normalized values, using the mean and scale declared with the
+    parameter, e.g.
+        uniform vec3 iCenter (mean=(0,1,0), scale=(2,2,2));
+    is set to mean + scale*x for its three elements of 'x'. Integers
+    are rounded to the nearest value. A mat4 has 16 elements, in the
+    column-major order of fraktal_param_matrix4f, and one mean and scale
+    for all of them, e.g. (mean=0, scale=1).
+
+    Each parameter is still a separate uniform, so this makes one GL
+    call per parameter. The layout of the vector is computed when the
+    kernel is linked, so the cost of a call is linear in the number of
+    parameters.
+
+    'f': The current kernel (see fraktal_use_kernel).
+    'n': Number of elements in 'x', which must be the sum of the
+         components returned by fraktal_get_param_vector_layout.
+
+    Like fraktal_param_*, this may be recorded into a command list.
+*/
+FRAKTALAPI void fraktal_set_param_vector(fKernel *f, const float *x, int n);
+
 //-----------------------------------------------------------------------------
 // §5 Context management
 //-----------------------------------------------------------------------------
@@ -348,6 +685,325 @@ FRAKTALAPI void fraktal_push_current_context();
 */
 FRAKTALAPI void fraktal_pop_current_context();
 
+/*
+    Declares whether fraktal is the only user of the GPU context. This
+    is false by default.
+
+    If true, fraktal assumes that no one else modifies the GPU state in
+    between calls to fraktal functions. fraktal_use_kernel then neither
+    backs up nor restores the GPU state, and fraktal remembers the state
+    it has set across calls, so that redundant state changes are skipped.
+
+    Must not be called while a kernel is in use.
+*/
+FRAKTALAPI void fraktal_set_exclusive_context(bool exclusive);
+
+/*
+    Selects how OpenGL errors are detected. Messages are written to
+    stderr and to the log.
+
+    FRAKTAL_VALIDATION_OFF: No checks. This is the default if fraktal
+    is compiled with NDEBUG.
+
+    FRAKTAL_VALIDATION_ERRORS: Errors and undefined behavior are reported
+    by the driver through debug output (OpenGL 4.3 or GL_KHR_debug),
+    without fraktal asking for them. Messages are asynchronous: they may
+    arrive after the call that caused them, and from a driver thread.
+
+    FRAKTAL_VALIDATION_FULL: As above, and also reports other severe
+    driver messages. Messages are synchronous, so they are reported
+    during the call that caused them. In addition, fraktal calls
+    glGetError after each operation, and fraktal_assert fails on an
+    error. This waits on the driver and is meant for debugging. This is
+    the default if fraktal is compiled without NDEBUG.
+
+    Debug output is set up in the context that is current when this is
+    called (or on the first call to fraktal that needs a context), and
+    replaces any debug output callback that was set in that context.
+*/
+FRAKTALAPI void fraktal_set_validation(fEnum level);
+
+//-----------------------------------------------------------------------------
+// §6 Command lists
+//-----------------------------------------------------------------------------
+
+/*
+    A command list records a sequence of fraktal calls once, so that it
+    can be replayed many times with a single call, for example:
+
+      fCommandList *list = fraktal_create_command_list();
+      fraktal_begin_command_list(list);
+      fraktal_use_kernel(f);
+      fraktal_param_1i(loc_iSamples, 0);
+      fraktal_zero_array(out);
+      fraktal_run_kernel(out);
+      fraktal_to_cpu(cpu_memory, out);
+      fraktal_use_kernel(NULL);
+      fraktal_end_command_list();
+
+      for (int i = 0; i < n; i++)
+      {
+          fraktal_patch_param(list, f, loc_iSamples, &i);
+          fraktal_run_command_list(list);
+      }
+
+    The following calls are recorded: fraktal_use_kernel,
+    fraktal_run_kernel, fraktal_run_kernel_instanced, fraktal_zero_array,
+    fraktal_to_cpu and fraktal_param_... While a command list is being recorded, these
+    calls are not executed, and the arrays, kernels and CPU memory
+    they reference must remain valid for as long as the list is run.
+*/
+FRAKTALAPI fCommandList *fraktal_create_command_list();
+
+/*
+    If 'list' is NULL the function silently returns.
+*/
+FRAKTALAPI void fraktal_destroy_command_list(fCommandList *list);
+
+/*
+    Discards the current contents of 'list' and begins recording into
+    it. Only one list can be recorded at a time.
+*/
+FRAKTALAPI void fraktal_begin_command_list(fCommandList *list);
+FRAKTALAPI void fraktal_end_command_list();
+
+/*
+    Replaces the value of every recorded parameter call that matches
+    'offset' and was recorded while the kernel 'f' was in use (or any
+    kernel, if 'f' is NULL). 'value' must point to data of the same
+    type as the recorded call: for example three floats for
+    fraktal_param_3f, 16 floats for fraktal_param_matrix4f, or an
+    fArray pointer for fraktal_param_array.
+
+    Returns the number of recorded calls that were patched.
+*/
+FRAKTALAPI int fraktal_patch_param(fCommandList *list, fKernel *f, int offset, const void *value);
+
+/*
+    Executes the recorded calls in order.
+*/
+FRAKTALAPI void fraktal_run_command_list(fCommandList *list);
+
+//-----------------------------------------------------------------------------
+// §7 SDF programs
+//-----------------------------------------------------------------------------
+
+/*
+    An SDF program describes a model as a sequence of operations on the
+    primitives and operators in libf/hg_sdf.f. Programs are encoded into
+    an array that is read by the interpreter kernel in libf/interpreter.f,
+    so a model can be edited and evaluated without compiling or linking
+    a new kernel, for example:
+
+        fSdfProgram *p = fraktal_create_sdf_program();
+        float box[] = { 1.0f, 0.5f, 1.0f };
+        float sphere[] = { 1.2f };
+        float round[] = { 0.1f };
+        fraktal_add_sdf_op(p, FRAKTAL_SDF_BOX, box, 3);
+        fraktal_add_sdf_op(p, FRAKTAL_SDF_SPHERE, sphere, 1);
+        fraktal_add_sdf_op(p, FRAKTAL_SDF_DIFFERENCE_ROUND, round, 1);
+        fArray *a = fraktal_create_sdf_array(&p, 1);
+        ...
+        fraktal_use_kernel(f); // interpreter.f used as the model, e.g. with geometry.f
+        fraktal_param_array(fraktal_get_param_offset(f, "iProgram"), a);
+
+    The program is a stack machine. Primitives push a distance, combine
+    operators pop two distances and push the result, and domain operators
+    transform the evaluation point of the primitives that follow. Arguments
+    are listed next to each operation below.
+*/
+typedef int fSdfOp;
+enum fSdfOp_
+{
+    FRAKTAL_SDF_END,                  // (used internally to terminate a program)
+
+    // Primitives (push one distance)
+    FRAKTAL_SDF_SPHERE,               // radius
+    FRAKTAL_SDF_BOX,                  // half-size x, y, z
+    FRAKTAL_SDF_CYLINDER,             // radius, half-height
+    FRAKTAL_SDF_CAPSULE,              // radius, half-length
+    FRAKTAL_SDF_TORUS,                // small radius, large radius
+    FRAKTAL_SDF_PLANE,                // normal x, y, z, distance from origin
+    FRAKTAL_SDF_CONE,                 // radius, height
+    FRAKTAL_SDF_HEXAGON,              // circumradius, half-height
+    FRAKTAL_SDF_OCTAHEDRON,           // radius
+    FRAKTAL_SDF_DODECAHEDRON,         // radius
+    FRAKTAL_SDF_ICOSAHEDRON,          // radius
+
+    // Combine operators (pop two distances a, b and push one)
+    FRAKTAL_SDF_UNION,                // -
+    FRAKTAL_SDF_INTERSECTION,         // -
+    FRAKTAL_SDF_DIFFERENCE,           // - (a minus b)
+    FRAKTAL_SDF_UNION_ROUND,          // radius
+    FRAKTAL_SDF_INTERSECTION_ROUND,   // radius
+    FRAKTAL_SDF_DIFFERENCE_ROUND,     // radius
+    FRAKTAL_SDF_UNION_CHAMFER,        // radius
+    FRAKTAL_SDF_INTERSECTION_CHAMFER, // radius
+    FRAKTAL_SDF_DIFFERENCE_CHAMFER,   // radius
+    FRAKTAL_SDF_UNION_SOFT,           // radius
+    FRAKTAL_SDF_UNION_STAIRS,         // radius, number of steps
+    FRAKTAL_SDF_UNION_COLUMNS,        // radius, number of columns
+    FRAKTAL_SDF_PIPE,                 // radius
+    FRAKTAL_SDF_ENGRAVE,              // depth
+    FRAKTAL_SDF_GROOVE,               // width, depth
+    FRAKTAL_SDF_TONGUE,               // width, height
+
+    // Domain operators
+    FRAKTAL_SDF_PUSH_POINT,           // - (saves the evaluation point)
+    FRAKTAL_SDF_POP_POINT,            // - (restores the last saved point)
+    FRAKTAL_SDF_TRANSLATE,            // offset x, y, z
+    FRAKTAL_SDF_ROTATE_X,             // angle in radians
+    FRAKTAL_SDF_ROTATE_Y,             // angle in radians
+    FRAKTAL_SDF_ROTATE_Z,             // angle in radians
+    FRAKTAL_SDF_MOD1,                 // axis (0, 1 or 2), cell size
+    FRAKTAL_SDF_MIRROR,               // axis (0, 1 or 2), distance
+    FRAKTAL_SDF_MOD_POLAR,            // axis (0, 1 or 2), repetitions
+
+    // Modifies the distance on top of the stack
+    FRAKTAL_SDF_ROUND,                // radius (subtracted from the distance)
+
+    FRAKTAL_SDF_NUM_OPS
+};
+
+/*
+    Creates an empty SDF program.
+*/
+FRAKTALAPI fSdfProgram *fraktal_create_sdf_program();
+
+/*
+    Frees all memory associated with a program.
+
+    If 'p' is NULL the function silently returns.
+*/
+FRAKTALAPI void fraktal_destroy_sdf_program(fSdfProgram *p);
+
+/*
+    Appends an operation to the program. 'args' must point to as many
+    floats as listed for the operation in fSdfOp (it may be NULL if the
+    operation has none), and 'num_args' must match that count.
+
+    The function returns false and leaves the program unchanged if the
+    arguments are wrong, if a combine operator does not have two
+    distances to pop, if a push or pop is unbalanced, if the stacks
+    exceed 8 entries, or if the program exceeds 255 operations.
+*/
+FRAKTALAPI bool fraktal_add_sdf_op(fSdfProgram *p, fSdfOp op, const float *args, int num_args);
+
+/*
+    Encodes 'count' programs into a read-only 4-channel float array that
+    can be passed as the iProgram parameter of libf/interpreter.f.
+    Program i is stored in row i, and is evaluated by model() when
+    iProgramOffset + iInstance equals i, so that several programs can
+    be rendered with one call to fraktal_run_kernel_instanced.
+
+    Each program must leave exactly one distance on the stack. If a
+    program is incomplete, the function returns NULL.
+*/
+FRAKTALAPI fArray *fraktal_create_sdf_array(fSdfProgram **programs, int count);
+
+//-----------------------------------------------------------------------------
+// §8 Graphs
+//-----------------------------------------------------------------------------
+
+/*
+    A graph describes a pipeline of kernel passes, such as a pre-pass,
+    an accumulation pass and a compose pass, together with the arrays
+    that the passes pass between each other. Each pass is recorded like
+    a command list, and the arrays that a pass reads (array parameters,
+    fraktal_to_cpu) and writes (fraktal_run_kernel, fraktal_zero_array)
+    are found from the recorded calls, for example:
+
+        fGraph *g = fraktal_create_graph();
+        fArray *depth = fraktal_create_graph_array(g, 64, 48, 1, FRAKTAL_FLOAT);
+
+        fraktal_begin_graph_pass(g);
+        fraktal_use_kernel(prepass);
+        fraktal_zero_array(depth);
+        fraktal_run_kernel(depth);
+        fraktal_end_graph_pass();
+
+        fraktal_begin_graph_pass(g);
+        fraktal_use_kernel(render);
+        fraktal_param_array(fraktal_get_param_offset(render, "iChannel0"), depth);
+        fraktal_run_kernel(image);
+        fraktal_end_graph_pass();
+
+        fraktal_run_graph(g); // every frame
+
+    Passes run in the order they were recorded. When the graph is
+    compiled, passes whose results are never used are dropped, clears
+    that have no effect are dropped, and graph arrays whose lifetimes
+    do not overlap share memory.
+
+    A pass is used if it reads an array back to the CPU, or writes to
+    an array that was not created by the graph, to a persistent graph
+    array, or to a graph array that a later used pass reads. A graph
+    array is persistent if it is first accessed by something other than
+    a clear, so that it accumulates over runs of the graph; persistent
+    arrays do not share memory.
+*/
+
+/*
+    Creates an empty graph.
+*/
+FRAKTALAPI fGraph *fraktal_create_graph();
+
+/*
+    Frees all memory associated with a graph, including its arrays.
+
+    If 'g' is NULL the function silently returns.
+*/
+FRAKTALAPI void fraktal_destroy_graph(fGraph *g);
+
+/*
+    Creates a read-write array that is owned by the graph. The array
+    can be used in graph passes like any other array, but has no memory
+    until the graph is compiled, and may share memory with other graph
+    arrays. It is destroyed with the graph and must not be passed to
+    fraktal_destroy_array.
+
+    After the graph is compiled, the array can also be used outside the
+    graph (e.g. displayed or read back), but its contents are only
+    defined if it is persistent.
+*/
+FRAKTALAPI fArray *fraktal_create_graph_array(
+    fGraph *g,
+    int width,
+    int height,
+    int channels,
+    fEnum format);
+
+/*
+    Begins recording a pass. The calls up to fraktal_end_graph_pass are
+    recorded into the graph (see fraktal_begin_command_list), and the
+    pass must begin by selecting its kernel with fraktal_use_kernel.
+    Adding a pass invalidates the compiled graph.
+*/
+FRAKTALAPI void fraktal_begin_graph_pass(fGraph *g);
+FRAKTALAPI void fraktal_end_graph_pass();
+
+/*
+    Schedules the passes and assigns memory to the graph arrays. This
+    is done by fraktal_run_graph if the graph has changed since it was
+    last compiled, but can be called beforehand, e.g. to have valid
+    graph arrays. Compiling again reallocates the graph arrays, so the
+    contents of persistent arrays are lost.
+*/
+FRAKTALAPI void fraktal_compile_graph(fGraph *g);
+
+/*
+    Replaces the value of recorded parameter calls in the graph (see
+    fraktal_patch_param). Returns the number of recorded calls that were
+    patched, including those in passes that were dropped.
+*/
+FRAKTALAPI int fraktal_patch_graph_param(fGraph *g, fKernel *f, int offset, const void *value);
+
+/*
+    Runs the scheduled passes in order, compiling the graph first if
+    needed. No kernel is in use when the function returns.
+*/
+FRAKTALAPI void fraktal_run_graph(fGraph *g);
+
 #ifdef __cplusplus
 }
 #endif
@@ -51,14 +51,18 @@ fArray *fraktal_create_array(
     fraktal_assert(channels == 1 || channels == 2 || channels == 4);
 
     GLenum internal_format,data_format,data_type;
-    fraktal_assert(fraktal_format_to_gl_format(channels, format, &internal_format, &data_format, &data_type) && "Invalid array format");
+    if (!fraktal_format_to_gl_format(channels, format, &internal_format, &data_format, &data_type))
+    {
+        log_err("Failed to create array: invalid format (%d channels, format %d).\n", channels, format);
+        return NULL;
+    }
 
     GLenum target = height == 1 ? GL_TEXTURE_1D : GL_TEXTURE_2D;
 
     GLuint color0 = 0;
     {
         glGenTextures(1, &color0);
-        glBindTexture(target, color0);
+        fraktal_gl_begin_transfer_texture(target, color0);
         if (target == GL_TEXTURE_1D)
         {
             glTexImage1D(target, 0, internal_format, width, 0, data_format, data_type, data);
@@ -72,9 +76,10 @@ fArray *fraktal_create_array(
         }
         glTexParameteri(target, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
         glTexParameteri(target, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
-        glBindTexture(target, 0);
+        fraktal_gl_end_transfer_texture(target);
         if (glGetError() != GL_NO_ERROR)
         {
+            fraktal_gl_forget_texture(color0);
             glDeleteTextures(1, &color0);
             log_err("Failed to create OpenGL texture object.\n");
             return NULL;
@@ -85,14 +90,17 @@ fArray *fraktal_create_array(
     if (access == FRAKTAL_READ_WRITE)
     {
         glGenFramebuffers(1, &fbo);
-        glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+        fraktal_gl_bind_framebuffer(fbo);
         if (target == GL_TEXTURE_1D)
             glFramebufferTexture1D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, color0, 0);
         else if (target == GL_TEXTURE_2D)
             glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, target, color0, 0);
-        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        if (!fraktal_gl.valid)
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
         if (glGetError() != GL_NO_ERROR)
         {
+            fraktal_gl_forget_framebuffer(fbo);
+            fraktal_gl_forget_texture(color0);
             glDeleteFramebuffers(1, &fbo);
             glDeleteTextures(1, &color0);
             log_err("Failed to create framebuffer object.\n");
@@ -118,6 +126,8 @@ void fraktal_destroy_array(fArray *a)
     {
         fraktal_ensure_context();
         fraktal_check_gl_error();
+        fraktal_gl_forget_texture(a->color0);
+        fraktal_gl_forget_framebuffer(a->fbo);
         glDeleteTextures(1, &a->color0);
         glDeleteFramebuffers(1, &a->fbo);
         free(a);
@@ -127,22 +137,45 @@ void fraktal_destroy_array(fArray *a)
 
 void fraktal_zero_array(fArray *a)
 {
+    if (fraktal_recording)
+    {
+        fraktal_record(FRAKTAL_CMD_ZERO_ARRAY)->array = a;
+        return;
+    }
     fraktal_assert(a);
     fraktal_assert(a->access == FRAKTAL_READ_WRITE);
     fraktal_assert(a->fbo);
     fraktal_assert(a->color0);
     fraktal_ensure_context();
     fraktal_check_gl_error();
-    GLint last_framebuffer; glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_framebuffer);
-    glBindFramebuffer(GL_FRAMEBUFFER, a->fbo);
-    glClearColor(0,0,0,0);
-    glClear(GL_COLOR_BUFFER_BIT);
-    glBindFramebuffer(GL_FRAMEBUFFER, last_framebuffer);
+    if (fraktal_gl.valid)
+    {
+        // The state mirror knows the current bindings, so there is
+        // nothing to query or restore.
+        fraktal_gl_bind_framebuffer(a->fbo);
+        fraktal_gl_clear_color_zero();
+        glClear(GL_COLOR_BUFFER_BIT);
+    }
+    else
+    {
+        GLint last_framebuffer; glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_framebuffer);
+        glBindFramebuffer(GL_FRAMEBUFFER, a->fbo);
+        glClearColor(0,0,0,0);
+        glClear(GL_COLOR_BUFFER_BIT);
+        glBindFramebuffer(GL_FRAMEBUFFER, last_framebuffer);
+    }
     fraktal_check_gl_error();
 }
 
 void fraktal_to_cpu(void *cpu_memory, fArray *a)
 {
+    if (fraktal_recording)
+    {
+        fCommand *cmd = fraktal_record(FRAKTAL_CMD_TO_CPU);
+        cmd->cpu_memory = cpu_memory;
+        cmd->array = a;
+        return;
+    }
     fraktal_assert(cpu_memory);
     fraktal_assert(a);
     fraktal_assert(a->color0);
@@ -150,11 +183,12 @@ void fraktal_to_cpu(void *cpu_memory, fArray *a)
     fraktal_check_gl_error();
     GLenum target = a->height == 1 ? GL_TEXTURE_1D : GL_TEXTURE_2D;
     GLenum internal_format,data_format,data_type;
-    fraktal_assert(fraktal_format_to_gl_format(a->channels, a->format, &internal_format, &data_format, &data_type));
+    bool valid_format = fraktal_format_to_gl_format(a->channels, a->format, &internal_format, &data_format, &data_type);
+    fraktal_assert(valid_format);
     glPixelStorei(GL_PACK_ALIGNMENT, 1);
-    glBindTexture(target, a->color0);
+    fraktal_gl_begin_transfer_texture(target, a->color0);
     glGetTexImage(target, 0, data_format, data_type, cpu_memory);
-    glBindTexture(target, 0);
+    fraktal_gl_end_transfer_texture(target);
     fraktal_check_gl_error();
 }
 
@@ -0,0 +1,197 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <log.h>
+
+typedef int fCommandType;
+enum fCommandType_
+{
+    FRAKTAL_CMD_USE_KERNEL,
+    FRAKTAL_CMD_RUN_KERNEL,
+    FRAKTAL_CMD_RUN_KERNEL_INSTANCED,
+    FRAKTAL_CMD_RUN_KERNEL_FUSED,
+    FRAKTAL_CMD_ZERO_ARRAY,
+    FRAKTAL_CMD_TO_CPU,
+    FRAKTAL_CMD_PARAM_1F,
+    FRAKTAL_CMD_PARAM_2F,
+    FRAKTAL_CMD_PARAM_3F,
+    FRAKTAL_CMD_PARAM_4F,
+    FRAKTAL_CMD_PARAM_1I,
+    FRAKTAL_CMD_PARAM_2I,
+    FRAKTAL_CMD_PARAM_3I,
+    FRAKTAL_CMD_PARAM_4I,
+    FRAKTAL_CMD_PARAM_MATRIX4F,
+    FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F,
+    FRAKTAL_CMD_PARAM_ARRAY,
+};
+
+struct fCommand
+{
+    fCommandType type;
+    fKernel *kernel; // the kernel to use, or the kernel in use when a parameter was recorded
+    fArray *array;   // the array to run, zero, read back, or pass as a parameter
+    fArray *epilogue_array; // the epilogue output of a fused run
+    void *cpu_memory;
+    int offset;
+    union
+    {
+        float f[16];
+        int i[4];
+    };
+};
+
+struct fCommandList
+{
+    fCommand *commands;
+    int count;
+    int capacity;
+    fKernel *kernel; // the kernel in use at this point of the recording
+};
+
+// Non-NULL while a command list is being recorded. Recordable functions
+// append a command to this list instead of executing.
+static fCommandList *fraktal_recording = NULL;
+
+static fCommand *fraktal_record(fCommandType type)
+{
+    fCommandList *list = fraktal_recording;
+    fraktal_assert(list);
+    if (list->count == list->capacity)
+    {
+        int capacity = list->capacity ? 2*list->capacity : 16;
+        fCommand *commands = (fCommand*)realloc(list->commands, capacity*sizeof(fCommand));
+        fraktal_assert(commands && "Ran out of memory");
+        list->commands = commands;
+        list->capacity = capacity;
+    }
+    fCommand *cmd = &list->commands[list->count++];
+    memset(cmd, 0, sizeof(fCommand));
+    cmd->type = type;
+    cmd->kernel = list->kernel;
+    return cmd;
+}
+
+static void fraktal_record_param_f(fCommandType type, int offset, const float *x, int n)
+{
+    fraktal_assert(fraktal_recording->kernel && "Call fraktal_use_kernel first.");
+    fCommand *cmd = fraktal_record(type);
+    cmd->offset = offset;
+    for (int i = 0; i < n; i++)
+        cmd->f[i] = x[i];
+}
+
+static void fraktal_record_param_i(fCommandType type, int offset, const int *x, int n)
+{
+    fraktal_assert(fraktal_recording->kernel && "Call fraktal_use_kernel first.");
+    fCommand *cmd = fraktal_record(type);
+    cmd->offset = offset;
+    for (int i = 0; i < n; i++)
+        cmd->i[i] = x[i];
+}
+
+static int fraktal_command_param_size(fCommandType type)
+{
+    switch (type)
+    {
+        case FRAKTAL_CMD_PARAM_1F: return 1*sizeof(float);
+        case FRAKTAL_CMD_PARAM_2F: return 2*sizeof(float);
+        case FRAKTAL_CMD_PARAM_3F: return 3*sizeof(float);
+        case FRAKTAL_CMD_PARAM_4F: return 4*sizeof(float);
+        case FRAKTAL_CMD_PARAM_1I: return 1*sizeof(int);
+        case FRAKTAL_CMD_PARAM_2I: return 2*sizeof(int);
+        case FRAKTAL_CMD_PARAM_3I: return 3*sizeof(int);
+        case FRAKTAL_CMD_PARAM_4I: return 4*sizeof(int);
+        case FRAKTAL_CMD_PARAM_MATRIX4F: return 16*sizeof(float);
+        case FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F: return 16*sizeof(float);
+        case FRAKTAL_CMD_PARAM_ARRAY: return sizeof(fArray*);
+        default: return 0;
+    }
+}
+
+fCommandList *fraktal_create_command_list()
+{
+    fCommandList *list = (fCommandList*)calloc(1, sizeof(fCommandList));
+    fraktal_assert(list && "Ran out of memory");
+    return list;
+}
+
+void fraktal_destroy_command_list(fCommandList *list)
+{
+    if (list)
+    {
+        fraktal_assert(fraktal_recording != list && "Cannot destroy a command list while it is being recorded.");
+        free(list->commands);
+        free(list);
+    }
+}
+
+void fraktal_begin_command_list(fCommandList *list)
+{
+    fraktal_assert(list);
+    fraktal_assert(!fraktal_recording && "Another command list is already being recorded.");
+    list->count = 0;
+    list->kernel = NULL;
+    fraktal_recording = list;
+}
+
+void fraktal_end_command_list()
+{
+    fraktal_assert(fraktal_recording && "No command list is being recorded.");
+    fraktal_recording = NULL;
+}
+
+int fraktal_patch_param(fCommandList *list, fKernel *f, int offset, const void *value)
+{
+    fraktal_assert(list);
+    fraktal_assert(value);
+    if (offset < 0)
+        return 0;
+    int patched = 0;
+    for (int i = 0; i < list->count; i++)
+    {
+        fCommand *cmd = &list->commands[i];
+        int size = fraktal_command_param_size(cmd->type);
+        if (size == 0 || cmd->offset != offset || (f && cmd->kernel != f))
+            continue;
+        if (cmd->type == FRAKTAL_CMD_PARAM_ARRAY)
+            memcpy(&cmd->array, value, size);
+        else
+            memcpy(cmd->f, value, size);
+        patched++;
+    }
+    return patched;
+}
+
+void fraktal_run_command_list(fCommandList *list)
+{
+    fraktal_assert(list);
+    fraktal_assert(!fraktal_recording && "Cannot run a command list while recording.");
+    for (int i = 0; i < list->count; i++)
+    {
+        fCommand *cmd = &list->commands[i];
+        switch (cmd->type)
+        {
+            case FRAKTAL_CMD_USE_KERNEL: fraktal_use_kernel(cmd->kernel); break;
+            case FRAKTAL_CMD_RUN_KERNEL: fraktal_run_kernel(cmd->array); break;
+            case FRAKTAL_CMD_RUN_KERNEL_INSTANCED: fraktal_run_kernel_instanced(cmd->array, cmd->i[0], cmd->i[1], cmd->i[2]); break;
+            case FRAKTAL_CMD_RUN_KERNEL_FUSED: fraktal_run_kernel_fused(cmd->array, cmd->epilogue_array); break;
+            case FRAKTAL_CMD_ZERO_ARRAY: fraktal_zero_array(cmd->array); break;
+            case FRAKTAL_CMD_TO_CPU: fraktal_to_cpu(cmd->cpu_memory, cmd->array); break;
+            case FRAKTAL_CMD_PARAM_1F: fraktal_param_1f(cmd->offset, cmd->f[0]); break;
+            case FRAKTAL_CMD_PARAM_2F: fraktal_param_2f(cmd->offset, cmd->f[0], cmd->f[1]); break;
+            case FRAKTAL_CMD_PARAM_3F: fraktal_param_3f(cmd->offset, cmd->f[0], cmd->f[1], cmd->f[2]); break;
+            case FRAKTAL_CMD_PARAM_4F: fraktal_param_4f(cmd->offset, cmd->f[0], cmd->f[1], cmd->f[2], cmd->f[3]); break;
+            case FRAKTAL_CMD_PARAM_1I: fraktal_param_1i(cmd->offset, cmd->i[0]); break;
+            case FRAKTAL_CMD_PARAM_2I: fraktal_param_2i(cmd->offset, cmd->i[0], cmd->i[1]); break;
+            case FRAKTAL_CMD_PARAM_3I: fraktal_param_3i(cmd->offset, cmd->i[0], cmd->i[1], cmd->i[2]); break;
+            case FRAKTAL_CMD_PARAM_4I: fraktal_param_4i(cmd->offset, cmd->i[0], cmd->i[1], cmd->i[2], cmd->i[3]); break;
+            case FRAKTAL_CMD_PARAM_MATRIX4F: fraktal_param_matrix4f(cmd->offset, cmd->f); break;
+            case FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F: fraktal_param_transpose_matrix4f(cmd->offset, cmd->f); break;
+            case FRAKTAL_CMD_PARAM_ARRAY: fraktal_param_array(cmd->offset, cmd->array); break;
+            default: fraktal_assert(false && "Invalid command type.");
+        }
+    }
+}
@@ -2,6 +2,7 @@
 // See LICENSE.txt for copyright and licensing details (standard MIT License).
 
 #pragma once
+#include <string.h>
 #include <log.h>
 #include <GLFW/glfw3.h>
 
@@ -15,10 +16,88 @@ static void fraktal_glfw_error_callback(int error, const char* description)
     fprintf(stderr, "Fraktal GLFW error %d: %s\n", error, description);
 }
 
+static void flush_kernel_cache(); // see fraktal_link.h
+
 static GLFWwindow *fraktal_context = NULL;
 static bool fraktal_gl_symbols_loaded = false;
 static const char *fraktal_glsl_version = "#version 150";
 
+// See fraktal_set_validation
+#ifdef NDEBUG
+static fEnum fraktal_validation = FRAKTAL_VALIDATION_OFF;
+#else
+static fEnum fraktal_validation = FRAKTAL_VALIDATION_FULL;
+#endif
+static bool fraktal_validation_installed = false; // in the current context
+
+static void fraktal_poll_gl_error(const char *file, int line)
+{
+    GLenum error = glGetError();
+    if (error != GL_NO_ERROR)
+    {
+        log_err("OpenGL error 0x%x (%s:%d)\n", error, file, line);
+        fraktal_assert(false && "OpenGL error");
+    }
+}
+
+static void APIENTRY fraktal_debug_output(GLenum source, GLenum type, GLuint id, GLenum severity, GLsizei length, const GLchar *message, GLvoid *user)
+{
+    if (type == GL_DEBUG_TYPE_ERROR)
+        log_err("OpenGL error: %s\n", message);
+    else
+        log_err("OpenGL warning: %s\n", message);
+}
+
+static bool fraktal_debug_output_supported()
+{
+    if (!glDebugMessageCallback || !glDebugMessageControl)
+        return false;
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    if (major > 4 || (major == 4 && minor >= 3))
+        return true;
+    GLint count = 0;
+    glGetIntegerv(GL_NUM_EXTENSIONS, &count);
+    for (int i = 0; i < count; i++)
+        if (strcmp((const char*)glGetStringi(GL_EXTENSIONS, i), "GL_KHR_debug") == 0)
+            return true;
+    return false;
+}
+
+// Sets up debug output in the current context for the validation level.
+// Only FULL reports messages synchronously, so that they are logged from
+// the thread (and during the call) that caused them; this serializes the
+// driver, which ERRORS should not pay for.
+static void fraktal_install_validation()
+{
+    fraktal_validation_installed = true;
+    if (!fraktal_debug_output_supported())
+        return;
+    if (fraktal_validation == FRAKTAL_VALIDATION_OFF)
+    {
+        glDisable(GL_DEBUG_OUTPUT);
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+        glDebugMessageCallback(NULL, NULL);
+        return;
+    }
+    glDebugMessageCallback((GLDEBUGPROC)fraktal_debug_output, NULL);
+    glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DONT_CARE, 0, NULL, GL_FALSE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_ERROR, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    glDebugMessageControl(GL_DONT_CARE, GL_DEBUG_TYPE_UNDEFINED_BEHAVIOR, GL_DONT_CARE, 0, NULL, GL_TRUE);
+    if (fraktal_validation == FRAKTAL_VALIDATION_FULL)
+    {
+        glDebugMessageControl(GL_DONT_CARE, GL_DONT_CARE, GL_DEBUG_SEVERITY_HIGH, 0, NULL, GL_TRUE);
+        glEnable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+    else
+    {
+        glDisable(GL_DEBUG_OUTPUT_SYNCHRONOUS);
+    }
+    glEnable(GL_DEBUG_OUTPUT);
+}
+
 bool fraktal_create_context()
 {
     fraktal_assert(!fraktal_context && "A context already exists.");
@@ -43,14 +122,21 @@ bool fraktal_create_context()
         fprintf(stderr, "Error creating context: failed to create GLFW window.\n");
         return false;
     }
+    fraktal_validation_installed = false;
     return true;
 }
 
 void fraktal_destroy_context()
 {
     if (fraktal_context)
+    {
+        flush_kernel_cache(); // while the context of the cached kernels exists
+        glfwMakeContextCurrent(fraktal_context);
+        fraktal_gl_delete_objects();
         glfwDestroyWindow(fraktal_context);
+    }
     fraktal_context = NULL;
+    fraktal_validation_installed = false;
 }
 
 void fraktal_push_current_context()
@@ -72,6 +158,15 @@ static void fraktal_ensure_context()
     // else: we expect the caller to have made a context current
     // on the thread
 
+    // The state that fraktal keeps about a context is of no use in
+    // another one (this can only be detected for GLFW contexts).
+    void *current = glfwGetCurrentContext();
+    if (current != fraktal_gl.context)
+    {
+        fraktal_gl_forget_context();
+        fraktal_gl.context = current;
+    }
+
     if (!fraktal_gl_symbols_loaded)
     {
         fraktal_gl_symbols_loaded = true;
@@ -82,4 +177,17 @@ static void fraktal_ensure_context()
     // verify that we have OpenGL symbols loaded by testing one
     // of the function pointers
     fraktal_assert(glCreateShader != NULL && "Failed to load OpenGL symbols.");
+
+    if (!fraktal_validation_installed)
+        fraktal_install_validation();
+}
+
+void fraktal_set_validation(fEnum level)
+{
+    fraktal_assert(level == FRAKTAL_VALIDATION_OFF ||
+                   level == FRAKTAL_VALIDATION_ERRORS ||
+                   level == FRAKTAL_VALIDATION_FULL);
+    fraktal_validation = level;
+    fraktal_validation_installed = false;
+    fraktal_ensure_context();
 }
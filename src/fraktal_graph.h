@@ -0,0 +1,410 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <log.h>
+
+// How a recorded command accesses one of its arrays
+typedef int fGraphAccess;
+enum fGraphAccess_
+{
+    FRAKTAL_GRAPH_READ,       // sampled as a parameter or read back to the CPU
+    FRAKTAL_GRAPH_ACCUMULATE, // kernel results are added to it (read and write)
+    FRAKTAL_GRAPH_CLEAR,      // set to zero (write only)
+};
+
+struct fGraphArray
+{
+    fArray *logical; // the handle given to the user, which borrows the GL objects of its physical array
+    int physical;    // index into fGraph::physical, or -1 if unused
+    int first;       // first and last scheduled pass that accesses the array
+    int last;
+    bool persistent; // the first access is not a clear, so the contents must be kept between runs
+};
+
+struct fGraphPass
+{
+    int begin; // range of commands in fGraph::recorded
+    int end;
+    bool live; // contributes to the result of the graph
+};
+
+struct fGraph
+{
+    fCommandList recorded; // all passes, as recorded
+    fCommandList compiled; // the commands that remain after scheduling
+    bool is_compiled;
+
+    fGraphPass *passes;
+    int num_passes;
+    int passes_capacity;
+
+    fGraphArray *arrays;
+    int num_arrays;
+    int arrays_capacity;
+
+    fArray **physical;
+    int num_physical;
+};
+
+// Non-NULL while a graph pass is being recorded (into its 'recorded' list)
+static fGraph *fraktal_recording_graph = NULL;
+
+static int fraktal_graph_operands(const fCommand *cmd, fArray **arrays, fGraphAccess *access)
+{
+    switch (cmd->type)
+    {
+        case FRAKTAL_CMD_ZERO_ARRAY:
+            arrays[0] = cmd->array; access[0] = FRAKTAL_GRAPH_CLEAR;
+            return 1;
+        case FRAKTAL_CMD_RUN_KERNEL:
+        case FRAKTAL_CMD_RUN_KERNEL_INSTANCED:
+            arrays[0] = cmd->array; access[0] = FRAKTAL_GRAPH_ACCUMULATE;
+            return 1;
+        case FRAKTAL_CMD_RUN_KERNEL_FUSED:
+            arrays[0] = cmd->array; access[0] = FRAKTAL_GRAPH_ACCUMULATE;
+            arrays[1] = cmd->epilogue_array; access[1] = FRAKTAL_GRAPH_ACCUMULATE;
+            return 2;
+        case FRAKTAL_CMD_PARAM_ARRAY:
+        case FRAKTAL_CMD_TO_CPU:
+            arrays[0] = cmd->array; access[0] = FRAKTAL_GRAPH_READ;
+            return 1;
+        default:
+            return 0;
+    }
+}
+
+static int fraktal_graph_find_array(fGraph *g, fArray *a)
+{
+    for (int i = 0; i < g->num_arrays; i++)
+        if (g->arrays[i].logical == a)
+            return i;
+    return -1;
+}
+
+// Returns how the graph array 'index' is next accessed after command
+// 'after' by the commands that are kept, or -1 if it is not accessed.
+static int fraktal_graph_next_access(fGraph *g, bool *keep, int index, int after)
+{
+    fCommand *commands = g->recorded.commands;
+    for (int p = 0; p < g->num_passes; p++)
+    {
+        fGraphPass *pass = &g->passes[p];
+        if (!pass->live || pass->end <= after + 1)
+            continue;
+        int begin = pass->begin > after + 1 ? pass->begin : after + 1;
+        for (int i = begin; i < pass->end; i++)
+        {
+            if (!keep[i])
+                continue;
+            fArray *arrays[2];
+            fGraphAccess access[2];
+            int n = fraktal_graph_operands(&commands[i], arrays, access);
+            for (int k = 0; k < n; k++)
+                if (arrays[k] == g->arrays[index].logical)
+                    return access[k];
+        }
+    }
+    return -1;
+}
+
+static void fraktal_graph_release_physical(fGraph *g)
+{
+    for (int i = 0; i < g->num_physical; i++)
+        fraktal_destroy_array(g->physical[i]);
+    free(g->physical);
+    g->physical = NULL;
+    g->num_physical = 0;
+    for (int i = 0; i < g->num_arrays; i++)
+    {
+        g->arrays[i].logical->fbo = 0;
+        g->arrays[i].logical->color0 = 0;
+        g->arrays[i].physical = -1;
+    }
+}
+
+fGraph *fraktal_create_graph()
+{
+    fGraph *g = (fGraph*)calloc(1, sizeof(fGraph));
+    fraktal_assert(g && "Ran out of memory");
+    return g;
+}
+
+void fraktal_destroy_graph(fGraph *g)
+{
+    if (g)
+    {
+        fraktal_assert(fraktal_recording_graph != g && "Cannot destroy a graph while a pass is being recorded.");
+        fraktal_ensure_context();
+        fraktal_graph_release_physical(g);
+        for (int i = 0; i < g->num_arrays; i++)
+            free(g->arrays[i].logical);
+        free(g->arrays);
+        free(g->passes);
+        free(g->recorded.commands);
+        free(g->compiled.commands);
+        free(g);
+    }
+}
+
+fArray *fraktal_create_graph_array(fGraph *g, int width, int height, int channels, fEnum format)
+{
+    fraktal_assert(g);
+    fraktal_assert(width > 0 && height > 0);
+    fraktal_assert(channels == 1 || channels == 2 || channels == 4);
+    fraktal_assert(format == FRAKTAL_FLOAT || format == FRAKTAL_UINT8);
+    if (g->num_arrays == g->arrays_capacity)
+    {
+        int capacity = g->arrays_capacity ? 2*g->arrays_capacity : 8;
+        fGraphArray *arrays = (fGraphArray*)realloc(g->arrays, capacity*sizeof(fGraphArray));
+        fraktal_assert(arrays && "Ran out of memory");
+        g->arrays = arrays;
+        g->arrays_capacity = capacity;
+    }
+    fArray *a = (fArray*)calloc(1, sizeof(fArray));
+    fraktal_assert(a && "Ran out of memory");
+    a->width = width;
+    a->height = height;
+    a->channels = channels;
+    a->format = format;
+    a->access = FRAKTAL_READ_WRITE;
+
+    fGraphArray *array = &g->arrays[g->num_arrays++];
+    memset(array, 0, sizeof(fGraphArray));
+    array->logical = a;
+    array->physical = -1;
+    g->is_compiled = false;
+    return a;
+}
+
+void fraktal_begin_graph_pass(fGraph *g)
+{
+    fraktal_assert(g);
+    fraktal_assert(!fraktal_recording && "Cannot begin a graph pass while recording.");
+    if (g->num_passes == g->passes_capacity)
+    {
+        int capacity = g->passes_capacity ? 2*g->passes_capacity : 8;
+        fGraphPass *passes = (fGraphPass*)realloc(g->passes, capacity*sizeof(fGraphPass));
+        fraktal_assert(passes && "Ran out of memory");
+        g->passes = passes;
+        g->passes_capacity = capacity;
+    }
+    fGraphPass *pass = &g->passes[g->num_passes];
+    pass->begin = g->recorded.count;
+    pass->end = g->recorded.count;
+    pass->live = true;
+    g->recorded.kernel = NULL;
+    g->is_compiled = false;
+    fraktal_recording = &g->recorded;
+    fraktal_recording_graph = g;
+}
+
+void fraktal_end_graph_pass()
+{
+    fGraph *g = fraktal_recording_graph;
+    fraktal_assert(g && "No graph pass is being recorded.");
+    fraktal_assert(fraktal_recording == &g->recorded);
+    g->passes[g->num_passes].end = g->recorded.count;
+    g->num_passes++;
+    fraktal_recording = NULL;
+    fraktal_recording_graph = NULL;
+}
+
+void fraktal_compile_graph(fGraph *g)
+{
+    fraktal_assert(g);
+    fraktal_assert(fraktal_recording_graph != g && "Cannot compile a graph while a pass is being recorded.");
+    fraktal_ensure_context();
+    fraktal_graph_release_physical(g);
+    fCommand *commands = g->recorded.commands;
+    int num_arrays = g->num_arrays;
+    bool *flags = (bool*)calloc(2*num_arrays + g->recorded.count + 1, sizeof(bool));
+    fraktal_assert(flags && "Ran out of memory");
+    bool *needed = flags;                 // the array's contents are read by a later live pass
+    bool *zero = flags + num_arrays;      // the array is known to be zero
+    bool *keep = flags + 2*num_arrays;    // the command is kept
+
+    // An array whose first access is not a clear keeps accumulating
+    // over runs of the graph, so its memory cannot be shared.
+    for (int i = 0; i < num_arrays; i++)
+    {
+        g->arrays[i].persistent = false;
+        g->arrays[i].first = -1;
+        g->arrays[i].last = -1;
+    }
+    for (int i = 0; i < g->recorded.count; i++)
+    {
+        fArray *arrays[2];
+        fGraphAccess access[2];
+        int n = fraktal_graph_operands(&commands[i], arrays, access);
+        for (int k = 0; k < n; k++)
+        {
+            int index = fraktal_graph_find_array(g, arrays[k]);
+            if (index >= 0 && !needed[index])
+            {
+                needed[index] = true; // (used as 'seen' here)
+                g->arrays[index].persistent = access[k] != FRAKTAL_GRAPH_CLEAR;
+            }
+        }
+    }
+    memset(needed, 0, num_arrays*sizeof(bool));
+
+    // Walk the passes backwards and drop those that neither read back
+    // to the CPU, nor write to an array outside the graph, a persistent
+    // array or an array that a later pass reads.
+    for (int p = g->num_passes - 1; p >= 0; p--)
+    {
+        fGraphPass *pass = &g->passes[p];
+        pass->live = false;
+        for (int i = pass->begin; i < pass->end; i++)
+        {
+            fArray *arrays[2];
+            fGraphAccess access[2];
+            int n = fraktal_graph_operands(&commands[i], arrays, access);
+            if (commands[i].type == FRAKTAL_CMD_TO_CPU)
+                pass->live = true;
+            for (int k = 0; k < n; k++)
+            {
+                if (access[k] == FRAKTAL_GRAPH_READ)
+                    continue;
+                int index = fraktal_graph_find_array(g, arrays[k]);
+                if (index < 0 || g->arrays[index].persistent || needed[index])
+                    pass->live = true;
+            }
+        }
+        if (!pass->live)
+            continue;
+        for (int i = pass->end - 1; i >= pass->begin; i--)
+        {
+            fArray *arrays[2];
+            fGraphAccess access[2];
+            int n = fraktal_graph_operands(&commands[i], arrays, access);
+            for (int k = 0; k < n; k++)
+            {
+                int index = fraktal_graph_find_array(g, arrays[k]);
+                if (index >= 0)
+                    needed[index] = access[k] != FRAKTAL_GRAPH_CLEAR;
+            }
+        }
+    }
+
+    // Drop clears of arrays that are already zero, and clears whose
+    // result is cleared again (or discarded) before it is read.
+    for (int p = 0; p < g->num_passes; p++)
+        for (int i = g->passes[p].begin; i < g->passes[p].end; i++)
+            keep[i] = g->passes[p].live;
+    for (int p = 0; p < g->num_passes; p++)
+    {
+        if (!g->passes[p].live)
+            continue;
+        for (int i = g->passes[p].begin; i < g->passes[p].end; i++)
+        {
+            fArray *arrays[2];
+            fGraphAccess access[2];
+            int n = fraktal_graph_operands(&commands[i], arrays, access);
+            for (int k = 0; k < n; k++)
+            {
+                int index = fraktal_graph_find_array(g, arrays[k]);
+                if (index < 0)
+                    continue;
+                if (access[k] == FRAKTAL_GRAPH_CLEAR)
+                {
+                    int next = fraktal_graph_next_access(g, keep, index, i);
+                    bool discarded = next == FRAKTAL_GRAPH_CLEAR || (next < 0 && !g->arrays[index].persistent);
+                    if (zero[index] || discarded)
+                        keep[i] = false;
+                    else
+                        zero[index] = true;
+                }
+                else if (access[k] == FRAKTAL_GRAPH_ACCUMULATE)
+                {
+                    zero[index] = false;
+                }
+                if (keep[i])
+                {
+                    if (g->arrays[index].first < 0)
+                        g->arrays[index].first = p;
+                    g->arrays[index].last = p;
+                }
+            }
+        }
+    }
+
+    // Assign memory in order of first use. Arrays of the same format
+    // whose lifetimes do not overlap share memory.
+    int *physical_last = (int*)malloc((num_arrays + 1)*sizeof(int));
+    g->physical = (fArray**)malloc((num_arrays + 1)*sizeof(fArray*));
+    fraktal_assert(physical_last && g->physical && "Ran out of memory");
+    for (int p = 0; p < g->num_passes; p++)
+    {
+        for (int i = 0; i < num_arrays; i++)
+        {
+            fGraphArray *array = &g->arrays[i];
+            if (array->first != p)
+                continue;
+            fArray *a = array->logical;
+            int physical = -1;
+            for (int j = 0; j < g->num_physical && !array->persistent; j++)
+            {
+                fArray *b = g->physical[j];
+                if (physical_last[j] < p &&
+                    a->width == b->width && a->height == b->height &&
+                    a->channels == b->channels && a->format == b->format)
+                {
+                    physical = j;
+                    break;
+                }
+            }
+            if (physical < 0)
+            {
+                physical = g->num_physical++;
+                g->physical[physical] = fraktal_create_array(NULL, a->width, a->height, a->channels, a->format, FRAKTAL_READ_WRITE);
+                fraktal_assert(g->physical[physical] && "Failed to create graph array");
+            }
+            // Persistent arrays are never released
+            physical_last[physical] = array->persistent ? g->num_passes : array->last;
+            array->physical = physical;
+            a->fbo = g->physical[physical]->fbo;
+            a->color0 = g->physical[physical]->color0;
+        }
+    }
+    free(physical_last);
+
+    g->compiled.count = 0;
+    for (int i = 0; i < g->recorded.count; i++)
+    {
+        if (!keep[i])
+            continue;
+        fCommandList *list = &g->compiled;
+        if (list->count == list->capacity)
+        {
+            int capacity = list->capacity ? 2*list->capacity : 16;
+            fCommand *compiled = (fCommand*)realloc(list->commands, capacity*sizeof(fCommand));
+            fraktal_assert(compiled && "Ran out of memory");
+            list->commands = compiled;
+            list->capacity = capacity;
+        }
+        list->commands[list->count++] = commands[i];
+    }
+    free(flags);
+    g->is_compiled = true;
+}
+
+int fraktal_patch_graph_param(fGraph *g, fKernel *f, int offset, const void *value)
+{
+    fraktal_assert(g);
+    fraktal_patch_param(&g->compiled, f, offset, value);
+    return fraktal_patch_param(&g->recorded, f, offset, value);
+}
+
+void fraktal_run_graph(fGraph *g)
+{
+    fraktal_assert(g);
+    fraktal_assert(!fraktal_recording && "Cannot run a graph while recording.");
+    if (!g->is_compiled)
+        fraktal_compile_graph(g);
+    fraktal_run_command_list(&g->compiled);
+    fraktal_use_kernel(NULL);
+}
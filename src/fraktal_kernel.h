@@ -3,29 +3,145 @@
 #include <log.h>
 #include <string.h>
 
-struct fKernel
+enum { FRAKTAL_MAX_SPECIALIZED = 8 };
+enum { FRAKTAL_MAX_KERNEL_VARIANTS = 32 };
+
+// Identifies a program variant of a kernel.
+struct fKernelVariantKey
+{
+    int values[FRAKTAL_MAX_SPECIALIZED]; // values of the specialized parameters
+    GLenum compute_format; // image format of the output, or 0 if not a compute program
+    GLenum compute_target; // GL_TEXTURE_1D or GL_TEXTURE_2D
+    int tile_width;        // compute workgroup size
+    int tile_height;
+    int generic;           // 1 only for the generic program, so that no request selects it by key
+};
+
+struct fKernelVariant
 {
     GLuint program;
-    int loc_iPosition;
+    int loc_tiles;
+    int loc_target;
+    bool tiles_set; // FraktalTiles is non-zero (last run was instanced)
+    int *location;  // uniform location of each parameter (NULL: same as its offset)
+    fKernelVariantKey key;
+};
+
+struct fKernelSource
+{
+    char *data;
+    char *name;
+    GLuint shader;   // compiled with the specialized parameters as uniforms
+    int param_begin; // parameters declared in this source
+    int param_end;
+    bool specialized; // declares specialized parameters
+    bool fused;       // declares the output, which is passed to the epilogue
+    bool epilogue;    // added with fraktal_add_link_epilogue
+};
+
+// Kernels with specialized parameters (declared with the 'specialize'
+// meta flag) are compiled once for each distinct combination of their
+// values, with the parameters replaced by constants. Likewise, kernels
+// that run as compute shaders are compiled once for each output format.
+struct fKernelSpecialization
+{
+    int param[FRAKTAL_MAX_SPECIALIZED]; // index of each specialized parameter
+    int count;
+    fKernelVariantKey requested;
+    int tile_width; // 0 unless compute is enabled (see fraktal_set_compute_tile)
+    int tile_height;
+    fKernelVariant variants[FRAKTAL_MAX_KERNEL_VARIANTS];
+    int variant_count;
+    fCommand *values; // the value each parameter was last set to
+};
+
+struct fKernel
+{
+    fKernelVariant generic; // specialized parameters are uniforms
+    fKernelVariant *active; // the variant that is run
+    fKernelSpecialization *spec; // NULL unless there can be other variants
+    const char *glsl_version;
+    fKernelSource *sources;
+    int num_sources;
     fParams params;
+    bool fused; // linked with an epilogue (see fraktal_run_kernel_fused)
+
+    // See fraktal_set_kernel_cache
+    unsigned int hash; // of the sources
+    int refs;          // handles returned by fraktal_link_kernel (0 if not cached)
+    int last_used;     // cache tick of the last release
 };
 
 static fKernel *fraktal_current_kernel = NULL;
 
+static fCommandType fraktal_param_command_type(fParamType type)
+{
+    switch (type)
+    {
+        case FRAKTAL_PARAM_FLOAT: return FRAKTAL_CMD_PARAM_1F;
+        case FRAKTAL_PARAM_FLOAT_VEC2: return FRAKTAL_CMD_PARAM_2F;
+        case FRAKTAL_PARAM_FLOAT_VEC3: return FRAKTAL_CMD_PARAM_3F;
+        case FRAKTAL_PARAM_FLOAT_VEC4: return FRAKTAL_CMD_PARAM_4F;
+        case FRAKTAL_PARAM_FLOAT_MAT4: return FRAKTAL_CMD_PARAM_MATRIX4F;
+        case FRAKTAL_PARAM_INT: return FRAKTAL_CMD_PARAM_1I;
+        case FRAKTAL_PARAM_INT_VEC2: return FRAKTAL_CMD_PARAM_2I;
+        case FRAKTAL_PARAM_INT_VEC3: return FRAKTAL_CMD_PARAM_3I;
+        case FRAKTAL_PARAM_INT_VEC4: return FRAKTAL_CMD_PARAM_4I;
+        default: return FRAKTAL_CMD_USE_KERNEL; // not a settable parameter
+    }
+}
+
+// Prepares 'f' for having more than one program. The parameter values
+// that are already set on the generic program are read back, so that
+// they can be given to the other programs.
+static void fraktal_create_specialization(fKernel *f)
+{
+    fraktal_assert(!f->spec);
+    fKernelSpecialization *spec = (fKernelSpecialization*)calloc(1, sizeof(fKernelSpecialization));
+    fraktal_assert(spec && "Ran out of memory");
+    spec->values = (fCommand*)calloc(f->params.count > 0 ? f->params.count : 1, sizeof(fCommand));
+    fraktal_assert(spec->values && "Ran out of memory");
+    for (int i = 0; i < f->params.count; i++)
+    {
+        if (f->params.specialize[i])
+            spec->param[spec->count++] = i;
+
+        int offset = f->params.offset[i];
+        fCommand *value = &spec->values[i];
+        value->type = fraktal_param_command_type(f->params.type[i]);
+        if (offset < 0 || value->type == FRAKTAL_CMD_USE_KERNEL)
+            value->type = FRAKTAL_CMD_USE_KERNEL;
+        else if (value->type >= FRAKTAL_CMD_PARAM_1I && value->type <= FRAKTAL_CMD_PARAM_4I)
+            glGetUniformiv(f->generic.program, offset, value->i);
+        else
+            glGetUniformfv(f->generic.program, offset, value->f);
+    }
+    f->spec = spec;
+}
+
+static fKernelVariant *fraktal_link_variant(fKernel *f); // see fraktal_link.h
+
 int fraktal_get_param_offset(fKernel *f, const char *name)
 {
     fraktal_assert(name);
     fraktal_assert(f);
-    fraktal_assert(f->program);
+    fraktal_assert(f->generic.program);
     fraktal_ensure_context();
     for (int i = 0; i < f->params.count; i++)
-        if (strcmp(f->params.name[i], name) == 0)
+        if (strcmp(fraktal_param_name(&f->params, i), name) == 0)
             return f->params.offset[i];
     return -1;
 }
 
 void fraktal_use_kernel(fKernel *f)
 {
+    if (fraktal_recording)
+    {
+        fraktal_record(FRAKTAL_CMD_USE_KERNEL)->kernel = f;
+        fraktal_recording->kernel = f;
+        return;
+    }
+
     fraktal_ensure_context();
     fraktal_check_gl_error();
     static GLint last_program;
@@ -46,42 +162,53 @@ void fraktal_use_kernel(fKernel *f)
     static GLenum last_enable_depth_test;
     static GLenum last_enable_scissor_test;
     static GLenum last_enable_color_logic_op;
-    static GLuint vao = 0;
 
-    static GLuint quad = 0;
-    if (!quad)
+    if (f)
     {
-        static const float data[] = { -1,-1, +1,-1, +1,+1, +1,+1, -1,+1, -1,-1 };
-        glGenBuffers(1, &quad);
-        glBindBuffer(GL_ARRAY_BUFFER, quad);
-        glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
-        glBindBuffer(GL_ARRAY_BUFFER, 0);
+        fraktal_assert(f->generic.program && "f must be a valid kernel object");
     }
-    fraktal_assert(quad && "Failed to create vertex buffer");
 
-    if (f)
+    // If fraktal owns the context there is no foreign state to back up
+    // or restore, and the state mirror stays valid between uses.
+    bool save_restore = !fraktal_gl.exclusive;
+
+    if (f && !fraktal_current_kernel && save_restore)
     {
-        fraktal_assert(glIsProgram(f->program) && "f must be a valid kernel object");
+        // Back-up GL state
+        glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+        glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
+        glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
+        glGetIntegerv(GL_VIEWPORT, last_viewport);
+        glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box);
+        glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_framebuffer);
+        glGetIntegerv(GL_BLEND_SRC_RGB, (GLint*)&last_blend_src_rgb);
+        glGetIntegerv(GL_BLEND_DST_RGB, (GLint*)&last_blend_dst_rgb);
+        glGetIntegerv(GL_BLEND_SRC_ALPHA, (GLint*)&last_blend_src_alpha);
+        glGetIntegerv(GL_BLEND_DST_ALPHA, (GLint*)&last_blend_dst_alpha);
+        glGetIntegerv(GL_BLEND_EQUATION_RGB, (GLint*)&last_blend_equation_rgb);
+        glGetIntegerv(GL_BLEND_EQUATION_ALPHA, (GLint*)&last_blend_equation_alpha);
+        glGetBooleanv(GL_DEPTH_WRITEMASK, (GLboolean*)&last_depth_writemask);
+        last_enable_blend = glIsEnabled(GL_BLEND);
+        last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
+        last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
+        last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
+        last_enable_color_logic_op = glIsEnabled(GL_COLOR_LOGIC_OP);
     }
 
-    if (fraktal_current_kernel)
+    if (f)
     {
-        if (f)
-        {
-            fraktal_current_kernel = f;
-            glUseProgram(f->program);
-            if (!f->loc_iPosition)
-                f->loc_iPosition = glGetAttribLocation(f->program, "iPosition");
-            fraktal_assert(f->loc_iPosition >= 0);
-            glEnableVertexAttribArray(f->loc_iPosition);
-            glVertexAttribPointer(f->loc_iPosition, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 2, 0);
-        }
-        else
-        {
-            glDisableVertexAttribArray(fraktal_current_kernel->loc_iPosition);
-            glDeleteVertexArrays(1, &vao);
-            fraktal_current_kernel = NULL;
+        fraktal_current_kernel = f;
+        fraktal_gl_begin_tracking();
+        fraktal_gl_kernel_state();
+        fraktal_gl_use_program(f->active->program);
+    }
+    else if (fraktal_current_kernel)
+    {
+        fraktal_current_kernel = NULL;
+        fraktal_gl_end_tracking();
 
+        if (save_restore)
+        {
             // Restore GL state
             glUseProgram(last_program);
             glBindVertexArray(last_vertex_array);
@@ -99,70 +226,231 @@ void fraktal_use_kernel(fKernel *f)
             glActiveTexture(GL_TEXTURE0);
         }
     }
-    else
+    fraktal_check_gl_error();
+}
+
+void fraktal_set_exclusive_context(bool exclusive)
+{
+    fraktal_assert(!fraktal_current_kernel && "Cannot change context ownership while a kernel is in use.");
+    if (fraktal_gl.exclusive && !exclusive)
     {
-        if (f)
-        {
-            // Back-up GL state
-            glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
-            glGetIntegerv(GL_ARRAY_BUFFER_BINDING, &last_array_buffer);
-            glGetIntegerv(GL_VERTEX_ARRAY_BINDING, &last_vertex_array);
-            glGetIntegerv(GL_VIEWPORT, last_viewport);
-            glGetIntegerv(GL_SCISSOR_BOX, last_scissor_box);
-            glGetIntegerv(GL_FRAMEBUFFER_BINDING, &last_framebuffer);
-            glGetIntegerv(GL_BLEND_SRC_RGB, (GLint*)&last_blend_src_rgb);
-            glGetIntegerv(GL_BLEND_DST_RGB, (GLint*)&last_blend_dst_rgb);
-            glGetIntegerv(GL_BLEND_SRC_ALPHA, (GLint*)&last_blend_src_alpha);
-            glGetIntegerv(GL_BLEND_DST_ALPHA, (GLint*)&last_blend_dst_alpha);
-            glGetIntegerv(GL_BLEND_EQUATION_RGB, (GLint*)&last_blend_equation_rgb);
-            glGetIntegerv(GL_BLEND_EQUATION_ALPHA, (GLint*)&last_blend_equation_alpha);
-            glGetBooleanv(GL_DEPTH_WRITEMASK, (GLboolean*)&last_depth_writemask);
-            last_enable_blend = glIsEnabled(GL_BLEND);
-            last_enable_cull_face = glIsEnabled(GL_CULL_FACE);
-            last_enable_depth_test = glIsEnabled(GL_DEPTH_TEST);
-            last_enable_scissor_test = glIsEnabled(GL_SCISSOR_TEST);
-            last_enable_color_logic_op = glIsEnabled(GL_COLOR_LOGIC_OP);
-
-            fraktal_current_kernel = f;
-            glDisable(GL_CULL_FACE);
-            glDisable(GL_DEPTH_TEST);
-            glDisable(GL_SCISSOR_TEST);
-            glDisable(GL_COLOR_LOGIC_OP);
-            glEnable(GL_BLEND);
-            glBlendFunc(GL_ONE, GL_ONE);
-            glBlendEquation(GL_FUNC_ADD);
-            glGenVertexArrays(1, &vao);
-            glBindVertexArray(vao);
-            glBindBuffer(GL_ARRAY_BUFFER, quad);
-
-            glUseProgram(f->program);
-            if (!f->loc_iPosition)
-                f->loc_iPosition = glGetAttribLocation(f->program, "iPosition");
-            fraktal_assert(f->loc_iPosition >= 0);
-            glEnableVertexAttribArray(f->loc_iPosition);
-            glVertexAttribPointer(f->loc_iPosition, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 2, 0);
-        }
-        else
+        // Don't leave one of our kernels current for whoever uses the
+        // context next (the kernel may be destroyed in the meantime).
+        fraktal_ensure_context();
+        glUseProgram(0);
+    }
+    fraktal_gl.exclusive = exclusive;
+    fraktal_gl.valid = false;
+    if (exclusive)
+        fraktal_gl_begin_tracking();
+}
+
+static void fraktal_upload_param(int location, const fCommand *value)
+{
+    if (location < 0)
+        return;
+    switch (value->type)
+    {
+        case FRAKTAL_CMD_PARAM_1F: glUniform1f(location, value->f[0]); break;
+        case FRAKTAL_CMD_PARAM_2F: glUniform2f(location, value->f[0], value->f[1]); break;
+        case FRAKTAL_CMD_PARAM_3F: glUniform3f(location, value->f[0], value->f[1], value->f[2]); break;
+        case FRAKTAL_CMD_PARAM_4F: glUniform4f(location, value->f[0], value->f[1], value->f[2], value->f[3]); break;
+        case FRAKTAL_CMD_PARAM_1I: glUniform1i(location, value->i[0]); break;
+        case FRAKTAL_CMD_PARAM_2I: glUniform2i(location, value->i[0], value->i[1]); break;
+        case FRAKTAL_CMD_PARAM_3I: glUniform3i(location, value->i[0], value->i[1], value->i[2]); break;
+        case FRAKTAL_CMD_PARAM_4I: glUniform4i(location, value->i[0], value->i[1], value->i[2], value->i[3]); break;
+        case FRAKTAL_CMD_PARAM_MATRIX4F: glUniformMatrix4fv(location, 1, false, value->f); break;
+        case FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F: glUniformMatrix4fv(location, 1, true, value->f); break;
+        default: break;
+    }
+}
+
+static fKernelVariant *fraktal_find_variant(fKernel *f)
+{
+    fKernelSpecialization *spec = f->spec;
+    if (spec->count == 0 && !spec->requested.compute_format)
+        return &f->generic;
+    for (int i = 0; i < spec->variant_count; i++)
+        if (memcmp(&spec->variants[i].key, &spec->requested, sizeof(fKernelVariantKey)) == 0)
+            return &spec->variants[i];
+    return fraktal_link_variant(f);
+}
+
+static void fraktal_select_variant(fKernel *f)
+{
+    fKernelSpecialization *spec = f->spec;
+    fKernelVariant *v = fraktal_find_variant(f);
+    if ((!v || !v->program) && spec->requested.compute_format)
+    {
+        // Fall back to the fragment pipeline
+        spec->requested.compute_format = 0;
+        spec->requested.compute_target = 0;
+        spec->requested.tile_width = 0;
+        spec->requested.tile_height = 0;
+        v = fraktal_find_variant(f);
+    }
+    if (!v || !v->program)
+        v = &f->generic; // the generic program can run any combination of values
+    if (v == f->active)
+        return;
+
+    // Uniform values belong to the program, so the new program
+    // must be given the values that were set on the previous one.
+    f->active = v;
+    fraktal_gl_use_program(v->program);
+    for (int i = 0; i < f->params.count; i++)
+    {
+        int location = v->location ? v->location[i] : f->params.offset[i];
+        fraktal_upload_param(location, &spec->values[i]);
+    }
+}
+
+// Sets a parameter of a kernel that has specialized parameters. Setting
+// a specialized parameter to a new value selects the matching variant.
+static void fraktal_param_specialized(fCommandType type, int offset, const void *x)
+{
+    fKernel *f = fraktal_current_kernel;
+    fKernelSpecialization *spec = f->spec;
+    fCommand value;
+    memset(&value, 0, sizeof(value));
+    value.type = type;
+    memcpy(value.f, x, fraktal_command_param_size(type));
+
+    bool reselect = false;
+    for (int i = 0; i < f->params.count; i++)
+    {
+        if (f->params.offset[i] != offset)
+            continue;
+        spec->values[i] = value;
+        for (int k = 0; k < spec->count; k++)
         {
-            // do nothing
+            if (spec->param[k] == i && spec->requested.values[k] != value.i[0])
+            {
+                spec->requested.values[k] = value.i[0];
+                reselect = true;
+            }
         }
     }
-    fraktal_check_gl_error();
+
+    fKernelVariant *v = f->active;
+    for (int i = 0; i < f->params.count; i++)
+        if (f->params.offset[i] == offset)
+            fraktal_upload_param(v->location ? v->location[i] : offset, &value);
+    if (reselect)
+        fraktal_select_variant(f);
+}
+
+void fraktal_param_1f(int offset, float x)
+{
+    if (fraktal_recording) { float v[] = { x }; fraktal_record_param_f(FRAKTAL_CMD_PARAM_1F, offset, v, 1); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { float v[] = { x }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_1F, offset, v); return; }
+    glUniform1f(offset, x);
+}
+
+void fraktal_param_2f(int offset, float x, float y)
+{
+    if (fraktal_recording) { float v[] = { x, y }; fraktal_record_param_f(FRAKTAL_CMD_PARAM_2F, offset, v, 2); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { float v[] = { x, y }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_2F, offset, v); return; }
+    glUniform2f(offset, x, y);
+}
+
+void fraktal_param_3f(int offset, float x, float y, float z)
+{
+    if (fraktal_recording) { float v[] = { x, y, z }; fraktal_record_param_f(FRAKTAL_CMD_PARAM_3F, offset, v, 3); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { float v[] = { x, y, z }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_3F, offset, v); return; }
+    glUniform3f(offset, x, y, z);
+}
+
+void fraktal_param_4f(int offset, float x, float y, float z, float w)
+{
+    if (fraktal_recording) { float v[] = { x, y, z, w }; fraktal_record_param_f(FRAKTAL_CMD_PARAM_4F, offset, v, 4); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { float v[] = { x, y, z, w }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_4F, offset, v); return; }
+    glUniform4f(offset, x, y, z, w);
+}
+
+void fraktal_param_1i(int offset, int x)
+{
+    if (fraktal_recording) { int v[] = { x }; fraktal_record_param_i(FRAKTAL_CMD_PARAM_1I, offset, v, 1); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { int v[] = { x }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_1I, offset, v); return; }
+    glUniform1i(offset, x);
+}
+
+void fraktal_param_2i(int offset, int x, int y)
+{
+    if (fraktal_recording) { int v[] = { x, y }; fraktal_record_param_i(FRAKTAL_CMD_PARAM_2I, offset, v, 2); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { int v[] = { x, y }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_2I, offset, v); return; }
+    glUniform2i(offset, x, y);
+}
+
+void fraktal_param_3i(int offset, int x, int y, int z)
+{
+    if (fraktal_recording) { int v[] = { x, y, z }; fraktal_record_param_i(FRAKTAL_CMD_PARAM_3I, offset, v, 3); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { int v[] = { x, y, z }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_3I, offset, v); return; }
+    glUniform3i(offset, x, y, z);
+}
+
+void fraktal_param_4i(int offset, int x, int y, int z, int w)
+{
+    if (fraktal_recording) { int v[] = { x, y, z, w }; fraktal_record_param_i(FRAKTAL_CMD_PARAM_4I, offset, v, 4); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { int v[] = { x, y, z, w }; fraktal_param_specialized(FRAKTAL_CMD_PARAM_4I, offset, v); return; }
+    glUniform4i(offset, x, y, z, w);
+}
+
+void fraktal_param_matrix4f(int offset, float m[4*4])
+{
+    if (fraktal_recording) { fraktal_record_param_f(FRAKTAL_CMD_PARAM_MATRIX4F, offset, m, 16); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { fraktal_param_specialized(FRAKTAL_CMD_PARAM_MATRIX4F, offset, m); return; }
+    glUniformMatrix4fv(offset, 1, false, m);
+}
+
+void fraktal_param_transpose_matrix4f(int offset, float m[4*4])
+{
+    if (fraktal_recording) { fraktal_record_param_f(FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F, offset, m, 16); return; }
+    fraktal_assert(fraktal_current_kernel);
+    if (offset < 0)
+        return;
+    if (fraktal_current_kernel->spec) { fraktal_param_specialized(FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F, offset, m); return; }
+    glUniformMatrix4fv(offset, 1, true, m);
 }
 
-void fraktal_param_1f(int offset, float x)                            { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform1f(offset, x); }
-void fraktal_param_2f(int offset, float x, float y)                   { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform2f(offset, x, y); }
-void fraktal_param_3f(int offset, float x, float y, float z)          { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform3f(offset, x, y, z); }
-void fraktal_param_4f(int offset, float x, float y, float z, float w) { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform4f(offset, x, y, z, w); }
-void fraktal_param_1i(int offset, int x)                              { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform1i(offset, x); }
-void fraktal_param_2i(int offset, int x, int y)                       { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform2i(offset, x, y); }
-void fraktal_param_3i(int offset, int x, int y, int z)                { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform3i(offset, x, y, z); }
-void fraktal_param_4i(int offset, int x, int y, int z, int w)         { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniform4i(offset, x, y, z, w); }
-void fraktal_param_matrix4f(int offset, float m[4*4])                 { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniformMatrix4fv(offset, 1, false, m); }
-void fraktal_param_transpose_matrix4f(int offset, float m[4*4])       { fraktal_assert(fraktal_current_kernel); if (offset < 0) return; glUniformMatrix4fv(offset, 1, true, m); }
 
 void fraktal_param_array(int offset, fArray *a)
 {
+    if (fraktal_recording)
+    {
+        fraktal_assert(fraktal_recording->kernel && "Call fraktal_use_kernel first.");
+        fCommand *cmd = fraktal_record(FRAKTAL_CMD_PARAM_ARRAY);
+        cmd->offset = offset;
+        cmd->array = a;
+        return;
+    }
     fraktal_assert(a);
     fraktal_assert(a->color0);
     fraktal_assert(a->width > 0 && a->height > 0 && "Array has invalid dimensions.");
@@ -177,30 +465,356 @@ void fraktal_param_array(int offset, fArray *a)
                 tex_unit = p->assigned_tex_unit[i];
         fraktal_assert(tex_unit >= 0 && "Array parameter with unassigned texture unit.");
     }
-    glUniform1i(offset, tex_unit);
-    glActiveTexture(GL_TEXTURE0 + tex_unit);
+    // Note: the sampler uniform is assigned its texture unit once at link time.
     if (a->height == 1)
-        glBindTexture(GL_TEXTURE_1D, a->color0);
+        fraktal_gl_bind_texture(tex_unit, GL_TEXTURE_1D, a->color0);
     else
-        glBindTexture(GL_TEXTURE_2D, a->color0);
+        fraktal_gl_bind_texture(tex_unit, GL_TEXTURE_2D, a->color0);
+}
+
+// Returns the number of elements of a parameter of the given type in the
+// parameter vector (see fraktal_set_param_vector), or 0 if it cannot be
+// part of it. mat2 and mat3 are left out, as there is no way to set them.
+static int fraktal_param_vector_components(fParamType type)
+{
+    switch (type)
+    {
+        case FRAKTAL_PARAM_FLOAT: return 1;
+        case FRAKTAL_PARAM_FLOAT_VEC2: return 2;
+        case FRAKTAL_PARAM_FLOAT_VEC3: return 3;
+        case FRAKTAL_PARAM_FLOAT_VEC4: return 4;
+        case FRAKTAL_PARAM_FLOAT_MAT4: return 16;
+        case FRAKTAL_PARAM_INT: return 1;
+        case FRAKTAL_PARAM_INT_VEC2: return 2;
+        case FRAKTAL_PARAM_INT_VEC3: return 3;
+        case FRAKTAL_PARAM_INT_VEC4: return 4;
+        default: return 0;
+    }
+}
+
+// Lays out the parameter vector of a kernel when it is linked, so that
+// setting it is a single walk over the parameters. A parameter that is
+// declared by several sources is part of the vector once, and each of
+// its declarations gets the index of the first one.
+static void fraktal_compute_param_vector(fParams *p)
+{
+    int *first = (int*)calloc(p->names_length > 0 ? p->names_length : 1, sizeof(int)); // index + 1, by name
+    fraktal_assert(first && "Ran out of memory");
+    p->vector_length = 0;
+    for (int i = 0; i < p->count; i++)
+    {
+        int n = fraktal_param_vector_components(p->type[i]);
+        p->vector_index[i] = -1;
+        if (n == 0 || p->specialize[i])
+            continue;
+        if (!first[p->name[i]])
+        {
+            first[p->name[i]] = p->vector_length + 1;
+            p->vector_length += n;
+        }
+        p->vector_index[i] = first[p->name[i]] - 1;
+    }
+    free(first);
+}
+
+int fraktal_get_param_vector_layout(fKernel *f, const char **names, int *components, int max_count)
+{
+    fraktal_assert(f);
+    const fParams *p = &f->params;
+    int count = 0;
+    int length = 0;
+    for (int i = 0; i < p->count; i++)
+    {
+        if (p->vector_index[i] != length) // not in the vector, or declared before
+            continue;
+        int n = fraktal_param_vector_components(p->type[i]);
+        if (count < max_count)
+        {
+            if (names) names[count] = fraktal_param_name(p, i);
+            if (components) components[count] = n;
+        }
+        length += n;
+        count++;
+    }
+    return count;
+}
+
+void fraktal_set_param_vector(fKernel *f, const float *x, int n)
+{
+    fraktal_assert(f);
+    fraktal_assert((x || n == 0) && "'x' must be non-NULL if 'n' is non-zero.");
+    fraktal_assert((fraktal_recording ? fraktal_recording->kernel == f : fraktal_current_kernel == f) && "Call fraktal_use_kernel(f) first.");
+    fParams *p = &f->params;
+    if (n != p->vector_length)
+    {
+        log_err("Failed to set parameter vector: expected %d elements, but got %d.\n", p->vector_length, n);
+        return;
+    }
+
+    // Parameters are plain uniforms, which GL can only set one at a time
+    // (unless they are elements of one array), so this makes one call per
+    // parameter. Parameters that were optimized out are skipped.
+    int length = 0;
+    for (int i = 0; i < p->count; i++)
+    {
+        int at = p->vector_index[i];
+        if (at < 0)
+            continue;
+        fParamType type = p->type[i];
+        int components = fraktal_param_vector_components(type);
+        bool is_int = type == FRAKTAL_PARAM_INT || type == FRAKTAL_PARAM_INT_VEC2 ||
+                      type == FRAKTAL_PARAM_INT_VEC3 || type == FRAKTAL_PARAM_INT_VEC4;
+        fCommand value;
+        memset(&value, 0, sizeof(value));
+        value.type = fraktal_param_command_type(type);
+        for (int k = 0; k < components; k++)
+        {
+            int e = type == FRAKTAL_PARAM_FLOAT_MAT4 ? 0 : k;
+            float v = (&p->mean[i].x)[e] + (&p->scale[i].x)[e]*x[at + k];
+            if (is_int)
+                value.i[k] = (int)floorf(v + 0.5f);
+            else
+                value.f[k] = v;
+        }
+
+        // A parameter declared by several sources has one uniform, but a
+        // specialized kernel holds a value for each declaration.
+        bool first = at == length;
+        if (first)
+            length += components;
+        int offset = p->offset[i];
+        if (offset < 0)
+            continue;
+        if (fraktal_recording)
+        {
+            if (first)
+            {
+                fCommand *cmd = fraktal_record(value.type);
+                cmd->offset = offset;
+                memcpy(cmd->f, value.f, fraktal_command_param_size(value.type));
+            }
+        }
+        else if (f->spec)
+        {
+            // Not a specialized parameter, so the variant stays the same
+            f->spec->values[i] = value;
+            if (first)
+                fraktal_upload_param(f->active->location ? f->active->location[i] : offset, &value);
+        }
+        else if (first)
+        {
+            fraktal_upload_param(offset, &value);
+        }
+    }
+}
+
+static bool fraktal_compute_supported()
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return (major > 4 || (major == 4 && minor >= 3)) && glDispatchCompute && glBindImageTexture && glMemoryBarrier;
+}
+
+static bool fraktal_fusion_supported()
+{
+    GLint major = 0;
+    GLint minor = 0;
+    glGetIntegerv(GL_MAJOR_VERSION, &major);
+    glGetIntegerv(GL_MINOR_VERSION, &minor);
+    return (major > 4 || (major == 4 && minor >= 2)) && glBindImageTexture && glMemoryBarrier;
+}
+
+bool fraktal_set_compute_tile(fKernel *f, int tile_width, int tile_height)
+{
+    fraktal_assert(f);
+    fraktal_assert(tile_width >= 0 && tile_height >= 0);
+    fraktal_ensure_context();
+    fraktal_check_gl_error();
+    if (tile_width == 0 || tile_height == 0)
+    {
+        if (f->spec)
+        {
+            f->spec->tile_width = 0;
+            f->spec->tile_height = 0;
+        }
+        return true;
+    }
+    if (!fraktal_compute_supported())
+        return false;
+    if (!f->spec)
+        fraktal_create_specialization(f);
+    f->spec->tile_width = tile_width;
+    f->spec->tile_height = tile_height;
+    fraktal_check_gl_error();
+    return true;
+}
+
+// Selects the compute program for 'out' if compute is enabled (and
+// 'out' is given), or the fragment program otherwise.
+static void fraktal_select_pipeline(fKernel *f, fArray *out)
+{
+    fKernelSpecialization *spec = f->spec;
+    fKernelVariantKey *key = &spec->requested;
+    key->compute_format = 0;
+    key->compute_target = 0;
+    key->tile_width = 0;
+    key->tile_height = 0;
+    if (out && spec->tile_width > 0)
+    {
+        GLenum data_format,data_type;
+        fraktal_format_to_gl_format(out->channels, out->format, &key->compute_format, &data_format, &data_type);
+        key->compute_target = out->height == 1 ? GL_TEXTURE_1D : GL_TEXTURE_2D;
+        key->tile_width = spec->tile_width;
+        key->tile_height = out->height == 1 ? 1 : spec->tile_height;
+    }
+    if (memcmp(&f->active->key, key, sizeof(fKernelVariantKey)) != 0)
+        fraktal_select_variant(f);
+}
+
+static void fraktal_dispatch_compute(fKernelVariant *v, fArray *out)
+{
+    glBindImageTexture(0, out->color0, 0, GL_FALSE, 0, GL_READ_WRITE, v->key.compute_format);
+    int groups_x = (out->width + v->key.tile_width - 1) / v->key.tile_width;
+    int groups_y = (out->height + v->key.tile_height - 1) / v->key.tile_height;
+    glDispatchCompute(groups_x, groups_y, 1);
+
+    // Make the image writes visible to whatever reads the array next:
+    // kernels (sampling or adding to it), clears and fraktal_to_cpu.
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                    GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                    GL_TEXTURE_UPDATE_BARRIER_BIT |
+                    GL_FRAMEBUFFER_BARRIER_BIT);
+    fraktal_check_gl_error();
 }
 
 void fraktal_run_kernel(fArray *out)
 {
+    if (fraktal_recording)
+    {
+        fraktal_assert(fraktal_recording->kernel && "Call fraktal_use_kernel first.");
+        fraktal_record(FRAKTAL_CMD_RUN_KERNEL)->array = out;
+        return;
+    }
     fraktal_assert(fraktal_current_kernel && "Call fraktal_use_kernel first.");
     fraktal_assert(out);
     fraktal_assert(out->width > 0);
     fraktal_assert(out->height > 0);
     fraktal_assert(out->fbo && "The output array's access mode cannot be read-only.");
     fraktal_assert(out->color0);
+    fraktal_assert(!fraktal_current_kernel->fused && "Kernels linked with an epilogue must be run with fraktal_run_kernel_fused.");
     fraktal_ensure_context();
     fraktal_check_gl_error();
 
-    glBindFramebuffer(GL_FRAMEBUFFER, out->fbo);
+    fKernel *f = fraktal_current_kernel;
+    if (f->spec)
+        fraktal_select_pipeline(f, out);
+    fKernelVariant *v = f->active;
+    if (v->key.compute_format)
+    {
+        fraktal_dispatch_compute(v, out);
+        return;
+    }
+    if (v->tiles_set)
+    {
+        glUniform3i(v->loc_tiles, 0, 0, 0);
+        v->tiles_set = false;
+    }
+
+    fraktal_gl_bind_framebuffer(out->fbo);
     if (out->height == 0)
-        glViewport(0, 0, out->width, 1);
+        fraktal_gl_viewport(0, 0, out->width, 1);
     else
-        glViewport(0, 0, out->width, out->height);
+        fraktal_gl_viewport(0, 0, out->width, out->height);
     glDrawArrays(GL_TRIANGLES, 0, 6);
     fraktal_check_gl_error();
 }
+
+void fraktal_run_kernel_instanced(fArray *out, int count, int tile_width, int tile_height)
+{
+    if (fraktal_recording)
+    {
+        fraktal_assert(fraktal_recording->kernel && "Call fraktal_use_kernel first.");
+        fCommand *cmd = fraktal_record(FRAKTAL_CMD_RUN_KERNEL_INSTANCED);
+        cmd->array = out;
+        cmd->i[0] = count;
+        cmd->i[1] = tile_width;
+        cmd->i[2] = tile_height;
+        return;
+    }
+    fraktal_assert(fraktal_current_kernel && "Call fraktal_use_kernel first.");
+    fraktal_assert(out);
+    fraktal_assert(out->fbo && "The output array's access mode cannot be read-only.");
+    fraktal_assert(count >= 0);
+    fraktal_assert(tile_width > 0 && tile_width <= out->width && "Tile width must be between 1 and the array width.");
+    fraktal_assert(tile_height > 0 && tile_height <= out->height && "Tile height must be between 1 and the array height.");
+    int columns = out->width / tile_width;
+    int rows = (count + columns - 1) / columns;
+    fraktal_assert(rows*tile_height <= out->height && "The output array is too small to hold all instances.");
+    fraktal_assert(!fraktal_current_kernel->fused && "Kernels linked with an epilogue must be run with fraktal_run_kernel_fused.");
+    fraktal_ensure_context();
+    fraktal_check_gl_error();
+    if (count == 0)
+        return;
+
+    fKernel *f = fraktal_current_kernel;
+    if (f->spec)
+        fraktal_select_pipeline(f, NULL);
+    fKernelVariant *v = f->active;
+    glUniform3i(v->loc_tiles, columns, tile_width, tile_height);
+    glUniform2f(v->loc_target, (float)out->width, (float)out->height);
+    v->tiles_set = true;
+
+    fraktal_gl_bind_framebuffer(out->fbo);
+    fraktal_gl_viewport(0, 0, out->width, out->height);
+    glDrawArraysInstanced(GL_TRIANGLES, 0, 6, count);
+    fraktal_check_gl_error();
+}
+
+void fraktal_run_kernel_fused(fArray *out, fArray *epilogue_out)
+{
+    if (fraktal_recording)
+    {
+        fraktal_assert(fraktal_recording->kernel && "Call fraktal_use_kernel first.");
+        fCommand *cmd = fraktal_record(FRAKTAL_CMD_RUN_KERNEL_FUSED);
+        cmd->array = out;
+        cmd->epilogue_array = epilogue_out;
+        return;
+    }
+    fraktal_assert(fraktal_current_kernel && "Call fraktal_use_kernel first.");
+    fraktal_assert(fraktal_current_kernel->fused && "The kernel was not linked with an epilogue.");
+    fraktal_assert(out);
+    fraktal_assert(epilogue_out);
+    fraktal_assert(out->access == FRAKTAL_READ_WRITE && "The output array's access mode cannot be read-only.");
+    fraktal_assert(out->channels == 4 && out->format == FRAKTAL_FLOAT && out->height > 1 && "The output array must be a 2D 4-channel float array.");
+    fraktal_assert(epilogue_out->fbo && "The epilogue output array's access mode cannot be read-only.");
+    fraktal_assert(epilogue_out->width == out->width && epilogue_out->height == out->height);
+    fraktal_ensure_context();
+    fraktal_check_gl_error();
+
+    fKernel *f = fraktal_current_kernel;
+    if (f->spec)
+        fraktal_select_pipeline(f, NULL);
+    fKernelVariant *v = f->active;
+    if (v->tiles_set)
+    {
+        glUniform3i(v->loc_tiles, 0, 0, 0);
+        v->tiles_set = false;
+    }
+
+    // The kernel adds its result to 'out' through an image, so that the
+    // epilogue can be given the sum, while the epilogue writes to the
+    // framebuffer. Each fragment reads and writes only its own pixel.
+    glBindImageTexture(0, out->color0, 0, GL_FALSE, 0, GL_READ_WRITE, GL_RGBA32F);
+    fraktal_gl_bind_framebuffer(epilogue_out->fbo);
+    fraktal_gl_viewport(0, 0, epilogue_out->width, epilogue_out->height);
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    // Make the image writes visible to whatever reads 'out' next
+    glMemoryBarrier(GL_TEXTURE_FETCH_BARRIER_BIT |
+                    GL_SHADER_IMAGE_ACCESS_BARRIER_BIT |
+                    GL_TEXTURE_UPDATE_BARRIER_BIT |
+                    GL_FRAMEBUFFER_BARRIER_BIT);
+    fraktal_check_gl_error();
+}
@@ -1,15 +1,34 @@
 #pragma once
 #include <stdlib.h>
+#include <stdarg.h>
+#include <sys/stat.h>
+#include <mutex>
 #include <log.h>
 #include <file.h>
 
-enum { MAX_LINK_STATE_ITEMS = 1024 };
 struct fLinkState
 {
     const char *glsl_version;
-    GLuint shaders[MAX_LINK_STATE_ITEMS];
+    GLuint *shaders;
     int num_shaders;
+    int capacity; // of 'shaders' and 'sources'
     fParams params;
+
+    // Shaders that declare specialized parameters are kept as source, so
+    // that the kernel can recompile them with the parameters as constants.
+    fKernelSource *sources;
+
+    int epilogue; // index of the epilogue source, or -1 (see fraktal_add_link_epilogue)
+
+    // "#define <name> <value>" lines (see fraktal_link_define), which are
+    // kept as part of each source added afterwards, so that variants are
+    // compiled with the same defines.
+    char *defines;
+
+    // Sources are compiled by fraktal_link_kernel instead of when they
+    // are added, so that the link can be prepared on any thread (see
+    // fraktal_create_deferred_link).
+    bool deferred;
 };
 
 static GLuint compile_shader(const char *name, const char **sources, int num_sources, GLenum type)
@@ -18,7 +37,7 @@ static GLuint compile_shader(const char *name, const char **sources, int num_sou
     fraktal_check_gl_error();
     fraktal_assert(sources && "Missing shader source list");
     fraktal_assert(num_sources > 0 && "Must have atleast one shader");
-    fraktal_assert((type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER));
+    fraktal_assert((type == GL_VERTEX_SHADER || type == GL_FRAGMENT_SHADER || type == GL_COMPUTE_SHADER));
     if (!name)
         name = "unnamed";
 
@@ -67,187 +86,1897 @@ static bool program_link_status(GLuint program)
     return true;
 }
 
-static bool add_link_data(fLinkState *link, char *data, const char *name)
+// Declares the specialized parameters in params[source->param_begin,
+// source->param_end): as uniforms if 'values' is NULL, or otherwise
+// as constants (values[k] is the value of the k'th specialized parameter).
+static void write_specialized_declarations(char *dst, size_t size, fParams *params, fKernelSource *source, const int *values)
 {
-    fraktal_assert(link);
-    fraktal_assert(link->num_shaders < MAX_LINK_STATE_ITEMS);
-    fraktal_assert(link->glsl_version);
-    fraktal_assert(data && "'data' must be a non-NULL pointer to a buffer containing kernel source text.");
-    fraktal_ensure_context();
-    fraktal_check_gl_error();
-    if (!parse_fraktal_source(data, &link->params, name))
+    dst[0] = '\0';
+    int k = 0;
+    for (int i = 0; i < source->param_end; i++)
     {
-        log_err("Error parsing kernel source\n");
-        return false;
+        if (!params->specialize[i])
+            continue;
+        if (i >= source->param_begin)
+        {
+            size_t len = strlen(dst);
+            if (values)
+                snprintf(dst + len, size - len, "const int %s = %d;\n", fraktal_param_name(params, i), values[k]);
+            else
+                snprintf(dst + len, size - len, "uniform int %s;\n", fraktal_param_name(params, i));
+        }
+        k++;
+    }
+}
+
+static const char *kernel_fragment_prelude =
+    "\nuniform int Dummy;\n"
+    "#define ZERO (min(0, Dummy))\n"
+    "flat in int iInstance;\n"
+    "flat in vec2 FraktalTileOrigin;\n"
+    "#define iFragCoord (gl_FragCoord.xy - FraktalTileOrigin)\n"
+    #ifdef FRAKTAL_GUI
+    "#define FRAKTAL_GUI\n"
+    #endif
+    ;
+
+static GLuint compile_kernel_shader(const char *glsl_version, const char *data, const char *declarations, const char *name)
+{
+    const char *sources[] = {
+        glsl_version,
+        kernel_fragment_prelude,
+        declarations,
+        "\n#line 0\n",
+        data,
+    };
+    int num_sources = sizeof(sources)/sizeof(sources[0]);
+    return compile_shader(name, sources, num_sources, GL_FRAGMENT_SHADER);
+}
+
+static const char *compute_image_format(GLenum internal_format)
+{
+    switch (internal_format)
+    {
+        case GL_R32F: return "r32f";
+        case GL_RG32F: return "rg32f";
+        case GL_RGBA32F: return "rgba32f";
+        case GL_R8: return "r8";
+        case GL_RG8: return "rg8";
+        case GL_RGBA8: return "rgba8";
+        default: return NULL;
+    }
+}
+
+// Converts the output variable of a kernel to a vec4 expression.
+static const char *kernel_output_to_vec4(const char *type)
+{
+    if      (strcmp(type, "float") == 0) return "vec4(%s, 0.0, 0.0, 0.0)";
+    else if (strcmp(type, "vec2") == 0)  return "vec4(%s, 0.0, 0.0)";
+    else if (strcmp(type, "vec3") == 0)  return "vec4(%s, 0.0)";
+    else if (strcmp(type, "vec4") == 0)  return "%s";
+    return NULL;
+}
+
+// Compiles a kernel source as a compute shader. Kernels are written as
+// fragment shaders, so gl_FragCoord and main are redefined, and the
+// source that declares the output variable gets a main function which
+// runs the kernel and adds the output to the output image (like the
+// blending of the fragment pipeline).
+static GLuint compile_kernel_compute_shader(const char *data, const char *declarations, const char *name, fKernelVariantKey *key)
+{
+    char *copy = strdup(data);
+    fraktal_assert(copy && "Ran out of memory");
+    char type[32];
+    char output[FRAKTAL_MAX_PARAM_NAME_LEN + 1];
+    bool has_output = parse_fragment_output(copy, type, sizeof(type), output, sizeof(output));
+
+    char epilogue[2048] = {0};
+    if (has_output)
+    {
+        const char *to_vec4 = kernel_output_to_vec4(type);
+        if (!to_vec4)
+        {
+            log_err("Failed to compile compute shader (%s): unsupported output type '%s'.\n", name, type);
+            free(copy);
+            return 0;
+        }
+        char result[128];
+        snprintf(result, sizeof(result), to_vec4, output);
+        bool is_1d = key->compute_target == GL_TEXTURE_1D;
+        snprintf(epilogue, sizeof(epilogue),
+            "\n#undef main\n"
+            "layout(local_size_x = %d, local_size_y = %d) in;\n"
+            "layout(binding = 0, %s) uniform %s FraktalOutput;\n"
+            "void FraktalMain();\n"
+            "void main()\n"
+            "{\n"
+            "    ivec2 p = ivec2(gl_GlobalInvocationID.xy);\n"
+            "    FraktalFragCoord = vec4(vec2(p) + vec2(0.5), 0.0, 1.0);\n"
+            "    %s = %s(0.0);\n"
+            "    FraktalMain();\n"
+            "    if (%s)\n"
+            "        imageStore(FraktalOutput, %s, imageLoad(FraktalOutput, %s) + %s);\n"
+            "}\n",
+            key->tile_width, key->tile_height,
+            compute_image_format(key->compute_format), is_1d ? "image1D" : "image2D",
+            output, type,
+            is_1d ? "p.x < imageSize(FraktalOutput)" : "all(lessThan(p, imageSize(FraktalOutput)))",
+            is_1d ? "p.x" : "p", is_1d ? "p.x" : "p", result);
     }
+
     const char *sources[] = {
-        link->glsl_version,
-        "\nuniform int Dummy;\n"
+        "#version 430\n",
+        "uniform int Dummy;\n"
         "#define ZERO (min(0, Dummy))\n"
+        "#define FRAKTAL_COMPUTE\n"
+        "#define iInstance 0\n"
+        "vec4 FraktalFragCoord;\n"
+        "#define gl_FragCoord FraktalFragCoord\n"
+        "#define iFragCoord (FraktalFragCoord.xy)\n"
+        "#define main FraktalMain\n"
         #ifdef FRAKTAL_GUI
         "#define FRAKTAL_GUI\n"
         #endif
+        ,
+        declarations,
+        "\n#line 0\n",
+        copy,
+        epilogue,
+    };
+    int num_sources = sizeof(sources)/sizeof(sources[0]);
+    GLuint shader = compile_shader(name, sources, num_sources, GL_COMPUTE_SHADER);
+    free(copy);
+    return shader;
+}
+
+// Compiles the kernel source that declares the output variable, such
+// that its output is added to an image instead of the framebuffer, and
+// the sum is passed through the epilogue, whose result is written to
+// the framebuffer (see fraktal_run_kernel_fused).
+static GLuint compile_kernel_fused_shader(const char *data, const char *declarations, const char *name)
+{
+    char *copy = strdup(data);
+    fraktal_assert(copy && "Ran out of memory");
+    char type[32];
+    char output[FRAKTAL_MAX_PARAM_NAME_LEN + 1];
+    if (!parse_fragment_output(copy, type, sizeof(type), output, sizeof(output)))
+    {
+        free(copy);
+        return 0;
+    }
+    const char *to_vec4 = kernel_output_to_vec4(type);
+    if (!to_vec4)
+    {
+        log_err("Failed to compile fused shader (%s): unsupported output type '%s'.\n", name, type);
+        free(copy);
+        return 0;
+    }
+
+    char result[128];
+    snprintf(result, sizeof(result), to_vec4, output);
+    char epilogue[1024];
+    snprintf(epilogue, sizeof(epilogue),
+        "\n#undef main\n"
+        "layout(binding = 0, rgba32f) uniform image2D FraktalOutput;\n"
+        "out vec4 FraktalEpilogueOutput;\n"
+        "vec4 epilogue(vec4 value);\n"
+        "void FraktalMain();\n"
+        "void main()\n"
+        "{\n"
+        "    %s = %s(0.0);\n"
+        "    FraktalMain();\n"
+        "    ivec2 p = ivec2(gl_FragCoord.xy);\n"
+        "    vec4 sum = imageLoad(FraktalOutput, p) + %s;\n"
+        "    imageStore(FraktalOutput, p, sum);\n"
+        "    FraktalEpilogueOutput = epilogue(sum);\n"
+        "}\n",
+        output, type, result);
+
+    const char *sources[] = {
+        "#version 420\n",
+        kernel_fragment_prelude,
+        "#define main FraktalMain\n",
+        declarations,
         "\n#line 0\n",
-        (const char*)data,
+        copy,
+        epilogue,
     };
     int num_sources = sizeof(sources)/sizeof(sources[0]);
     GLuint shader = compile_shader(name, sources, num_sources, GL_FRAGMENT_SHADER);
-    if (!shader)
-        return false;
-    link->shaders[link->num_shaders++] = shader;
-    fraktal_check_gl_error();
-    return true;
+    free(copy);
+    return shader;
 }
 
-fLinkState *fraktal_create_link()
+// Linked kernels are kept in the cache while they are in use, and up to
+// 'max_kernels' kernels in total are kept after being destroyed (the
+// least recently used are freed first). See fraktal_set_kernel_cache.
+struct fKernelCache
 {
-    fraktal_ensure_context();
-    fLinkState *link = (fLinkState*)malloc(sizeof(fLinkState));
-    link->num_shaders = 0;
-    link->glsl_version = "#version 150";
-    link->params.count = 0;
-    link->params.sampler_count = 0;
-    return link;
+    fKernel **kernels;
+    int count;
+    int capacity;
+    int max_kernels; // 0 if the cache is disabled
+    int tick;
+    int hits;
+    int misses;
+};
+
+static fKernelCache fraktal_kernel_cache;
+
+static void free_kernel(fKernel *f); // see fraktal_destroy_kernel
+
+static unsigned int hash_link_sources(fLinkState *link)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (int i = 0; i < link->num_shaders; i++)
+    {
+        for (const char *c = link->sources[i].data; *c; c++)
+            hash = (hash ^ (unsigned char)*c)*16777619u;
+        hash = (hash ^ 0xff)*16777619u; // separates the sources
+    }
+    if (link->epilogue >= 0)
+        hash = (hash ^ (unsigned int)link->epilogue)*16777619u;
+    return hash;
 }
 
-void fraktal_destroy_link(fLinkState *link)
+static fKernel *find_cached_kernel(fLinkState *link, unsigned int hash)
 {
-    if (link)
+    fKernelCache *cache = &fraktal_kernel_cache;
+    for (int i = 0; i < cache->count; i++)
     {
-        fraktal_ensure_context();
-        fraktal_check_gl_error();
-        for (int i = 0; i < link->num_shaders; i++)
-            if (link->shaders[i])
-                glDeleteShader(link->shaders[i]);
-        free(link);
-        fraktal_check_gl_error();
+        fKernel *f = cache->kernels[i];
+        if (f->hash != hash ||
+            f->num_sources != link->num_shaders ||
+            f->fused != (link->epilogue >= 0) ||
+            strcmp(f->glsl_version, link->glsl_version) != 0)
+            continue;
+        bool equal = true;
+        for (int j = 0; j < f->num_sources && equal; j++)
+            if (strcmp(f->sources[j].data, link->sources[j].data) != 0)
+                equal = false;
+        if (equal)
+            return f;
     }
+    return NULL;
 }
 
-bool fraktal_add_link_data(fLinkState *link, const char *data, unsigned int size, const char *name)
+// Returns true if a cached kernel was linked from 'data', in which case
+// compiling 'data' on its own is known to succeed.
+static bool is_cached_source(const char *glsl_version, const char *data)
 {
-    // cannot assume that we are allowed to modify user data, so we make a copy.
-    if (size == 0) size = (unsigned int)strlen(data);
-    char *copy = (char*)malloc(size + 1);
-    strcpy(copy, data);
-    fraktal_assert(copy && "Ran out of memory");
-    bool result = add_link_data(link, copy, name);
-    free(copy);
-    return result;
+    fKernelCache *cache = &fraktal_kernel_cache;
+    for (int i = 0; i < cache->count; i++)
+    {
+        fKernel *f = cache->kernels[i];
+        if (strcmp(f->glsl_version, glsl_version) != 0)
+            continue;
+        for (int j = 0; j < f->num_sources; j++)
+            if (strcmp(f->sources[j].data, data) == 0)
+                return true;
+    }
+    return false;
 }
 
-bool fraktal_add_link_file(fLinkState *link, const char *path)
+// Frees the least recently used kernels that are not in use, until the
+// cache is within its limit.
+static void evict_cached_kernels()
 {
-    char *data = read_file(path);
-    if (!data)
+    fKernelCache *cache = &fraktal_kernel_cache;
+    while (cache->count > cache->max_kernels)
     {
-        log_err("Failed to open file '%s'\n", path);
-        return false;
+        int lru = -1;
+        for (int i = 0; i < cache->count; i++)
+            if (cache->kernels[i]->refs == 0 &&
+                (lru < 0 || cache->kernels[i]->last_used < cache->kernels[lru]->last_used))
+                lru = i;
+        if (lru < 0)
+            break;
+        fKernel *f = cache->kernels[lru];
+        cache->kernels[lru] = cache->kernels[--cache->count];
+        free_kernel(f);
     }
-    bool result = add_link_data(link, data, path);
-    free(data);
-    return result;
 }
 
-fKernel *fraktal_link_kernel(fLinkState *link)
+static void add_cached_kernel(fKernel *f, unsigned int hash)
 {
-    fraktal_assert(link);
-    fraktal_ensure_context();
-    fraktal_check_gl_error();
-    if (link->num_shaders <= 0)
-        return NULL;
+    fKernelCache *cache = &fraktal_kernel_cache;
+    if (cache->count == cache->capacity)
+    {
+        int capacity = cache->capacity ? 2*cache->capacity : 16;
+        fKernel **kernels = (fKernel**)realloc(cache->kernels, capacity*sizeof(fKernel*));
+        fraktal_assert(kernels && "Ran out of memory");
+        cache->kernels = kernels;
+        cache->capacity = capacity;
+    }
+    f->hash = hash;
+    f->refs = 1;
+    f->last_used = ++cache->tick;
+    cache->kernels[cache->count++] = f;
+    evict_cached_kernels();
+}
 
-    static GLuint vs = 0;
-    if (!vs)
+// Empties the cache before its context is destroyed, as kernels do not
+// survive their context. Kernels that are not in use are freed. Kernels
+// that are still in use are taken out of the cache, and are freed by the
+// last of their holders to destroy them (like uncached kernels), so that
+// they are never returned to a link in a later context.
+static void flush_kernel_cache()
+{
+    fKernelCache *cache = &fraktal_kernel_cache;
+    for (int i = 0; i < cache->count; i++)
     {
-        static const char *source =
-            "in vec2 iPosition;\n"
-            "void main()\n"
-            "{\n"
-            "    gl_Position = vec4(iPosition, 0.0, 1.0);\n"
-            "}\n"
-        ;
-        const char *sources[] = { link->glsl_version, "\n#line 0\n", source };
-        vs = compile_shader("built-in vertex shader", sources, sizeof(sources)/sizeof(char*), GL_VERTEX_SHADER);
+        fKernel *f = cache->kernels[i];
+        if (f->refs == 0)
+            free_kernel(f);
+        else
+            f->refs--;
     }
-    if (!vs)
+    cache->count = 0;
+}
+
+void fraktal_set_kernel_cache(int max_kernels)
+{
+    fraktal_assert(max_kernels >= 0);
+    fKernelCache *cache = &fraktal_kernel_cache;
+    cache->max_kernels = max_kernels;
+    evict_cached_kernels();
+    if (max_kernels == 0)
     {
-        log_err("Failed to link kernel\n");
+        // Kernels that are still in use are freed when destroyed.
+        cache->hits = 0;
+        cache->misses = 0;
+    }
+}
+
+void fraktal_get_kernel_cache_stats(int *hits, int *misses, int *count)
+{
+    fKernelCache *cache = &fraktal_kernel_cache;
+    if (hits) *hits = cache->hits;
+    if (misses) *misses = cache->misses;
+    if (count) *count = cache->count;
+}
+
+static GLuint compile_link_source(fLinkState *link, fKernelSource *source)
+{
+    char declarations[FRAKTAL_MAX_SPECIALIZED*(FRAKTAL_MAX_PARAM_NAME_LEN + 32)];
+    write_specialized_declarations(declarations, sizeof(declarations), &link->params, source, NULL);
+    return compile_kernel_shader(link->glsl_version, source->data, declarations, source->name);
+}
+
+struct fStringBuilder
+{
+    char *data;
+    size_t length;
+    size_t capacity;
+};
+
+static void string_append(fStringBuilder *b, const char *format, ...)
+{
+    for (;;)
+    {
+        va_list args;
+        va_start(args, format);
+        size_t available = b->capacity - b->length;
+        int n = b->data ? vsnprintf(b->data + b->length, available, format, args) : -1;
+        va_end(args);
+        if (n >= 0 && (size_t)n < available)
+        {
+            b->length += n;
+            return;
+        }
+        size_t needed = n >= 0 ? b->length + n + 1 : 0;
+        size_t capacity = b->capacity ? 2*b->capacity : 4096;
+        while (capacity < needed)
+            capacity *= 2;
+        b->data = (char*)realloc(b->data, capacity);
+        fraktal_assert(b->data && "Ran out of memory");
+        b->capacity = capacity;
+    }
+}
+
+enum { FRAKTAL_MAX_INCLUDES = 32 };
+
+// Files included with '#include "path"' are read and parsed once, and
+// reused by later links until the file is modified (see expand_includes).
+// The cache is guarded by 'lock', since links may be prepared on several
+// threads (see fraktal_create_deferred_link).
+struct fModule
+{
+    char *path;
+    time_t mtime;
+    long size;
+    char *data;   // parsed source (with meta annotations erased)
+    char *source; // source as read, kept only if it declares parameters
+};
+
+struct fModuleCache
+{
+    std::mutex lock;
+    fModule *modules;
+    int count;
+    int capacity;
+};
+
+static fModuleCache fraktal_module_cache;
+
+// Returns the parsed source of the file at 'path', which the caller must
+// free, and adds the parameters that it declares to 'params'.
+static char *load_module(const char *path, fParams *params)
+{
+    struct stat info;
+    if (stat(path, &info) != 0)
+    {
+        log_err("Failed to include '%s': file not found.\n", path);
         return NULL;
     }
 
-    GLuint program = glCreateProgram();
-    glAttachShader(program, vs);
-    for (int i = 0; i < link->num_shaders; i++)
-        glAttachShader(program, link->shaders[i]);
-    glLinkProgram(program);
-    glDetachShader(program, vs);
-    for (int i = 0; i < link->num_shaders; i++)
-        glDetachShader(program, link->shaders[i]);
+    fModuleCache *cache = &fraktal_module_cache;
+    char *data = NULL;
+    char *source = NULL;
+    {
+        std::lock_guard<std::mutex> guard(cache->lock);
+        for (int i = 0; i < cache->count; i++)
+        {
+            fModule *m = &cache->modules[i];
+            if (strcmp(m->path, path) == 0 && m->mtime == info.st_mtime && m->size == (long)info.st_size)
+            {
+                data = strdup(m->data);
+                source = m->source ? strdup(m->source) : NULL;
+                break;
+            }
+        }
+    }
+    if (data)
+    {
+        // The layout of parameters (std140 offsets and texture units)
+        // depends on the parameters declared before them, so these are
+        // parsed again for each link.
+        bool result = !source || parse_fraktal_source(source, params, path);
+        free(source);
+        if (!result)
+        {
+            free(data);
+            return NULL;
+        }
+        return data;
+    }
 
-    if (!program_link_status(program))
+    source = read_file(path);
+    if (!source)
     {
-        glDeleteProgram(program);
-        log_err("Failed to link kernel\n");
+        log_err("Failed to include '%s': could not read file.\n", path);
+        return NULL;
+    }
+    data = strdup(source);
+    fraktal_assert(data && "Ran out of memory");
+    int param_begin = params->count;
+    if (!parse_fraktal_source(data, params, path))
+    {
+        free(source);
+        free(data);
         return NULL;
     }
+    if (params->count == param_begin)
+    {
+        free(source);
+        source = NULL;
+    }
 
-    fKernel *kernel = (fKernel*)malloc(sizeof(fKernel));
-    kernel->program = program;
-    kernel->params.count = link->params.count;
-    kernel->params.sampler_count = link->params.sampler_count;
-    kernel->loc_iPosition = 0;
-    for (int i = 0; i < link->params.count; i++)
+    std::lock_guard<std::mutex> guard(cache->lock);
+    fModule *m = NULL;
+    for (int i = 0; i < cache->count && !m; i++)
+        if (strcmp(cache->modules[i].path, path) == 0)
+            m = &cache->modules[i];
+    if (m)
     {
-        strcpy(kernel->params.name[i], link->params.name[i]);
-        kernel->params.type[i] = link->params.type[i];
-        kernel->params.mean[i] = link->params.mean[i];
-        kernel->params.scale[i] = link->params.scale[i];
-        kernel->params.offset[i] = glGetUniformLocation(program, link->params.name[i]);
-        kernel->params.assigned_tex_unit[i] = link->params.assigned_tex_unit[i];
-        kernel->params.std140_offset[i] = link->params.std140_offset[i];
-        kernel->params.std140_size[i] = link->params.std140_size[i];
+        free(m->data);
+        free(m->source);
     }
-    // print kernel information
-    #if 0
+    else
     {
-        for (int i = 0; i < kernel->params.count; i++)
+        if (cache->count == cache->capacity)
         {
-            printf("%s: ", kernel->params.name[i]);
-            printf("%d: ", kernel->params.offset[i]);
-            printf("%d: ", kernel->params.type[i]);
-            printf("%f: ", kernel->params.mean[i].x);
-            printf("%f: ", kernel->params.scale[i].x);
-            printf("%d: ", kernel->params.assigned_tex_unit[i]);
-            printf("%d: ", kernel->params.std140_offset[i]);
-            printf("%d: ", kernel->params.std140_size[i]);
-            printf("\n");
+            int capacity = cache->capacity ? 2*cache->capacity : 16;
+            fModule *modules = (fModule*)realloc(cache->modules, capacity*sizeof(fModule));
+            fraktal_assert(modules && "Ran out of memory");
+            cache->modules = modules;
+            cache->capacity = capacity;
         }
-        printf("num_params: %d\n", kernel->params.count);
-        printf("num_samplers: %d\n", kernel->params.sampler_count);
+        m = &cache->modules[cache->count++];
+        m->path = strdup(path);
     }
-    #endif
-    fraktal_check_gl_error();
-    return kernel;
+    m->mtime = info.st_mtime;
+    m->size = (long)info.st_size;
+    m->data = strdup(data);
+    m->source = source;
+    return data;
 }
 
-void fraktal_destroy_kernel(fKernel *f)
+// Removes "." segments, and ".." segments together with the segment
+// before them, so that a file has one path however it is included.
+static void normalize_path(char *path)
 {
-    if (f)
+    char *dst = path;
+    const char *c = path;
+    if (*c == '/' || *c == '\\')
+        dst++, c++;
+    char *root = dst;
+    while (*c)
     {
-        fraktal_ensure_context();
-        fraktal_check_gl_error();
-        if (f->program)
-            glDeleteProgram(f->program);
-        free(f);
-        fraktal_check_gl_error();
+        const char *end = c;
+        while (*end && *end != '/' && *end != '\\')
+            end++;
+        size_t len = end - c;
+        bool last = *end == '\0';
+
+        // the last segment written is [segment, dst)
+        char *segment = dst;
+        while (segment > root && segment[-1] != '/' && segment[-1] != '\\')
+            segment--;
+        bool parent = dst > root && !(dst - segment == 2 && segment[0] == '.' && segment[1] == '.');
+
+        if (len == 0 || (len == 1 && c[0] == '.'))
+        {
+            // skip empty and "." segments
+        }
+        else if (len == 2 && c[0] == '.' && c[1] == '.' && parent)
+        {
+            dst = segment > root ? segment - 1 : root;
+        }
+        else
+        {
+            if (dst > root)
+                *dst++ = '/';
+            memmove(dst, c, len);
+            dst += len;
+        }
+        c = last ? end : end + 1;
     }
+    *dst = '\0';
 }
 
-fKernel *fraktal_load_kernel(const char *path)
+// Paths are relative to the directory of the including file, or else
+// to the working directory.
+static void resolve_include(const char *includer, const char *path, size_t path_len, char *dst, size_t sizeof_dst)
 {
-    fraktal_assert(path);
-    fLinkState *link = fraktal_create_link();
-    fraktal_add_link_file(link, path);
-    return fraktal_link_kernel(link);
+    const char *slash = includer ? strrchr(includer, '/') : NULL;
+    const char *backslash = includer ? strrchr(includer, '\\') : NULL;
+    if (backslash > slash)
+        slash = backslash;
+    bool absolute = path[0] == '/' || path[0] == '\\' || (path_len > 1 && path[1] == ':');
+    if (slash && !absolute)
+    {
+        struct stat info;
+        snprintf(dst, sizeof_dst, "%.*s%.*s", (int)(slash - includer + 1), includer, (int)path_len, path);
+        normalize_path(dst);
+        if (stat(dst, &info) == 0)
+            return;
+    }
+    snprintf(dst, sizeof_dst, "%.*s", (int)path_len, path);
+    normalize_path(dst);
+}
+
+struct fIncludes
+{
+    char *paths[FRAKTAL_MAX_INCLUDES]; // paths[k] is source string k + 1
+    int count;
+
+    // The included text in the expanded source, as offsets [begin, end)
+    // of each file included by the source itself (which contains the
+    // files that it includes in turn).
+    size_t ranges[2*FRAKTAL_MAX_INCLUDES];
+    int num_ranges;
+};
+
+// Replaces each '#include "path"' directive in 'data' (source string
+// number 'string', named 'name') with the parsed source of the file,
+// and returns the result, which the caller must free. Each file is
+// included once per kernel source, so later directives for the same
+// file are removed. Included files are given their own source string
+// number (see #line), so compiler errors refer to the right file and
+// line, and are listed in 'includes'.
+static char *expand_includes(const char *data, const char *name, int string, fParams *params, fIncludes *includes)
+{
+    fStringBuilder b = {0};
+    int line = 1;
+    const char *c = data;
+    const char *path;
+    size_t path_len;
+    const char *directive;
+    while ((directive = parse_next_include(c, &path, &path_len)) != NULL)
+    {
+        string_append(&b, "%.*s", (int)(directive - c), c);
+        for (const char *d = c; d < directive; d++)
+            if (*d == '\n')
+                line++;
+        c = directive;
+        while (*c && *c != '\n' && *c != '\r')
+            c++;
+
+        char resolved[1024];
+        resolve_include(name, path, path_len, resolved, sizeof(resolved));
+        bool included = false;
+        for (int k = 0; k < includes->count; k++)
+            if (strcmp(includes->paths[k], resolved) == 0)
+                included = true;
+        if (included)
+            continue;
+        if (includes->count == FRAKTAL_MAX_INCLUDES)
+        {
+            log_err("<%s>: line %d: error: too many included files (maximum is %d).\n", name, line, FRAKTAL_MAX_INCLUDES);
+            free(b.data);
+            return NULL;
+        }
+        int k = includes->count;
+        includes->paths[includes->count++] = strdup(resolved);
+
+        char *module = load_module(resolved, params);
+        if (!module)
+        {
+            log_err("<%s>: line %d: error: failed to include '%s'.\n", name, line, resolved);
+            free(b.data);
+            return NULL;
+        }
+        char *expanded = expand_includes(module, resolved, k + 1, params, includes);
+        free(module);
+        if (!expanded)
+        {
+            free(b.data);
+            return NULL;
+        }
+        string_append(&b, "#line 0 %d\n", k + 1);
+        if (string == 0)
+            includes->ranges[2*includes->num_ranges] = b.length;
+        string_append(&b, "%s", expanded);
+        if (string == 0)
+            includes->ranges[2*includes->num_ranges++ + 1] = b.length;
+        string_append(&b, "\n#line %d %d", line, string);
+        free(expanded);
+    }
+    string_append(&b, "%s", c);
+    return b.data;
+}
+
+struct fStripState
+{
+    fGlobalDefinition *defs;
+    int count;
+    int *next;    // next definition with the same name, or -1
+    int *table;   // open addressing hash table of (first definition with a name + 1), or 0
+    int table_size;
+    bool *used;
+    int *stack;   // definitions whose text has not been searched for references
+    int stack_count;
+};
+
+static int find_definition(fStripState *s, const char *name, int len)
+{
+    unsigned int mask = (unsigned int)s->table_size - 1;
+    for (unsigned int i = fraktal_hash_param_name(name, len) & mask; s->table[i]; i = (i + 1) & mask)
+    {
+        fGlobalDefinition *d = &s->defs[s->table[i] - 1];
+        if (d->name_len == len && memcmp(d->name, name, len) == 0)
+            return s->table[i] - 1;
+    }
+    return -1;
+}
+
+// Marks the definitions named by identifiers in [c, end) as used.
+static void mark_used_definitions(fStripState *s, const char *c, const char *end)
+{
+    while (c < end)
+    {
+        if (parse_comment(&c))
+            continue;
+        if (parse_is_alpha(*c))
+        {
+            const char *start = c;
+            while (c < end && parse_is_alpha(*c))
+                c++;
+            if (parse_is_digit(*start))
+                continue;
+            int i = find_definition(s, start, (int)(c - start));
+            if (i >= 0 && !s->used[i])
+            {
+                // overloads share the name, and are all kept
+                for (int j = i; j >= 0; j = s->next[j])
+                {
+                    s->used[j] = true;
+                    s->stack[s->stack_count++] = j;
+                }
+            }
+            continue;
+        }
+        c++;
+    }
+}
+
+// Removes the functions and constants of included files that the source
+// does not use, directly or through other definitions, so that the driver
+// does not compile the rest of a library (hg_sdf.f defines around seventy
+// functions, of which a model typically uses a handful). Everything else
+// is kept: the source's own definitions, structs, uniforms, prototypes
+// and preprocessor directives, and whatever they refer to. Removed text
+// is replaced by its line breaks, so that line numbers still match.
+static char *strip_unused_definitions(const char *data, const fIncludes *includes)
+{
+    enum { max_definitions = 4096 };
+    fStripState s = {0};
+    s.defs = (fGlobalDefinition*)malloc(max_definitions*sizeof(fGlobalDefinition));
+    fraktal_assert(s.defs && "Ran out of memory");
+    int count = parse_global_definitions(data, s.defs, max_definitions);
+    if (count < 0)
+    {
+        free(s.defs);
+        return strdup(data);
+    }
+
+    // Only definitions in included files can be removed.
+    for (int i = 0; i < count; i++)
+    {
+        size_t begin = s.defs[i].begin - data;
+        size_t end = s.defs[i].end - data;
+        for (int r = 0; r < includes->num_ranges; r++)
+        {
+            if (begin >= includes->ranges[2*r] && end <= includes->ranges[2*r + 1])
+            {
+                s.defs[s.count++] = s.defs[i];
+                break;
+            }
+        }
+    }
+
+    s.table_size = 64;
+    while (s.table_size < 2*s.count)
+        s.table_size *= 2;
+    s.table = (int*)calloc(s.table_size, sizeof(int));
+    s.next = (int*)malloc((s.count + 1)*sizeof(int));
+    s.used = (bool*)calloc(s.count + 1, sizeof(bool));
+    s.stack = (int*)malloc((s.count + 1)*sizeof(int));
+    fraktal_assert(s.table && s.next && s.used && s.stack && "Ran out of memory");
+    unsigned int mask = (unsigned int)s.table_size - 1;
+    for (int i = s.count - 1; i >= 0; i--)
+    {
+        fGlobalDefinition *d = &s.defs[i];
+        int first = find_definition(&s, d->name, d->name_len);
+        if (first >= 0)
+        {
+            // insert at the front of the list of definitions with this name
+            s.next[i] = first;
+            for (unsigned int j = fraktal_hash_param_name(d->name, d->name_len) & mask; ; j = (j + 1) & mask)
+            {
+                if (s.table[j] == first + 1)
+                {
+                    s.table[j] = i + 1;
+                    break;
+                }
+            }
+        }
+        else
+        {
+            s.next[i] = -1;
+            unsigned int j = fraktal_hash_param_name(d->name, d->name_len) & mask;
+            while (s.table[j])
+                j = (j + 1) & mask;
+            s.table[j] = i + 1;
+        }
+    }
+
+    // The text outside the removable definitions is always kept, and
+    // refers to the first definitions to keep.
+    const char *c = data;
+    for (int i = 0; i < s.count; i++)
+    {
+        mark_used_definitions(&s, c, s.defs[i].begin);
+        c = s.defs[i].end;
+    }
+    mark_used_definitions(&s, c, c + strlen(c));
+    while (s.stack_count > 0)
+    {
+        fGlobalDefinition *d = &s.defs[s.stack[--s.stack_count]];
+        mark_used_definitions(&s, d->begin, d->end);
+    }
+
+    fStringBuilder b = {0};
+    c = data;
+    for (int i = 0; i < s.count; i++)
+    {
+        if (s.used[i])
+            continue;
+        string_append(&b, "%.*s", (int)(s.defs[i].begin - c), c);
+        for (c = s.defs[i].begin; c < s.defs[i].end; c++)
+            if (*c == '\n')
+                string_append(&b, "\n");
+    }
+    string_append(&b, "%s", c);
+
+    free(s.defs);
+    free(s.table);
+    free(s.next);
+    free(s.used);
+    free(s.stack);
+    return b.data;
+}
+
+static bool add_link_data(fLinkState *link, char *data, const char *name)
+{
+    fraktal_assert(link);
+    fraktal_assert(link->glsl_version);
+    fraktal_assert(data && "'data' must be a non-NULL pointer to a buffer containing kernel source text.");
+    if (!link->deferred)
+    {
+        fraktal_ensure_context();
+        fraktal_check_gl_error();
+    }
+    if (link->num_shaders == link->capacity)
+    {
+        int capacity = link->capacity ? 2*link->capacity : 8;
+        GLuint *shaders = (GLuint*)realloc(link->shaders, capacity*sizeof(GLuint));
+        fraktal_assert(shaders && "Ran out of memory");
+        link->shaders = shaders;
+        fKernelSource *sources = (fKernelSource*)realloc(link->sources, capacity*sizeof(fKernelSource));
+        fraktal_assert(sources && "Ran out of memory");
+        link->sources = sources;
+        link->capacity = capacity;
+    }
+    fKernelSource *source = &link->sources[link->num_shaders];
+    source->param_begin = link->params.count;
+    if (!parse_fraktal_source(data, &link->params, name))
+    {
+        log_err("Error parsing kernel source\n");
+        return false;
+    }
+    if (!name)
+        name = "unnamed";
+    fIncludes includes;
+    includes.count = 0;
+    includes.num_ranges = 0;
+    char *expanded = expand_includes(data, name, 0, &link->params, &includes);
+    if (!expanded)
+    {
+        for (int i = 0; i < includes.count; i++)
+            free(includes.paths[i]);
+        log_err("Error parsing kernel source\n");
+        return false;
+    }
+    if (includes.num_ranges > 0)
+    {
+        char *stripped = strip_unused_definitions(expanded, &includes);
+        free(expanded);
+        expanded = stripped;
+    }
+    data = expanded;
+    source->param_end = link->params.count;
+
+    bool specialized = false;
+    for (int i = source->param_begin; i < source->param_end; i++)
+        if (link->params.specialize[i])
+            specialized = true;
+
+    if (link->defines)
+    {
+        static const char *line_0 = "#line 0\n";
+        char *defined = (char*)malloc(strlen(link->defines) + strlen(line_0) + strlen(data) + 1);
+        fraktal_assert(defined && "Ran out of memory");
+        strcpy(defined, link->defines);
+        strcat(defined, line_0);
+        strcat(defined, data);
+        free(expanded);
+        source->data = defined;
+    }
+    else
+    {
+        source->data = expanded;
+    }
+
+    // Compiler errors refer to included files by their source string
+    // number, which are listed after the name, e.g. "model.f (1: hg_sdf.f)".
+    size_t name_len = strlen(name) + 1;
+    for (int i = 0; i < includes.count; i++)
+        name_len += strlen(includes.paths[i]) + 16;
+    source->name = (char*)malloc(name_len + 2);
+    fraktal_assert(source->name && "Ran out of memory");
+    strcpy(source->name, name);
+    for (int i = 0; i < includes.count; i++)
+    {
+        size_t len = strlen(source->name);
+        snprintf(source->name + len, name_len + 2 - len, "%s%d: %s", i == 0 ? " (" : ", ", i + 1, includes.paths[i]);
+        free(includes.paths[i]);
+    }
+    if (includes.count > 0)
+        strcat(source->name, ")");
+
+    // Sources of cached kernels are compiled only if the link misses
+    // the cache (see fraktal_link_kernel).
+    GLuint shader = 0;
+    if (!link->deferred && !is_cached_source(link->glsl_version, source->data))
+    {
+        shader = compile_link_source(link, source);
+        if (!shader)
+        {
+            free(source->data);
+            free(source->name);
+            source->data = NULL;
+            return false;
+        }
+    }
+    source->specialized = specialized;
+    source->fused = false;
+    source->epilogue = false;
+    source->shader = shader;
+    link->shaders[link->num_shaders++] = shader;
+    return true;
+}
+
+static fLinkState *create_link(bool deferred)
+{
+    fLinkState *link = (fLinkState*)calloc(1, sizeof(fLinkState));
+    fraktal_assert(link && "Ran out of memory");
+    link->glsl_version = "#version 150";
+    link->epilogue = -1;
+    link->deferred = deferred;
+    return link;
+}
+
+fLinkState *fraktal_create_link()
+{
+    fraktal_ensure_context();
+    return create_link(false);
+}
+
+fLinkState *fraktal_create_deferred_link()
+{
+    return create_link(true);
+}
+
+void fraktal_destroy_link(fLinkState *link)
+{
+    if (link)
+    {
+        // A deferred link has no shaders unless it has been linked.
+        bool has_shaders = false;
+        for (int i = 0; i < link->num_shaders; i++)
+            if (link->shaders[i])
+                has_shaders = true;
+        if (has_shaders)
+        {
+            fraktal_ensure_context();
+            fraktal_check_gl_error();
+            for (int i = 0; i < link->num_shaders; i++)
+                if (link->shaders[i])
+                    glDeleteShader(link->shaders[i]);
+            fraktal_check_gl_error();
+        }
+        for (int i = 0; i < link->num_shaders; i++)
+        {
+            free(link->sources[i].data);
+            free(link->sources[i].name);
+        }
+        free(link->shaders);
+        free(link->sources);
+        fraktal_free_params(&link->params);
+        free(link->defines);
+        free(link);
+    }
+}
+
+bool fraktal_link_define(fLinkState *link, const char *name, const char *value)
+{
+    fraktal_assert(link);
+    fraktal_assert(name);
+    bool valid = name[0] && !(name[0] >= '0' && name[0] <= '9');
+    for (const char *c = name; *c; c++)
+        if (!parse_is_alpha(*c) && *c != '_') // (parse_is_alpha includes digits)
+            valid = false;
+    if (!valid)
+    {
+        log_err("Failed to define '%s': not a valid macro name.\n", name);
+        return false;
+    }
+    if (value && strpbrk(value, "\r\n"))
+    {
+        log_err("Failed to define '%s': the value cannot span multiple lines.\n", name);
+        return false;
+    }
+
+    size_t len = link->defines ? strlen(link->defines) : 0;
+    size_t add = strlen("#define  \n") + strlen(name) + (value ? strlen(value) : 0);
+    char *defines = (char*)realloc(link->defines, len + add + 1);
+    fraktal_assert(defines && "Ran out of memory");
+    snprintf(defines + len, add + 1, "#define %s %s\n", name, value ? value : "");
+    link->defines = defines;
+    return true;
+}
+
+bool fraktal_add_link_data(fLinkState *link, const char *data, unsigned int size, const char *name)
+{
+    // cannot assume that we are allowed to modify user data, so we make a copy.
+    if (size == 0) size = (unsigned int)strlen(data);
+    char *copy = (char*)malloc(size + 1);
+    strcpy(copy, data);
+    fraktal_assert(copy && "Ran out of memory");
+    bool result = add_link_data(link, copy, name);
+    free(copy);
+    return result;
+}
+
+bool fraktal_add_link_file(fLinkState *link, const char *path)
+{
+    char *data = read_file(path);
+    if (!data)
+    {
+        log_err("Failed to open file '%s'\n", path);
+        return false;
+    }
+    bool result = add_link_data(link, data, path);
+    free(data);
+    return result;
+}
+
+bool fraktal_add_link_epilogue(fLinkState *link, const char *data, unsigned int size, const char *name)
+{
+    fraktal_assert(link);
+    fraktal_assert(data && "'data' must be a non-NULL pointer to a buffer containing kernel source text.");
+    if (link->epilogue >= 0)
+    {
+        log_err("Failed to add epilogue: the link already has an epilogue.\n");
+        return false;
+    }
+    // Deferred links do not touch GL here (see fraktal_link_kernel).
+    if (!link->deferred)
+        fraktal_ensure_context();
+    if (!link->deferred && !fraktal_fusion_supported())
+    {
+        log_err("Failed to add epilogue: fusing kernels requires OpenGL 4.2.\n");
+        return false;
+    }
+
+    static const char *prefix = "#define FRAKTAL_EPILOGUE\n#line 0\n";
+    if (size == 0) size = (unsigned int)strlen(data);
+    char *copy = (char*)malloc(strlen(prefix) + size + 1);
+    fraktal_assert(copy && "Ran out of memory");
+    strcpy(copy, prefix);
+    strncat(copy, data, size);
+    int index = link->num_shaders;
+    bool result = add_link_data(link, copy, name);
+    free(copy);
+    if (result)
+    {
+        link->epilogue = index;
+        link->sources[index].epilogue = true;
+    }
+    return result;
+}
+
+// Recompiles the source that declares the output variable, such that
+// it passes its output through the epilogue.
+static bool fuse_link_epilogue(fLinkState *link)
+{
+    for (int i = 0; i < link->num_shaders; i++)
+    {
+        fKernelSource *source = &link->sources[i];
+        if (i == link->epilogue)
+            continue;
+        if (source->fused)
+            return true;
+
+        char type[32];
+        char output[FRAKTAL_MAX_PARAM_NAME_LEN + 1];
+        char *copy = strdup(source->data);
+        fraktal_assert(copy && "Ran out of memory");
+        bool has_output = parse_fragment_output(copy, type, sizeof(type), output, sizeof(output));
+        free(copy);
+        if (!has_output)
+            continue;
+
+        char declarations[FRAKTAL_MAX_SPECIALIZED*(FRAKTAL_MAX_PARAM_NAME_LEN + 32)];
+        write_specialized_declarations(declarations, sizeof(declarations), &link->params, source, NULL);
+        GLuint shader = compile_kernel_fused_shader(source->data, declarations, source->name);
+        if (!shader)
+            return false;
+        glDeleteShader(link->shaders[i]);
+        link->shaders[i] = shader;
+        source->shader = shader;
+        source->fused = true;
+        return true;
+    }
+    log_err("Failed to fuse epilogue: no source declares an output variable.\n");
+    return false;
+}
+
+// Appends 'model' to 'b' with the names that it defines at global scope
+// renamed by the suffix _i. Only the uses of these names are renamed,
+// and not the member names that happen to be spelled the same: an
+// identifier after a '.' (a swizzle or a struct field), or a field name
+// in a struct declaration. Files that the model includes are expanded
+// later (see expand_includes), and are not renamed.
+static void append_renamed_model(fStringBuilder *b, const char *model, fTopLevelName *names, int num_names, int i)
+{
+    const char *copied = model; // end of the text appended so far
+    const char *c = model;
+    char last = 0;              // last character outside blanks and comments
+    int depth = 0;              // braces
+    int brackets = 0;
+    int struct_depth = 0;       // depth of the struct body we are in, if any
+    bool struct_pending = false;
+    while (*c)
+    {
+        if (parse_comment(&c) || parse_blank(&c))
+            continue;
+        if (*c == '"') // #include path
+        {
+            c++;
+            while (*c && *c != '"' && *c != '\n' && *c != '\r')
+                c++;
+            if (*c == '"')
+                c++;
+            last = '"';
+            continue;
+        }
+        if (parse_is_alpha(*c))
+        {
+            const char *start = c;
+            parse_alpha(&c);
+            int len = (int)(c - start);
+            bool member = last == '.';
+            bool field = struct_depth > 0 && brackets == 0 && (parse_is_alpha(last) || last == ',' || last == ']');
+            if (!parse_is_digit(*start) && !member && !field)
+            {
+                for (int j = 0; j < num_names; j++)
+                {
+                    if (names[j].kind == PARSE_TOP_LEVEL_DEFINITION &&
+                        (int)strlen(names[j].name) == len &&
+                        strncmp(names[j].name, start, len) == 0)
+                    {
+                        string_append(b, "%.*s_%d", (int)(c - copied), copied, i);
+                        copied = c;
+                        break;
+                    }
+                }
+            }
+            if (len == 6 && strncmp(start, "struct", 6) == 0)
+                struct_pending = true;
+            last = c[-1];
+            continue;
+        }
+        if (*c == '{')
+        {
+            depth++;
+            if (struct_pending)
+                struct_depth = depth;
+            struct_pending = false;
+        }
+        else if (*c == '}')
+        {
+            if (depth == struct_depth)
+                struct_depth = 0;
+            depth--;
+        }
+        else if (*c == '[') brackets++;
+        else if (*c == ']') brackets--;
+        else if (*c == ';') struct_pending = false;
+        last = *c;
+        c++;
+    }
+    string_append(b, "%s\n", copied);
+}
+
+bool fraktal_add_link_models(fLinkState *link, const char **models, int count, fEnum dispatch, const char *name)
+{
+    fraktal_assert(link);
+    fraktal_assert(models && count > 0);
+    fraktal_assert((dispatch == FRAKTAL_MODEL_PER_INSTANCE || dispatch == FRAKTAL_MODEL_PER_ROW) && "Invalid model dispatch mode.");
+
+    enum { max_names = 1024 };
+    fTopLevelName *names = (fTopLevelName*)malloc(max_names*sizeof(fTopLevelName));
+    fTopLevelName *uniforms = (fTopLevelName*)malloc(max_names*sizeof(fTopLevelName));
+    fraktal_assert(names && uniforms && "Ran out of memory");
+    int num_uniforms = 0;
+
+    fStringBuilder b = {0};
+    for (int i = 0; i < count; i++)
+    {
+        fraktal_assert(models[i]);
+        char *model = strdup(models[i]);
+        fraktal_assert(model && "Ran out of memory");
+        int num_names = parse_top_level_names(model, names, max_names);
+        if (num_names == max_names)
+            log_err("Model %d declares too many names; some may not be renamed.\n", i);
+
+        // Each model's functions and globals are suffixed by its index, so
+        // that models can use the same names without clashing. Uniforms are
+        // shared by all models and are only declared by the first one.
+        for (int j = 0; j < num_names; j++)
+        {
+            fTopLevelName *n = &names[j];
+            if (n->kind == PARSE_TOP_LEVEL_UNIFORM)
+            {
+                bool declared = false;
+                for (int k = 0; k < num_uniforms; k++)
+                    if (strcmp(uniforms[k].name, n->name) == 0)
+                        declared = true;
+                if (declared)
+                    parse_erase(n->begin, n->end);
+                else if (num_uniforms < max_names)
+                    uniforms[num_uniforms++] = *n;
+            }
+        }
+        string_append(&b, "#line 0 %d\n", i);
+        append_renamed_model(&b, model, names, num_names, i);
+        for (int j = 0; j < num_names; j++)
+            if (names[j].kind == PARSE_TOP_LEVEL_MACRO)
+                string_append(&b, "#undef %s\n", names[j].name);
+        free(model);
+    }
+
+    string_append(&b, "float model(vec3 p)\n{\n    switch (clamp(%s, 0, %d))\n    {\n",
+        dispatch == FRAKTAL_MODEL_PER_INSTANCE ? "iInstance" : "int(iFragCoord.y)", count - 1);
+    for (int i = 0; i < count; i++)
+        string_append(&b, "        case %d: return model_%d(p);\n", i, i);
+    string_append(&b, "    }\n    return 0.0;\n}\n");
+
+    bool result = add_link_data(link, b.data, name ? name : "models");
+    free(b.data);
+    free(names);
+    free(uniforms);
+    return result;
+}
+
+static GLuint get_kernel_vertex_shader(const char *glsl_version)
+{
+    GLuint vs = fraktal_gl.kernel_vs;
+    if (!vs)
+    {
+        // When running instanced, FraktalTiles holds the number of tile
+        // columns and the tile width and height, and each instance draws
+        // the quad over its own tile in the output array. Otherwise it
+        // is zero and the quad covers the whole output array.
+        static const char *source =
+            "in vec2 iPosition;\n"
+            "uniform ivec3 FraktalTiles;\n"
+            "uniform vec2 FraktalTarget;\n"
+            "flat out int iInstance;\n"
+            "flat out vec2 FraktalTileOrigin;\n"
+            "void main()\n"
+            "{\n"
+            "    iInstance = gl_InstanceID;\n"
+            "    if (FraktalTiles.x > 0)\n"
+            "    {\n"
+            "        ivec2 tile = ivec2(gl_InstanceID % FraktalTiles.x, gl_InstanceID / FraktalTiles.x);\n"
+            "        FraktalTileOrigin = vec2(tile*FraktalTiles.yz);\n"
+            "        vec2 pixel = FraktalTileOrigin + (0.5 + 0.5*iPosition)*vec2(FraktalTiles.yz);\n"
+            "        gl_Position = vec4(2.0*pixel/FraktalTarget - 1.0, 0.0, 1.0);\n"
+            "    }\n"
+            "    else\n"
+            "    {\n"
+            "        FraktalTileOrigin = vec2(0.0);\n"
+            "        gl_Position = vec4(iPosition, 0.0, 1.0);\n"
+            "    }\n"
+            "}\n"
+        ;
+        const char *sources[] = { glsl_version, "\n#line 0\n", source };
+        vs = compile_shader("built-in vertex shader", sources, sizeof(sources)/sizeof(char*), GL_VERTEX_SHADER);
+        fraktal_gl.kernel_vs = vs;
+    }
+    return vs;
+}
+
+// Returns 0 on failure. If 'keep_attached' is true the fragment shaders
+// are left attached to the program, which keeps them alive for as long
+// as the program exists (even if they are deleted in the meantime).
+static GLuint link_kernel_program(const char *glsl_version, GLuint *shaders, int num_shaders, bool keep_attached)
+{
+    GLuint vs = get_kernel_vertex_shader(glsl_version);
+    if (!vs)
+        return 0;
+
+    GLuint program = glCreateProgram();
+    glBindAttribLocation(program, 0, "iPosition");
+    glAttachShader(program, vs);
+    for (int i = 0; i < num_shaders; i++)
+        glAttachShader(program, shaders[i]);
+    glLinkProgram(program);
+    glDetachShader(program, vs);
+    if (!keep_attached)
+        for (int i = 0; i < num_shaders; i++)
+            glDetachShader(program, shaders[i]);
+
+    if (!program_link_status(program))
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+static GLuint link_compute_program(GLuint *shaders, int num_shaders)
+{
+    GLuint program = glCreateProgram();
+    for (int i = 0; i < num_shaders; i++)
+        glAttachShader(program, shaders[i]);
+    glLinkProgram(program);
+    for (int i = 0; i < num_shaders; i++)
+        glDetachShader(program, shaders[i]);
+    if (!program_link_status(program))
+    {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+// Sampler parameters are assigned a fixed texture unit, so that
+// fraktal_param_array only needs to bind the array's texture.
+static void assign_sampler_units(GLuint program, fParams *params, int *location)
+{
+    if (params->sampler_count == 0)
+        return;
+    GLint last_program = 0;
+    if (!fraktal_gl.valid)
+        glGetIntegerv(GL_CURRENT_PROGRAM, &last_program);
+    fraktal_gl_use_program(program);
+    for (int i = 0; i < params->count; i++)
+    {
+        fParamType type = params->type[i];
+        if (type == FRAKTAL_PARAM_SAMPLER1D || type == FRAKTAL_PARAM_SAMPLER2D)
+            glUniform1i(location[i], params->assigned_tex_unit[i]);
+    }
+    if (!fraktal_gl.valid)
+        glUseProgram(last_program);
+    else if (fraktal_current_kernel)
+        fraktal_gl_use_program(fraktal_current_kernel->active->program);
+}
+
+static void init_kernel_variant(fKernelVariant *v, GLuint program)
+{
+    v->program = program;
+    v->loc_tiles = program ? glGetUniformLocation(program, "FraktalTiles") : -1;
+    v->loc_target = program ? glGetUniformLocation(program, "FraktalTarget") : -1;
+    v->tiles_set = false;
+    v->location = NULL;
+}
+
+// Compiles and links the variant of 'f' that was last requested, where
+// the specialized parameters are constants equal to their requested
+// values. On failure, the variant is still added (with a program of 0)
+// so that it is not attempted again. Returns NULL if the cache is full.
+static fKernelVariant *fraktal_link_variant(fKernel *f)
+{
+    fKernelSpecialization *spec = f->spec;
+    if (spec->variant_count == FRAKTAL_MAX_KERNEL_VARIANTS)
+        return NULL;
+
+    fKernelVariant *v = &spec->variants[spec->variant_count++];
+    init_kernel_variant(v, 0);
+    v->key = spec->requested;
+    bool compute = v->key.compute_format != 0;
+
+    GLuint *shaders = (GLuint*)malloc(f->num_sources*sizeof(GLuint));
+    fraktal_assert(shaders && "Ran out of memory");
+    bool ok = true;
+    for (int i = 0; i < f->num_sources; i++)
+    {
+        fKernelSource *source = &f->sources[i];
+        shaders[i] = source->shader;
+        if (source->specialized || compute)
+        {
+            char declarations[FRAKTAL_MAX_SPECIALIZED*(FRAKTAL_MAX_PARAM_NAME_LEN + 32)];
+            write_specialized_declarations(declarations, sizeof(declarations), &f->params, source, v->key.values);
+            if (compute)
+                shaders[i] = compile_kernel_compute_shader(source->data, declarations, source->name, &v->key);
+            else if (source->fused)
+                shaders[i] = compile_kernel_fused_shader(source->data, declarations, source->name);
+            else
+                shaders[i] = compile_kernel_shader(f->glsl_version, source->data, declarations, source->name);
+            if (!shaders[i])
+                ok = false;
+        }
+    }
+
+    GLuint program = 0;
+    if (ok && compute)
+        program = link_compute_program(shaders, f->num_sources);
+    else if (ok)
+        program = link_kernel_program(f->glsl_version, shaders, f->num_sources, false);
+    for (int i = 0; i < f->num_sources; i++)
+        if (shaders[i] && shaders[i] != f->sources[i].shader)
+            glDeleteShader(shaders[i]);
+    free(shaders);
+
+    if (!program)
+    {
+        log_err("Failed to link kernel variant\n");
+        return v;
+    }
+
+    init_kernel_variant(v, program);
+    v->location = (int*)malloc(f->params.count*sizeof(int));
+    fraktal_assert(v->location && "Ran out of memory");
+    for (int i = 0; i < f->params.count; i++)
+        v->location[i] = glGetUniformLocation(program, fraktal_param_name(&f->params, i));
+    assign_sampler_units(program, &f->params, v->location);
+    fraktal_check_gl_error();
+    return v;
+}
+
+fKernel *fraktal_link_kernel(fLinkState *link)
+{
+    fraktal_assert(link);
+    fraktal_ensure_context();
+    fraktal_check_gl_error();
+    if (link->num_shaders <= 0)
+        return NULL;
+
+    int num_specialized = 0;
+    for (int i = 0; i < link->params.count; i++)
+        if (link->params.specialize[i])
+            num_specialized++;
+    if (num_specialized > FRAKTAL_MAX_SPECIALIZED)
+    {
+        log_err("Failed to link kernel: too many specialized parameters (maximum is %d)\n", FRAKTAL_MAX_SPECIALIZED);
+        return NULL;
+    }
+
+    unsigned int hash = 0;
+    if (fraktal_kernel_cache.max_kernels > 0)
+    {
+        hash = hash_link_sources(link);
+        fKernel *cached = find_cached_kernel(link, hash);
+        if (cached)
+        {
+            fraktal_kernel_cache.hits++;
+            cached->refs++;
+            return cached;
+        }
+        fraktal_kernel_cache.misses++;
+    }
+
+    if (link->deferred && link->epilogue >= 0 && !fraktal_fusion_supported())
+    {
+        log_err("Failed to link kernel: fusing kernels requires OpenGL 4.2.\n");
+        return NULL;
+    }
+
+    for (int i = 0; i < link->num_shaders; i++)
+    {
+        if (link->shaders[i])
+            continue;
+        GLuint shader = compile_link_source(link, &link->sources[i]);
+        if (!shader)
+        {
+            log_err("Failed to link kernel\n");
+            return NULL;
+        }
+        link->shaders[i] = shader;
+        link->sources[i].shader = shader;
+    }
+
+    if (link->epilogue >= 0 && !fuse_link_epilogue(link))
+    {
+        log_err("Failed to link kernel\n");
+        return NULL;
+    }
+
+    GLuint program = link_kernel_program(link->glsl_version, link->shaders, link->num_shaders, num_specialized > 0);
+    if (!program)
+    {
+        log_err("Failed to link kernel\n");
+        return NULL;
+    }
+
+    fKernel *kernel = (fKernel*)calloc(1, sizeof(fKernel));
+    fraktal_assert(kernel && "Ran out of memory");
+    init_kernel_variant(&kernel->generic, program);
+    kernel->generic.key.generic = 1;
+    kernel->active = &kernel->generic;
+    kernel->spec = NULL;
+    kernel->fused = link->epilogue >= 0;
+    fraktal_copy_params(&kernel->params, &link->params);
+    for (int i = 0; i < kernel->params.count; i++)
+        kernel->params.offset[i] = glGetUniformLocation(program, fraktal_param_name(&kernel->params, i));
+    fraktal_compute_param_vector(&kernel->params);
+    assign_sampler_units(program, &kernel->params, kernel->params.offset);
+
+    kernel->glsl_version = link->glsl_version;
+    kernel->num_sources = link->num_shaders;
+    kernel->sources = (fKernelSource*)malloc(link->num_shaders*sizeof(fKernelSource));
+    fraktal_assert(kernel->sources && "Ran out of memory");
+    for (int i = 0; i < link->num_shaders; i++)
+    {
+        kernel->sources[i] = link->sources[i];
+        kernel->sources[i].data = strdup(link->sources[i].data);
+        kernel->sources[i].name = strdup(link->sources[i].name);
+        if (num_specialized == 0)
+            kernel->sources[i].shader = 0; // not kept alive by the generic program
+    }
+
+    // The generic program keeps the shaders attached, such that the
+    // shaders without specialized parameters can be reused by variants.
+    if (num_specialized > 0)
+        fraktal_create_specialization(kernel);
+
+    // print kernel information
+    #if 0
+    {
+        for (int i = 0; i < kernel->params.count; i++)
+        {
+            printf("%s: ", fraktal_param_name(&kernel->params, i));
+            printf("%d: ", kernel->params.offset[i]);
+            printf("%d: ", kernel->params.type[i]);
+            printf("%f: ", kernel->params.mean[i].x);
+            printf("%f: ", kernel->params.scale[i].x);
+            printf("%d: ", kernel->params.assigned_tex_unit[i]);
+            printf("%d: ", kernel->params.std140_offset[i]);
+            printf("%d: ", kernel->params.std140_size[i]);
+            printf("\n");
+        }
+        printf("num_params: %d\n", kernel->params.count);
+        printf("num_samplers: %d\n", kernel->params.sampler_count);
+    }
+    #endif
+    if (fraktal_kernel_cache.max_kernels > 0)
+        add_cached_kernel(kernel, hash);
+    fraktal_check_gl_error();
+    return kernel;
+}
+
+void fraktal_destroy_kernel(fKernel *f)
+{
+    if (f && f->refs > 0)
+    {
+        f->refs--;
+        f->last_used = ++fraktal_kernel_cache.tick;
+        evict_cached_kernels();
+    }
+    else
+    {
+        free_kernel(f);
+    }
+}
+
+struct fLinkQueueItem
+{
+    fLinkState *link;
+    fLinkCallback done;
+    void *user;
+};
+
+// Links waiting to be linked on the GL thread, in the order they were
+// queued. Guarded by 'lock', since any thread may queue links.
+struct fLinkQueue
+{
+    std::mutex lock;
+    fLinkQueueItem *items;
+    int count;
+    int capacity;
+};
+
+static fLinkQueue fraktal_link_queue;
+
+void fraktal_queue_link(fLinkState *link, fLinkCallback done, void *user)
+{
+    fraktal_assert(link);
+    std::lock_guard<std::mutex> guard(fraktal_link_queue.lock);
+    fLinkQueue *q = &fraktal_link_queue;
+    if (q->count == q->capacity)
+    {
+        int capacity = q->capacity ? 2*q->capacity : 16;
+        fLinkQueueItem *items = (fLinkQueueItem*)realloc(q->items, capacity*sizeof(fLinkQueueItem));
+        fraktal_assert(items && "Ran out of memory");
+        q->items = items;
+        q->capacity = capacity;
+    }
+    q->items[q->count].link = link;
+    q->items[q->count].done = done;
+    q->items[q->count].user = user;
+    q->count++;
+}
+
+int fraktal_run_link_queue(int max_links)
+{
+    // The lock is only held while taking items off the queue, so that
+    // other threads can keep queueing links while these are linked.
+    fLinkQueueItem items[16];
+    int processed = 0;
+    while (max_links <= 0 || processed < max_links)
+    {
+        int n = 0;
+        {
+            std::lock_guard<std::mutex> guard(fraktal_link_queue.lock);
+            fLinkQueue *q = &fraktal_link_queue;
+            n = q->count;
+            if (n > 16) n = 16;
+            if (max_links > 0 && n > max_links - processed) n = max_links - processed;
+            if (n > 0)
+            {
+                memcpy(items, q->items, n*sizeof(fLinkQueueItem));
+                memmove(q->items, q->items + n, (q->count - n)*sizeof(fLinkQueueItem));
+                q->count -= n;
+            }
+        }
+        if (n == 0)
+            break;
+        for (int i = 0; i < n; i++)
+        {
+            fKernel *kernel = fraktal_link_kernel(items[i].link);
+            fraktal_destroy_link(items[i].link);
+            if (items[i].done)
+                items[i].done(kernel, items[i].user);
+        }
+        processed += n;
+    }
+    return processed;
+}
+
+static void free_kernel(fKernel *f)
+{
+    if (f)
+    {
+        fraktal_ensure_context();
+        fraktal_check_gl_error();
+        if (f->generic.program)
+        {
+            fraktal_gl_forget_program(f->generic.program);
+            glDeleteProgram(f->generic.program);
+        }
+        if (f->spec)
+        {
+            for (int i = 0; i < f->spec->variant_count; i++)
+            {
+                fKernelVariant *v = &f->spec->variants[i];
+                if (v->program)
+                {
+                    fraktal_gl_forget_program(v->program);
+                    glDeleteProgram(v->program);
+                }
+                free(v->location);
+            }
+            free(f->spec->values);
+            free(f->spec);
+        }
+        for (int i = 0; i < f->num_sources; i++)
+        {
+            free(f->sources[i].data);
+            free(f->sources[i].name);
+        }
+        free(f->sources);
+        fraktal_free_params(&f->params);
+        free(f);
+        fraktal_check_gl_error();
+    }
+}
+
+fKernel *fraktal_load_kernel(const char *path)
+{
+    fraktal_assert(path);
+    fLinkState *link = fraktal_create_link();
+    fraktal_add_link_file(link, path);
+    return fraktal_link_kernel(link);
+}
+
+// Writes the current value of parameter 'i' of 'f' as a GLSL constant
+// expression of the parameter's type. Returns false if the parameter
+// cannot be frozen.
+static bool write_param_literal(fStringBuilder *b, fKernel *f, int i)
+{
+    fCommand value;
+    memset(&value, 0, sizeof(value));
+    value.type = fraktal_param_command_type(f->params.type[i]);
+    if (value.type == FRAKTAL_CMD_USE_KERNEL)
+        return false;
+    bool is_int = value.type >= FRAKTAL_CMD_PARAM_1I && value.type <= FRAKTAL_CMD_PARAM_4I;
+
+    // Specialized parameters are constants in the variants, so their
+    // value is only known to the specialization.
+    fKernelVariant *v = f->active;
+    int location = v->location ? v->location[i] : f->params.offset[i];
+    if (f->spec && (location < 0 || f->params.specialize[i]))
+        value = f->spec->values[i];
+    else if (location >= 0 && is_int)
+        glGetUniformiv(v->program, location, value.i);
+    else if (location >= 0)
+        glGetUniformfv(v->program, location, value.f);
+
+    int n = fraktal_command_param_size(value.type)/(int)sizeof(float);
+    if (value.type == FRAKTAL_CMD_PARAM_TRANSPOSE_MATRIX4F)
+    {
+        fCommand t = value;
+        for (int r = 0; r < 4; r++)
+            for (int c = 0; c < 4; c++)
+                value.f[4*c + r] = t.f[4*r + c];
+    }
+    static const char *constructors[] = { "", "vec2", "vec3", "vec4" };
+    const char *constructor = n == 16 ? "mat4" : constructors[n - 1];
+    if (is_int && n > 1)
+        string_append(b, "i");
+    string_append(b, "%s%s", constructor, n > 1 ? "(" : "");
+    for (int k = 0; k < n; k++)
+    {
+        if (k > 0)
+            string_append(b, ", ");
+        if (is_int)
+        {
+            string_append(b, "%d", value.i[k]);
+        }
+        else
+        {
+            float x = value.f[k];
+            if (x != x || x - x != 0.0f) // NaN or infinity
+            {
+                log_err("Failed to freeze parameter '%s': value is not finite.\n", fraktal_param_name(&f->params, i));
+                return false;
+            }
+            char literal[32];
+            snprintf(literal, sizeof(literal), "%.9g", x);
+            if (!strpbrk(literal, ".e"))
+                strcat(literal, ".0");
+            string_append(b, "%s", literal);
+        }
+    }
+    if (n > 1)
+        string_append(b, ")");
+    return true;
+}
+
+static bool is_frozen_param(fKernel *f, int i, const char **names, int count)
+{
+    if (!names)
+        return fraktal_param_command_type(f->params.type[i]) != FRAKTAL_CMD_USE_KERNEL;
+    for (int k = 0; k < count; k++)
+        if (strcmp(names[k], fraktal_param_name(&f->params, i)) == 0)
+            return true;
+    return false;
+}
+
+static const char *param_type_name(fParamType type)
+{
+    switch (type)
+    {
+        case FRAKTAL_PARAM_FLOAT: return "float";
+        case FRAKTAL_PARAM_FLOAT_VEC2: return "vec2";
+        case FRAKTAL_PARAM_FLOAT_VEC3: return "vec3";
+        case FRAKTAL_PARAM_FLOAT_VEC4: return "vec4";
+        case FRAKTAL_PARAM_FLOAT_MAT2: return "mat2";
+        case FRAKTAL_PARAM_FLOAT_MAT3: return "mat3";
+        case FRAKTAL_PARAM_FLOAT_MAT4: return "mat4";
+        case FRAKTAL_PARAM_INT: return "int";
+        case FRAKTAL_PARAM_INT_VEC2: return "ivec2";
+        case FRAKTAL_PARAM_INT_VEC3: return "ivec3";
+        case FRAKTAL_PARAM_INT_VEC4: return "ivec4";
+        case FRAKTAL_PARAM_SAMPLER1D: return "sampler1D";
+        case FRAKTAL_PARAM_SAMPLER2D: return "sampler2D";
+        default: return NULL;
+    }
+}
+
+// Rewrites 'source' of 'f' with the frozen parameters declared as
+// constants. Specialized parameters are declared by the linker rather
+// than the source (see write_specialized_declarations), so they are
+// declared again, on the first line so that line numbers still match.
+static char *freeze_source(fKernel *f, fKernelSource *source, const char **names, int count)
+{
+    fStringBuilder b = {0};
+    for (int i = source->param_begin; i < source->param_end; i++)
+    {
+        if (!f->params.specialize[i])
+            continue;
+        const char *name = fraktal_param_name(&f->params, i);
+        if (is_frozen_param(f, i, names, count))
+        {
+            string_append(&b, "const int %s = ", name);
+            if (!write_param_literal(&b, f, i))
+            {
+                free(b.data);
+                return NULL;
+            }
+            string_append(&b, "; ");
+        }
+        else
+        {
+            string_append(&b, "uniform int %s (specialize); ", name);
+        }
+    }
+    if (b.data)
+        string_append(&b, "\n#line 0\n");
+
+    enum { max_names = 1024 };
+    fTopLevelName *declared = (fTopLevelName*)malloc(max_names*sizeof(fTopLevelName));
+    fraktal_assert(declared && "Ran out of memory");
+    int num_declared = parse_top_level_names(source->data, declared, max_names);
+    const char *c = source->data;
+    for (int j = 0; j < num_declared; j++)
+    {
+        fTopLevelName *d = &declared[j];
+        if (d->kind != PARSE_TOP_LEVEL_UNIFORM)
+            continue;
+        int i = -1;
+        for (int k = source->param_begin; k < source->param_end && i < 0; k++)
+            if (strcmp(fraktal_param_name(&f->params, k), d->name) == 0)
+                i = k;
+        if (i < 0 || !is_frozen_param(f, i, names, count))
+            continue;
+
+        string_append(&b, "%.*s", (int)(d->begin - c), c);
+        string_append(&b, "const %s %s = ", param_type_name(f->params.type[i]), d->name);
+        if (!write_param_literal(&b, f, i))
+        {
+            free(declared);
+            free(b.data);
+            return NULL;
+        }
+        string_append(&b, ";");
+        for (c = d->begin; c < d->end; c++)
+            if (*c == '\n')
+                string_append(&b, "\n");
+    }
+    string_append(&b, "%s", c);
+    free(declared);
+    return b.data;
+}
+
+fKernel *fraktal_freeze_kernel(fKernel *f, const char **names, int count)
+{
+    fraktal_assert(f);
+    fraktal_assert((names || count == 0) && "'names' must be non-NULL if 'count' is non-zero.");
+    fraktal_ensure_context();
+    fraktal_check_gl_error();
+    if (count == 0)
+        names = NULL;
+    for (int k = 0; k < count; k++)
+    {
+        int i = 0;
+        while (i < f->params.count && strcmp(names[k], fraktal_param_name(&f->params, i)) != 0)
+            i++;
+        if (i == f->params.count)
+        {
+            log_err("Failed to freeze kernel: it has no parameter named '%s'.\n", names[k]);
+            return NULL;
+        }
+        if (fraktal_param_command_type(f->params.type[i]) == FRAKTAL_CMD_USE_KERNEL)
+        {
+            log_err("Failed to freeze kernel: parameter '%s' cannot be frozen.\n", names[k]);
+            return NULL;
+        }
+    }
+
+    fLinkState *link = create_link(false);
+    link->glsl_version = f->glsl_version;
+    for (int s = 0; s < f->num_sources; s++)
+    {
+        fKernelSource *source = &f->sources[s];
+        char *data = freeze_source(f, source, names, count);
+        bool result = data && add_link_data(link, data, source->name);
+        free(data);
+        if (!result)
+        {
+            log_err("Failed to freeze kernel\n");
+            fraktal_destroy_link(link);
+            return NULL;
+        }
+        if (source->epilogue)
+        {
+            link->epilogue = s;
+            link->sources[s].epilogue = true;
+        }
+    }
+
+    // The meta lists were erased from the sources when they were first
+    // parsed, so the parameters get their mean and scale from 'f'.
+    for (int i = 0; i < link->params.count; i++)
+    {
+        for (int j = 0; j < f->params.count; j++)
+        {
+            if (strcmp(fraktal_param_name(&link->params, i), fraktal_param_name(&f->params, j)) == 0)
+            {
+                link->params.mean[i] = f->params.mean[j];
+                link->params.scale[i] = f->params.scale[j];
+                break;
+            }
+        }
+    }
+
+    fKernel *frozen = fraktal_link_kernel(link);
+    fraktal_destroy_link(link);
+    fraktal_check_gl_error();
+    return frozen;
 }
@@ -2,49 +2,96 @@
 // See LICENSE.txt for copyright and licensing details (standard MIT License).
 
 #pragma once
+#include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
 #include <log.h>
 
-static const char *parse_error_start = NULL;
-static const char *parse_error_name = NULL;
+// Parsing functions that take an fParser advance its position 'c' and
+// report errors with the line and column in the source. All state lives
+// in the fParser, so that several sources can be parsed at once. The
+// scanning functions that take a 'const char **' have no state at all.
+struct fParser
+{
+    const char *c;     // current position
+    const char *begin; // start of the source
+    const char *name;  // name of the source (used in error messages)
+    int *lines;        // offset of each line start (built on the first error)
+    int num_lines;
+
+    bool inside_list;
+    bool list_first;
+    bool list_error;
+};
+
+static void parse_init(fParser *p, const char *source, const char *name)
+{
+    memset(p, 0, sizeof(fParser));
+    p->c = source;
+    p->begin = source;
+    p->name = name ? name : "unnamed";
+}
+
+static void parse_free(fParser *p)
+{
+    free(p->lines);
+    p->lines = NULL;
+    p->num_lines = 0;
+}
 
-static void parse_error(const char *at, const char *message)
+static void parse_error(fParser *p, const char *at, const char *message)
 {
-    assert(parse_error_start);
-    assert(parse_error_name);
-    const char *c = parse_error_start;
-    size_t line = 1;
-    size_t column = 0;
-    while (*c && c <= at)
+    if (!p->lines)
     {
-        if (c[0] == '\n')
+        int capacity = 64;
+        p->lines = (int*)malloc(capacity*sizeof(int));
+        fraktal_assert(p->lines && "Ran out of memory");
+        p->lines[p->num_lines++] = 0;
+        for (const char *c = p->begin; (c = strchr(c, '\n')) != NULL; )
         {
-            if (c[1] == '\r')
-                c++;
             c++;
-            line++;
-            column = 0;
-        }
-        else
-        {
-            c++;
-            column++;
+            if (p->num_lines == capacity)
+            {
+                capacity *= 2;
+                p->lines = (int*)realloc(p->lines, capacity*sizeof(int));
+                fraktal_assert(p->lines && "Ran out of memory");
+            }
+            p->lines[p->num_lines++] = (int)(c - p->begin);
         }
     }
-    log_err("<%s>: line %d: col %d: error: %s", parse_error_name, line, column, message);
+
+    // find the last line that starts at or before 'at'
+    int offset = (int)(at - p->begin);
+    int lo = 0;
+    int hi = p->num_lines - 1;
+    while (lo < hi)
+    {
+        int mid = (lo + hi + 1)/2;
+        if (p->lines[mid] <= offset) lo = mid;
+        else hi = mid - 1;
+    }
+    int line = lo + 1;
+    int column = offset - p->lines[lo] + 1;
+    log_err("<%s>: line %d: col %d: error: %s", p->name, line, column, message);
 }
 
+// Characters that can be part of an identifier (or a number)
 static bool parse_is_alpha(char c)
 {
     return (c >= 'a' && c <= 'z') ||
            (c >= 'A' && c <= 'Z') ||
-           (c >= '0' && c <= '9');
+           (c >= '0' && c <= '9') ||
+           c == '_';
+}
+
+static bool parse_is_digit(char c)
+{
+    return c >= '0' && c <= '9';
 }
 
 static void parse_alpha(const char **c)
 {
-    while (**c && parse_is_alpha(**c))
+    while (parse_is_alpha(**c))
         (*c)++;
 }
 
@@ -64,36 +111,36 @@ static bool parse_blank(const char **c)
 
 static bool parse_comment(const char **c)
 {
-    char c0 = (*c)[0];
-    char c1 = (*c)[1];
-    if (c0 && c1 && c0 == '/' && c1 == '/')
+    const char *s = *c;
+    if (s[0] != '/')
+        return false;
+    if (s[1] == '/')
     {
-        while (**c && **c != '\n' && **c != '\r')
-            (*c)++;
-        while (**c && (**c == '\n' || **c == '\r'))
-            (*c)++;
+        s += 2;
+        while (*s && *s != '\n' && *s != '\r')
+            s++;
+        while (*s == '\n' || *s == '\r')
+            s++;
+        *c = s;
         return true;
     }
-    else if (c0 && c1 && c0 == '/' && c1 == '*')
+    else if (s[1] == '*')
     {
-        while ((*c)[0] && (*c)[1] && !((*c)[0] == '*' && (*c)[1] == '/'))
-            (*c)++;
-        (*c) += 2;
+        const char *end = strstr(s + 2, "*/");
+        *c = end ? end + 2 : s + strlen(s);
         return true;
     }
-    else
-    {
-        return false;
-    }
+    return false;
 }
 
-static bool parse_notalpha(const char **c)
+// Replaces the text in [begin, end) with spaces, keeping line breaks
+// so that line numbers in compiler errors still match the input. The
+// text must lie inside the (writable) buffer given to parse_fraktal_source.
+static void parse_erase(const char *begin, const char *end)
 {
-    if (parse_is_alpha(**c))
-        return false;
-    while (**c && !parse_is_alpha(**c))
-        (*c)++;
-    return true;
+    for (char *c = (char*)begin; c < end; c++)
+        if (*c != '\n' && *c != '\r')
+            *c = ' ';
 }
 
 static bool parse_char(const char **c, char match)
@@ -107,13 +154,6 @@ static bool parse_char(const char **c, char match)
         return false;
 }
 
-static bool parse_next(const char **c)
-{
-    while (parse_comment(c) || parse_blank(c) || parse_notalpha(c))
-        ;
-    return (**c) != '\0';
-}
-
 static bool parse_match(const char **c, const char *match)
 {
     const char *a = *c;
@@ -134,232 +174,285 @@ static bool parse_match(const char **c, const char *match)
     return false;
 }
 
-static bool parse_bool(const char **c, bool *x)
+static bool parse_bool(fParser *p, bool *x)
 {
-    if (parse_match(c, "true"))       *x = true;
-    else if (parse_match(c, "True"))  *x = true;
-    else if (parse_match(c, "false")) *x = false;
-    else if (parse_match(c, "False")) *x = false;
-    else                              return false;
+    if (parse_match(&p->c, "true"))       *x = true;
+    else if (parse_match(&p->c, "True"))  *x = true;
+    else if (parse_match(&p->c, "false")) *x = false;
+    else if (parse_match(&p->c, "False")) *x = false;
+    else                                  return false;
     return true;
 }
 
-static bool parse_int(const char **c, int *x)
+// Parses a decimal number, with an optional sign, fraction and exponent
+// (leading blanks are skipped). Unlike sscanf, this does not depend on
+// the locale (which can change the decimal separator).
+static bool parse_number(const char **c, double *x)
 {
-    int b;
-    int _x;
-    if (1 == sscanf(*c, "%d%n", &_x, &b))
+    static const double powers_of_10[] =
     {
-        *c = *c + b;
-        *x = _x;
-        return true;
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+        1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22
+    };
+    const char *s = *c;
+    while (parse_is_blank(*s))
+        s++;
+    bool negative = false;
+    if (*s == '-' || *s == '+')
+        negative = *(s++) == '-';
+
+    double mantissa = 0.0;
+    int digits = 0;
+    int exponent = 0;
+    for (; parse_is_digit(*s); s++, digits++)
+        mantissa = mantissa*10.0 + (*s - '0');
+    if (*s == '.')
+    {
+        for (s++; parse_is_digit(*s); s++, digits++, exponent--)
+            mantissa = mantissa*10.0 + (*s - '0');
     }
-    return false;
+    if (digits == 0)
+        return false;
+    if (*s == 'e' || *s == 'E')
+    {
+        const char *e = s + 1;
+        bool negative_exponent = false;
+        if (*e == '-' || *e == '+')
+            negative_exponent = *(e++) == '-';
+        if (parse_is_digit(*e))
+        {
+            int n = 0;
+            for (; parse_is_digit(*e); e++)
+                if (n < 10000)
+                    n = n*10 + (*e - '0');
+            exponent += negative_exponent ? -n : n;
+            s = e;
+        }
+    }
+
+    double value = mantissa;
+    int n = exponent < 0 ? -exponent : exponent;
+    double scale = 1.0;
+    for (; n > 22; n -= 22)
+        scale *= powers_of_10[22];
+    scale *= powers_of_10[n];
+    value = exponent < 0 ? value/scale : value*scale;
+    *x = negative ? -value : value;
+    *c = s;
+    return true;
 }
 
-static bool parse_float(const char **c, float *x)
+static bool parse_int(fParser *p, int *x)
 {
-    int b;
-    float _x;
-    if (1 == sscanf(*c, "%f%n", &_x, &b))
-    {
-        *c = *c + b;
-        *x = _x;
-        return true;
-    }
-    return false;
+    const char *s = p->c;
+    while (parse_is_blank(*s))
+        s++;
+    bool negative = false;
+    if (*s == '-' || *s == '+')
+        negative = *(s++) == '-';
+    if (!parse_is_digit(*s))
+        return false;
+    int value = 0;
+    for (; parse_is_digit(*s); s++)
+        value = value*10 + (*s - '0');
+    *x = negative ? -value : value;
+    p->c = s;
+    return true;
 }
 
-static bool parse_angle(const char **c, float *x)
+static bool parse_float(fParser *p, float *x)
 {
-    int b;
-    float _x;
-    if (1 == sscanf(*c, "%f%n", &_x, &b))
+    double value;
+    if (!parse_number(&p->c, &value))
+        return false;
+    *x = (float)value;
+    return true;
+}
+
+static bool parse_angle(fParser *p, float *x)
+{
+    float value;
+    if (parse_float(p, &value))
     {
-        *c = *c + b;
-        parse_blank(c);
-        if (parse_match(c, "deg"))
+        parse_blank(&p->c);
+        if (parse_match(&p->c, "deg"))
         {
-            *x = _x;
+            *x = value;
             return true;
         }
-        else if (parse_match(c, "rad"))
+        else if (parse_match(&p->c, "rad"))
         {
-            *x = _x*(180.0f/3.1415926535897932384626433832795f);
+            *x = value*(180.0f/3.1415926535897932384626433832795f);
             return true;
         }
-        else parse_error(*c, "Error parsing angle: must have either 'deg' or 'rad' as suffix.\n");
+        else parse_error(p, p->c, "Error parsing angle: must have either 'deg' or 'rad' as suffix.\n");
     }
     return false;
 }
 
 // len: does not include zero-terminator
-static bool parse_string(const char **c, const char **v, size_t *len)
+static bool parse_string(fParser *p, const char **v, size_t *len)
 {
     char delimiter = '\0';
-    if (parse_char(c, '\"'))
+    if (parse_char(&p->c, '\"'))
         delimiter = '\"';
-    else if (parse_char(c, '\''))
+    else if (parse_char(&p->c, '\''))
         delimiter = '\'';
     else
     {
-        parse_error(*c, "Error parsing string: must begin with single or double quotation.\n");
+        parse_error(p, p->c, "Error parsing string: must begin with single or double quotation.\n");
         return false;
     }
 
-    *v = *c;
-    while (**c && **c != delimiter)
-        (*c)++;
-    if (**c == '\0')
+    *v = p->c;
+    const char *end = strchr(p->c, delimiter);
+    if (!end)
     {
-        parse_error(*c, "Error parsing string: missing end quotation.\n");
+        p->c += strlen(p->c);
+        parse_error(p, p->c, "Error parsing string: missing end quotation.\n");
         return false;
     }
-    *len = *c - *v;
-    (*c)++;
+    *len = end - *v;
+    p->c = end + 1;
     return true;
 }
 
-static bool parse_int2(const char **c, int2 *v)
+static bool parse_int2(fParser *p, int2 *v)
 {
-    if (!parse_char(c, '('))  { parse_error(*c, "integer tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_int(c, &v->x)) { parse_error(*c, "1st tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ','))  { parse_error(*c, "integer tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_int(c, &v->y)) { parse_error(*c, "2nd tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ')'))  { parse_error(*c, "integer tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))  { parse_error(p, p->c, "integer tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_int(p, &v->x))     { parse_error(p, p->c, "1st tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "integer tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_int(p, &v->y))     { parse_error(p, p->c, "2nd tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ')'))  { parse_error(p, p->c, "integer tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_int3(const char **c, int3 *v)
+static bool parse_int3(fParser *p, int3 *v)
 {
-    if (!parse_char(c, '('))  { parse_error(*c, "integer tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_int(c, &v->x)) { parse_error(*c, "1st tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ','))  { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_int(c, &v->y)) { parse_error(*c, "2nd tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ','))  { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_int(c, &v->z)) { parse_error(*c, "3rd tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ')'))  { parse_error(*c, "integer tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))  { parse_error(p, p->c, "integer tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_int(p, &v->x))     { parse_error(p, p->c, "1st tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_int(p, &v->y))     { parse_error(p, p->c, "2nd tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_int(p, &v->z))     { parse_error(p, p->c, "3rd tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ')'))  { parse_error(p, p->c, "integer tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_int4(const char **c, int4 *v)
+static bool parse_int4(fParser *p, int4 *v)
 {
-    if (!parse_char(c, '('))  { parse_error(*c, "integer tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_int(c, &v->x)) { parse_error(*c, "1st tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ','))  { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_int(c, &v->y)) { parse_error(*c, "2nd tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ','))  { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_int(c, &v->z)) { parse_error(*c, "3rd tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ','))  { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_int(c, &v->w)) { parse_error(*c, "4th tuple component must be an integer.\n"); return false; }
-    if (!parse_char(c, ')'))  { parse_error(*c, "integer tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))  { parse_error(p, p->c, "integer tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_int(p, &v->x))     { parse_error(p, p->c, "1st tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_int(p, &v->y))     { parse_error(p, p->c, "2nd tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_int(p, &v->z))     { parse_error(p, p->c, "3rd tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_int(p, &v->w))     { parse_error(p, p->c, "4th tuple component must be an integer.\n"); return false; }
+    if (!parse_char(&p->c, ')'))  { parse_error(p, p->c, "integer tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_angle2(const char **c, angle2 *v)
+static bool parse_angle2(fParser *p, angle2 *v)
 {
-    if (!parse_char(c, '('))        { parse_error(*c, "angle tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_angle(c, &v->theta)) { parse_error(*c, "1st tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))        { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_angle(c, &v->phi))   { parse_error(*c, "2nd tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ')'))        { parse_error(*c, "angle tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))    { parse_error(p, p->c, "angle tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_angle(p, &v->theta)) { parse_error(p, p->c, "1st tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))    { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_angle(p, &v->phi))   { parse_error(p, p->c, "2nd tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ')'))    { parse_error(p, p->c, "angle tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_float2(const char **c, float2 *v)
+static bool parse_float2(fParser *p, float2 *v)
 {
-    if (!parse_char(c, '('))    { parse_error(*c, "tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_float(c, &v->x)) { parse_error(*c, "1st tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))    { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_float(c, &v->y)) { parse_error(*c, "2nd tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ')'))    { parse_error(*c, "tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))  { parse_error(p, p->c, "tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_float(p, &v->x))   { parse_error(p, p->c, "1st tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_float(p, &v->y))   { parse_error(p, p->c, "2nd tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ')'))  { parse_error(p, p->c, "tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_float3(const char **c, float3 *v)
+static bool parse_float3(fParser *p, float3 *v)
 {
-    if (!parse_char(c, '('))    { parse_error(*c, "tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_float(c, &v->x)) { parse_error(*c, "1st tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))    { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_float(c, &v->y)) { parse_error(*c, "2nd tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))    { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_float(c, &v->z)) { parse_error(*c, "3rd tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ')'))    { parse_error(*c, "tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))  { parse_error(p, p->c, "tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_float(p, &v->x))   { parse_error(p, p->c, "1st tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_float(p, &v->y))   { parse_error(p, p->c, "2nd tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_float(p, &v->z))   { parse_error(p, p->c, "3rd tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ')'))  { parse_error(p, p->c, "tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_float4(const char **c, float4 *v)
+static bool parse_float4(fParser *p, float4 *v)
 {
-    if (!parse_char(c, '('))    { parse_error(*c, "tuple must begin with parenthesis.\n"); return false; }
-    if (!parse_float(c, &v->x)) { parse_error(*c, "1st tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))    { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_float(c, &v->y)) { parse_error(*c, "2nd tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))    { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_float(c, &v->z)) { parse_error(*c, "3rd tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ','))    { parse_error(*c, "tuple components must be seperated by ','.\n"); return false; }
-    if (!parse_float(c, &v->w)) { parse_error(*c, "4th tuple component must be a number.\n"); return false; }
-    if (!parse_char(c, ')'))    { parse_error(*c, "tuple must end with parenthesis.\n"); return false; }
+    if (!parse_char(&p->c, '('))  { parse_error(p, p->c, "tuple must begin with parenthesis.\n"); return false; }
+    if (!parse_float(p, &v->x))   { parse_error(p, p->c, "1st tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_float(p, &v->y))   { parse_error(p, p->c, "2nd tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_float(p, &v->z))   { parse_error(p, p->c, "3rd tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ','))  { parse_error(p, p->c, "tuple components must be seperated by ','.\n"); return false; }
+    if (!parse_float(p, &v->w))   { parse_error(p, p->c, "4th tuple component must be a number.\n"); return false; }
+    if (!parse_char(&p->c, ')'))  { parse_error(p, p->c, "tuple must end with parenthesis.\n"); return false; }
     return true;
 }
 
-static bool parse_inside_list = false;
-static bool parse_list_first = false;
-static bool parse_list_error = false;
-
-static bool parse_begin_list(const char **c)
+static bool parse_begin_list(fParser *p)
 {
-    if (**c == '(')
+    if (*p->c == '(')
     {
-        *c = *c + 1;
-        parse_inside_list = true;
-        parse_list_first = true;
-        parse_list_error = false;
+        p->c++;
+        p->inside_list = true;
+        p->list_first = true;
+        p->list_error = false;
         return true;
     }
     return false;
 }
 
-static bool parse_next_in_list(const char **c)
+static bool parse_next_in_list(fParser *p)
 {
-    assert(parse_inside_list);
-    if (parse_list_error)
+    assert(p->inside_list);
+    if (p->list_error)
     {
-        parse_error(*c, "unexpected argument.\n");
+        parse_error(p, p->c, "unexpected argument.\n");
         return false;
     }
-    parse_blank(c);
-    if (parse_char(c, ')'))
+    parse_blank(&p->c);
+    if (parse_char(&p->c, ')'))
         return false;
-    if (!parse_list_first)
-        if (!parse_char(c, ',')) { parse_error(*c, "arguments must be seperated by ','.\n"); return false; }
-    parse_blank(c);
-    parse_list_first = false;
+    if (!p->list_first)
+        if (!parse_char(&p->c, ',')) { parse_error(p, p->c, "arguments must be seperated by ','.\n"); return false; }
+    parse_blank(&p->c);
+    p->list_first = false;
     return true;
 }
 
-static bool parse_end_list(const char **c)
+static bool parse_end_list(fParser *p)
 {
-    assert(parse_inside_list);
-    parse_inside_list = false;
-    if (parse_list_error)
+    assert(p->inside_list);
+    p->inside_list = false;
+    if (p->list_error)
         return false;
     return true;
 }
 
-static void parse_list_unexpected()
+static void parse_list_unexpected(fParser *p)
 {
-    parse_list_error = true;
+    p->list_error = true;
 }
 
 #define declare_parse_argument_(type) \
-    static bool parse_argument_##type(const char **c, const char *name, type *v) \
+    static bool parse_argument_##type(fParser *p, const char *name, type *v) \
     { \
-        if (parse_match(c, name)) \
+        if (parse_match(&p->c, name)) \
         { \
-            parse_blank(c); \
-            if (!parse_char(c, '=')) { parse_error(*c, "expected '=' between argument name and value.\n"); return false; } \
-            parse_blank(c); \
-            if (!parse_##type(c, v)) { parse_error(*c, "unexpected expression after '='.\n"); return false; } \
+            parse_blank(&p->c); \
+            if (!parse_char(&p->c, '=')) { parse_error(p, p->c, "expected '=' between argument name and value.\n"); return false; } \
+            parse_blank(&p->c); \
+            if (!parse_##type(p, v)) { parse_error(p, p->c, "unexpected expression after '='.\n"); return false; } \
             return true; \
         } \
         return false; \
@@ -377,29 +470,29 @@ declare_parse_argument_(float2);
 declare_parse_argument_(float3);
 declare_parse_argument_(float4);
 
-static bool parse_argument_string(const char **c, const char *name, const char **v, size_t *len, size_t max_len=0)
+static bool parse_argument_string(fParser *p, const char *name, const char **v, size_t *len, size_t max_len=0)
 {
-    if (parse_match(c, name))
+    if (parse_match(&p->c, name))
     {
-        parse_blank(c);
-        if (!parse_char(c, '=')) { parse_error(*c, "Error parsing argument: expected '=' between identifier and value.\n"); return false; }
-        if (!parse_string(c, v, len)) { parse_error(*c, "Error parsing argument value: unexpected type after '='.\n"); return false; }
-        if (max_len && *len > max_len) { parse_error(*c, "Error parsing string argument: string exceeded maximum length.\n"); return false; }
+        parse_blank(&p->c);
+        if (!parse_char(&p->c, '=')) { parse_error(p, p->c, "Error parsing argument: expected '=' between identifier and value.\n"); return false; }
+        if (!parse_string(p, v, len)) { parse_error(p, p->c, "Error parsing argument value: unexpected type after '='.\n"); return false; }
+        if (max_len && *len > max_len) { parse_error(p, p->c, "Error parsing string argument: string exceeded maximum length.\n"); return false; }
         return true;
     }
     return false;
 }
 
-static bool parse_argument_nstring(const char **c, const char *name, char *dst, size_t sizeof_dst)
+static bool parse_argument_nstring(fParser *p, const char *name, char *dst, size_t sizeof_dst)
 {
-    if (parse_match(c, name))
+    if (parse_match(&p->c, name))
     {
-        parse_blank(c);
+        parse_blank(&p->c);
         const char *v = NULL;
         size_t len = 0;
-        if (!parse_char(c, '=')) { parse_error(*c, "Error parsing argument: expected '=' between identifier and value.\n"); return false; }
-        if (!parse_string(c, &v, &len)) { parse_error(*c, "Error parsing argument value: unexpected type after '='.\n"); return false; }
-        if (len + 1 > sizeof_dst) { parse_error(*c, "Error parsing string argument: string exceeded maximum length.\n"); return false; }
+        if (!parse_char(&p->c, '=')) { parse_error(p, p->c, "Error parsing argument: expected '=' between identifier and value.\n"); return false; }
+        if (!parse_string(p, &v, &len)) { parse_error(p, p->c, "Error parsing argument value: unexpected type after '='.\n"); return false; }
+        if (len + 1 > sizeof_dst) { parse_error(p, p->c, "Error parsing string argument: string exceeded maximum length.\n"); return false; }
         memcpy(dst, v, len);
         dst[len] = '\0';
         return true;
@@ -407,36 +500,43 @@ static bool parse_argument_nstring(const char **c, const char *name, char *dst,
     return false;
 }
 
-static bool parse_param_meta(const char **c, fParams *p, int param)
+static bool parse_param_meta(fParser *p, fParams *params, int param)
 {
-    fParamType type = p->type[param];
-    while (parse_next_in_list(c)) {
+    fParamType type = params->type[param];
+    while (parse_next_in_list(p)) {
+        // A matrix has one mean and scale for all of its elements
         if (type == FRAKTAL_PARAM_FLOAT ||
+            type == FRAKTAL_PARAM_FLOAT_MAT4 ||
             type == FRAKTAL_PARAM_INT)
         {
-            if (parse_argument_float(c, "mean", (float*)&p->mean[param])) continue;
-            else if (parse_argument_float(c, "scale", (float*)&p->scale[param])) continue;
+            if (parse_argument_float(p, "mean", (float*)&params->mean[param])) continue;
+            else if (parse_argument_float(p, "scale", (float*)&params->scale[param])) continue;
+        }
+
+        if (type == FRAKTAL_PARAM_INT)
+        {
+            if (parse_match(&p->c, "specialize")) { params->specialize[param] = true; continue; }
         }
 
         if (type == FRAKTAL_PARAM_FLOAT_VEC2 ||
             type == FRAKTAL_PARAM_INT_VEC2)
         {
-            if (parse_argument_float2(c, "mean", (float2*)&p->mean[param])) continue;
-            else if (parse_argument_float2(c, "scale", (float2*)&p->scale[param])) continue;
+            if (parse_argument_float2(p, "mean", (float2*)&params->mean[param])) continue;
+            else if (parse_argument_float2(p, "scale", (float2*)&params->scale[param])) continue;
         }
 
         if (type == FRAKTAL_PARAM_FLOAT_VEC3 ||
             type == FRAKTAL_PARAM_INT_VEC3)
         {
-            if (parse_argument_float3(c, "mean", (float3*)&p->mean[param])) continue;
-            else if (parse_argument_float3(c, "scale", (float3*)&p->scale[param])) continue;
+            if (parse_argument_float3(p, "mean", (float3*)&params->mean[param])) continue;
+            else if (parse_argument_float3(p, "scale", (float3*)&params->scale[param])) continue;
         }
 
         if (type == FRAKTAL_PARAM_FLOAT_VEC4 ||
             type == FRAKTAL_PARAM_INT_VEC4)
         {
-            if (parse_argument_float4(c, "mean", (float4*)&p->mean[param])) continue;
-            else if (parse_argument_float4(c, "scale", (float4*)&p->scale[param])) continue;
+            if (parse_argument_float4(p, "mean", (float4*)&params->mean[param])) continue;
+            else if (parse_argument_float4(p, "scale", (float4*)&params->scale[param])) continue;
         }
 
         if (type == FRAKTAL_PARAM_SAMPLER1D ||
@@ -444,37 +544,36 @@ static bool parse_param_meta(const char **c, fParams *p, int param)
         {
             const char *v = NULL;
             size_t len = 0;
-            if (parse_argument_string(c, "file", &v, &len))
+            if (parse_argument_string(p, "file", &v, &len))
             {
                 printf("texture path!\n");
                 continue;
             }
         }
 
-        parse_list_unexpected();
+        parse_list_unexpected(p);
     }
 
-    if (!parse_end_list(c))
+    if (!parse_end_list(p))
     {
-        parse_error(*c, "invalid parameter meta arguments.\n");
+        parse_error(p, p->c, "invalid parameter meta arguments.\n");
         return false;
     }
     return true;
 }
 
-static bool parse_param(const char **c, fParams *p, int param)
+// Parses a parameter declaration after the 'uniform' keyword.
+static bool parse_param(fParser *p, fParams *params, int param)
 {
-    if (param >= FRAKTAL_MAX_PARAMS)
-    {
-        parse_error(*c, "exceeded maximum number of parameters in kernel.\n");
-        return false;
-    }
+    fraktal_reserve_params(params, param + 1);
+    params->vector_index[param] = -1; // see fraktal_compute_param_vector
 
     // Get type
     int base_alignment = 0;
     int type_size = 0;
     {
         fParamType type;
+        const char **c = &p->c;
         parse_blank(c);
         if      (parse_match(c, "float"))     { type = FRAKTAL_PARAM_FLOAT;      type_size = 1;  base_alignment = 1; }
         else if (parse_match(c, "vec2"))      { type = FRAKTAL_PARAM_FLOAT_VEC2; type_size = 2;  base_alignment = 2; }
@@ -487,14 +586,14 @@ static bool parse_param(const char **c, fParams *p, int param)
         else if (parse_match(c, "ivec2"))     { type = FRAKTAL_PARAM_INT_VEC2;   type_size = 2; base_alignment = 2; }
         else if (parse_match(c, "ivec3"))     { type = FRAKTAL_PARAM_INT_VEC3;   type_size = 4; base_alignment = 4; }
         else if (parse_match(c, "ivec4"))     { type = FRAKTAL_PARAM_INT_VEC4;   type_size = 4; base_alignment = 4; }
-        else if (parse_match(c, "sampler1D")) { type = FRAKTAL_PARAM_SAMPLER1D; p->assigned_tex_unit[param] = p->sampler_count++; }
-        else if (parse_match(c, "sampler2D")) { type = FRAKTAL_PARAM_SAMPLER2D; p->assigned_tex_unit[param] = p->sampler_count++; }
+        else if (parse_match(c, "sampler1D")) { type = FRAKTAL_PARAM_SAMPLER1D; params->assigned_tex_unit[param] = params->sampler_count++; }
+        else if (parse_match(c, "sampler2D")) { type = FRAKTAL_PARAM_SAMPLER2D; params->assigned_tex_unit[param] = params->sampler_count++; }
         else
         {
-            parse_error(*c, "invalid parameter type.\n");
+            parse_error(p, p->c, "invalid parameter type.\n");
             return false;
         }
-        p->type[param] = type;
+        params->type[param] = type;
     }
 
     // Calculate std140 buffer alignment
@@ -503,8 +602,8 @@ static bool parse_param(const char **c, fParams *p, int param)
         int prev_size = 0;
         if (param > 0)
         {
-            prev_offset = p->std140_offset[param - 1];
-            prev_size = p->std140_size[param - 1];
+            prev_offset = params->std140_offset[param - 1];
+            prev_size = params->std140_size[param - 1];
         }
         if (type_size > 0)
         {
@@ -512,95 +611,219 @@ static bool parse_param(const char **c, fParams *p, int param)
             offset += prev_size;
             if (base_alignment > 1)
                 offset += base_alignment - (offset % base_alignment);
-            p->std140_offset[param] = offset;
-            p->std140_size[param] = type_size;
+            params->std140_offset[param] = offset;
+            params->std140_size[param] = type_size;
         }
         else
         {
-            p->std140_offset[param] = prev_offset;
-            p->std140_size[param] = 0;
+            params->std140_offset[param] = prev_offset;
+            params->std140_size[param] = 0;
         }
     }
 
     // Get name
     {
-        const char *name_start;
-        size_t name_len;
-        parse_blank(c);
-        name_start = *c;
-        parse_alpha(c);
-        const char *name_end = *c;
+        parse_blank(&p->c);
+        const char *name_start = p->c;
+        parse_alpha(&p->c);
+        const char *name_end = p->c;
         if (name_start == name_end)
         {
-            parse_error(*c, "missing parameter name\n");
+            parse_error(p, p->c, "missing parameter name\n");
             return false;
         }
-        if (**c == '\0')
+        if (*p->c == '\0')
         {
-            parse_error(name_start, "file ends prematurely after this parameter.\n");
+            parse_error(p, name_start, "file ends prematurely after this parameter.\n");
             return false;
         }
-        name_len = name_end - name_start;
+        size_t name_len = name_end - name_start;
         if (name_len > FRAKTAL_MAX_PARAM_NAME_LEN)
         {
-            parse_error(*c, "parameter name is too long.\n");
+            parse_error(p, p->c, "parameter name is too long.\n");
             return false;
         }
-        memcpy(p->name[param], name_start, name_len);
-        p->name[param][name_len] = '\0';
+        params->name[param] = fraktal_intern_param_name(params, name_start, name_len);
     }
 
     // Get meta
-    parse_blank(c);
-    if (parse_begin_list(c))
+    parse_blank(&p->c);
+    params->specialize[param] = false;
+    const char *meta_start = p->c;
+    if (parse_begin_list(p))
     {
-        if (!parse_param_meta(c, p, param))
+        if (!parse_param_meta(p, params, param))
             return false;
+
+        // The meta list is not valid GLSL
+        parse_erase(meta_start, p->c);
     }
     else
     {
-        p->mean[param].x = 0.0f;
-        p->mean[param].y = 0.0f;
-        p->mean[param].z = 0.0f;
-        p->mean[param].w = 0.0f;
-        p->scale[param].x = 1.0f;
-        p->scale[param].y = 1.0f;
-        p->scale[param].z = 1.0f;
-        p->scale[param].w = 1.0f;
+        params->mean[param].x = 0.0f;
+        params->mean[param].y = 0.0f;
+        params->mean[param].z = 0.0f;
+        params->mean[param].w = 0.0f;
+        params->scale[param].x = 1.0f;
+        params->scale[param].y = 1.0f;
+        params->scale[param].z = 1.0f;
+        params->scale[param].w = 1.0f;
     }
 
-    if (!parse_char(c, ';'))
+    if (!parse_char(&p->c, ';'))
     {
-        parse_error(*c, "unexpected symbol after parameter name.\n");
+        parse_error(p, p->c, "unexpected symbol after parameter name.\n");
         return false;
     }
 
     return true;
 }
 
-static bool parse_fraktal_source(char *fs, fParams *p, const char *name)
+// Finds the parameter declarations in 'fs' in a single pass, where
+// comments, numbers and identifiers are skipped as whole tokens.
+static bool parse_fraktal_source(char *fs, fParams *params, const char *name)
+{
+    fParser p;
+    parse_init(&p, fs, name);
+    bool result = true;
+    while (*p.c)
+    {
+        char ch = *p.c;
+        if (ch == '/' && (p.c[1] == '/' || p.c[1] == '*'))
+        {
+            parse_comment(&p.c);
+        }
+        else if (parse_is_alpha(ch))
+        {
+            const char *declaration_start = p.c;
+            parse_alpha(&p.c);
+            if (p.c - declaration_start == 7 && memcmp(declaration_start, "uniform", 7) == 0)
+            {
+                int param = params->count;
+                if (!parse_param(&p, params, param))
+                {
+                    result = false;
+                    break;
+                }
+
+                // Specialized parameters are declared by the linker
+                // instead (either as a uniform or as a constant).
+                if (params->specialize[param])
+                    parse_erase(declaration_start, p.c);
+
+                params->count++;
+            }
+        }
+        else
+        {
+            p.c++;
+        }
+    }
+    parse_free(&p);
+    return result;
+}
+
+// Finds the next '#include "path"' directive at or after 'c' that is not
+// inside a comment, and returns a pointer to its '#', or NULL if there is
+// none. 'path' and 'path_len' are set to the path between the quotes.
+static const char *parse_next_include(const char *c, const char **path, size_t *path_len)
+{
+    bool line_start = true;
+    while (*c)
+    {
+        if (c[0] == '/' && c[1] == '/')
+        {
+            parse_comment(&c);
+            line_start = true;
+        }
+        else if (c[0] == '/' && c[1] == '*')
+        {
+            parse_comment(&c);
+        }
+        else if (*c == '\n')
+        {
+            line_start = true;
+            c++;
+        }
+        else if (*c == ' ' || *c == '\t' || *c == '\r')
+        {
+            c++;
+        }
+        else if (line_start && *c == '#')
+        {
+            const char *directive = c++;
+            while (*c == ' ' || *c == '\t')
+                c++;
+            if (parse_match(&c, "include"))
+            {
+                while (*c == ' ' || *c == '\t')
+                    c++;
+                if (*c == '"')
+                {
+                    const char *end = c + 1;
+                    while (*end && *end != '"' && *end != '\n' && *end != '\r')
+                        end++;
+                    if (*end == '"' && end > c + 1)
+                    {
+                        *path = c + 1;
+                        *path_len = end - (c + 1);
+                        return directive;
+                    }
+                }
+            }
+            line_start = false;
+        }
+        else
+        {
+            line_start = false;
+            c++;
+        }
+    }
+    return NULL;
+}
+
+static bool parse_identifier(const char **c, char *dst, size_t sizeof_dst)
+{
+    const char *start = *c;
+    while (**c && (parse_is_alpha(**c) || **c == '_'))
+        (*c)++;
+    size_t len = *c - start;
+    if (len == 0 || len + 1 > sizeof_dst)
+        return false;
+    memcpy(dst, start, len);
+    dst[len] = '\0';
+    return true;
+}
+
+// Finds the first output variable declaration (out <type> <name>;) and
+// erases its 'out' qualifier, turning it into a global variable.
+static bool parse_fragment_output(char *fs, char *type, size_t sizeof_type, char *name, size_t sizeof_name)
 {
-    parse_error_start = fs;
-    parse_error_name = name;
     char *cw = fs;
     while (*cw)
     {
         const char **c = (const char**)&cw;
         parse_comment(c);
         parse_blank(c);
-        if (parse_is_alpha(**c))
+        if (parse_is_alpha(**c) || **c == '_')
         {
-            if (parse_match(c, "uniform"))
+            const char *start = *c;
+            if (start[3] != '_' && parse_match(c, "out"))
             {
-                int param = p->count;
-                if (!parse_param(c, p, param))
-                    return false;
-
-                p->count++;
+                parse_blank(c);
+                if (!parse_identifier(c, type, sizeof_type)) continue;
+                parse_blank(c);
+                if (!parse_identifier(c, name, sizeof_name)) continue;
+                parse_blank(c);
+                if (**c != ';') continue;
+                parse_erase(start, start + 3);
+                return true;
             }
             else
             {
-                parse_alpha(c);
+                char skip[256];
+                if (!parse_identifier(c, skip, sizeof(skip)))
+                    cw++;
             }
         }
         else
@@ -608,5 +831,313 @@ static bool parse_fraktal_source(char *fs, fParams *p, const char *name)
             cw++;
         }
     }
-    return true;
+    return false;
+}
+
+typedef int fTopLevelKind;
+enum fTopLevelKind_
+{
+    PARSE_TOP_LEVEL_DEFINITION, // function, global variable or struct
+    PARSE_TOP_LEVEL_MACRO,      // #define
+    PARSE_TOP_LEVEL_UNIFORM,
+};
+struct fTopLevelName
+{
+    fTopLevelKind kind;
+    char name[FRAKTAL_MAX_PARAM_NAME_LEN + 1];
+    const char *begin; // the declaration (uniforms only)
+    const char *end;
+};
+
+static bool parse_is_qualifier(const char *s)
+{
+    return strcmp(s, "uniform") == 0 || strcmp(s, "in") == 0 ||
+           strcmp(s, "out") == 0 || strcmp(s, "layout") == 0 ||
+           strcmp(s, "flat") == 0 || strcmp(s, "smooth") == 0 ||
+           strcmp(s, "precision") == 0 || strcmp(s, "struct") == 0;
+}
+
+static void parse_add_top_level_name(fTopLevelName *names, int *count, int max_count, fTopLevelKind kind, const char *name)
+{
+    for (int i = 0; i < *count; i++)
+        if (names[i].kind == kind && strcmp(names[i].name, name) == 0)
+            return;
+    if (*count == max_count)
+        return;
+    fTopLevelName *n = &names[(*count)++];
+    n->kind = kind;
+    strcpy(n->name, name);
+    n->begin = NULL;
+    n->end = NULL;
+}
+
+// Finds the names that a source declares at global scope: functions,
+// global variables and structs, macros, and uniforms (with the range of
+// their declaration). Returns the number of names found.
+static int parse_top_level_names(const char *fs, fTopLevelName *names, int max_count)
+{
+    int count = 0;
+    int depth = 0;  // braces
+    int parens = 0;
+    int idents = 0; // identifiers so far in the current global statement
+    bool initializer = false;
+    bool line_start = true;
+    const char *statement = NULL;
+    char first[FRAKTAL_MAX_PARAM_NAME_LEN + 1] = {0};
+    char last[FRAKTAL_MAX_PARAM_NAME_LEN + 1] = {0};
+    const char *c = fs;
+    while (*c)
+    {
+        if (parse_comment(&c))
+        {
+            line_start = c[-1] == '\n' || c[-1] == '\r';
+            continue;
+        }
+        char ch = *c;
+        if (ch == '\n' || ch == '\r')
+        {
+            line_start = true;
+            c++;
+            continue;
+        }
+        if (ch == ' ' || ch == '\t')
+        {
+            c++;
+            continue;
+        }
+        if (ch == '#' && line_start)
+        {
+            c++;
+            parse_blank(&c);
+            if (parse_match(&c, "define"))
+            {
+                parse_blank(&c);
+                char name[FRAKTAL_MAX_PARAM_NAME_LEN + 1];
+                if (parse_identifier(&c, name, sizeof(name)))
+                    parse_add_top_level_name(names, &count, max_count, PARSE_TOP_LEVEL_MACRO, name);
+            }
+            while (*c && *c != '\n' && *c != '\r')
+            {
+                if (c[0] == '\\' && (c[1] == '\n' || c[1] == '\r'))
+                    c++;
+                c++;
+            }
+            continue;
+        }
+        line_start = false;
+
+        if ((ch >= '0' && ch <= '9') || ch == '.')
+        {
+            // skip numbers (including suffixes and exponents)
+            while (parse_is_alpha(*c) || *c == '.')
+                c++;
+            continue;
+        }
+
+        if (parse_is_alpha(ch) || ch == '_')
+        {
+            const char *start = c;
+            char ident[FRAKTAL_MAX_PARAM_NAME_LEN + 1];
+            if (!parse_identifier(&c, ident, sizeof(ident)))
+            {
+                while (parse_is_alpha(*c) || *c == '_')
+                    c++;
+                continue;
+            }
+            if (depth == 0 && parens == 0 && !initializer)
+            {
+                if (idents == 0)
+                {
+                    statement = start;
+                    strcpy(first, ident);
+                }
+                else if (strcmp(last, "struct") == 0)
+                    parse_add_top_level_name(names, &count, max_count, PARSE_TOP_LEVEL_DEFINITION, ident);
+                strcpy(last, ident);
+                idents++;
+            }
+            continue;
+        }
+
+        if (depth == 0 && parens == 0 && !initializer && idents >= 2)
+        {
+            if (strcmp(first, "uniform") == 0)
+            {
+                if (ch == ';')
+                {
+                    parse_add_top_level_name(names, &count, max_count, PARSE_TOP_LEVEL_UNIFORM, last);
+                    names[count - 1].begin = statement;
+                    names[count - 1].end = c + 1;
+                }
+            }
+            else if (!parse_is_qualifier(first) && (ch == '(' || ch == '=' || ch == ';' || ch == ',' || ch == '['))
+            {
+                parse_add_top_level_name(names, &count, max_count, PARSE_TOP_LEVEL_DEFINITION, last);
+            }
+        }
+
+        if (ch == '{') depth++;
+        else if (ch == '}') { depth--; if (depth == 0) { idents = 0; initializer = false; } }
+        else if (ch == '(') parens++;
+        else if (ch == ')') parens--;
+        else if (ch == '=' && depth == 0 && parens == 0) initializer = true;
+        else if (ch == ',' && depth == 0 && parens == 0) initializer = false;
+        else if (ch == ';' && depth == 0 && parens == 0) { idents = 0; initializer = false; }
+        c++;
+    }
+    return count;
+}
+
+// A global function definition or constant (see parse_global_definitions).
+struct fGlobalDefinition
+{
+    const char *begin;
+    const char *end; // one past the closing '}' or ';'
+    const char *name;
+    int name_len;
+};
+
+// Finds the function definitions and the global constants of a source,
+// which are the declarations that can be removed if nothing refers to
+// them. Definitions that contain preprocessor directives are left out,
+// since removing them could unbalance #if blocks or lose macros, and so
+// are declarations of several constants at once. Returns the number of
+// definitions found, or -1 if there are more than 'max_count'.
+static int parse_global_definitions(const char *fs, fGlobalDefinition *defs, int max_count)
+{
+    int count = 0;
+    int depth = 0;  // braces
+    int parens = 0;
+    bool line_start = true;
+    char previous = 0; // last character other than blanks and comments
+
+    // the current global statement
+    const char *statement = NULL;
+    const char *name = NULL;
+    int name_len = 0;
+    const char *last = NULL; // last identifier before the name was found
+    int last_len = 0;
+    bool is_const = false;
+    bool is_function = false; // '(' follows the name
+    bool has_body = false;    // '{' follows the parameter list
+    bool has_directive = false;
+    bool multiple = false;
+
+    const char *c = fs;
+    while (*c)
+    {
+        if (parse_comment(&c))
+        {
+            line_start = c[-1] == '\n' || c[-1] == '\r';
+            continue;
+        }
+        char ch = *c;
+        if (ch == '\n' || ch == '\r')
+        {
+            line_start = true;
+            c++;
+            continue;
+        }
+        if (ch == ' ' || ch == '\t')
+        {
+            c++;
+            continue;
+        }
+        if (ch == '#' && line_start)
+        {
+            if (statement)
+                has_directive = true;
+            while (*c && *c != '\n' && *c != '\r')
+            {
+                if (c[0] == '\\' && (c[1] == '\n' || c[1] == '\r'))
+                    c++;
+                c++;
+            }
+            continue;
+        }
+        line_start = false;
+
+        if ((ch >= '0' && ch <= '9') || ch == '.')
+        {
+            // skip numbers (including suffixes and exponents)
+            while (parse_is_alpha(*c) || *c == '.')
+                c++;
+            previous = '0';
+            continue;
+        }
+
+        if (parse_is_alpha(ch))
+        {
+            const char *start = c;
+            parse_alpha(&c);
+            if (depth == 0 && parens == 0)
+            {
+                if (!statement)
+                {
+                    statement = start;
+                    is_const = c - start == 5 && memcmp(start, "const", 5) == 0;
+                }
+                if (!name)
+                {
+                    last = start;
+                    last_len = (int)(c - start);
+                }
+            }
+            previous = 'a';
+            continue;
+        }
+
+        if (depth == 0 && parens == 0 && statement && !name && last)
+        {
+            if (ch == '(' || ch == '=' || (ch == '[' && is_const))
+            {
+                name = last;
+                name_len = last_len;
+                is_function = ch == '(';
+            }
+        }
+
+        bool end = false;
+        if (ch == '{')
+        {
+            if (depth == 0 && parens == 0 && is_function && previous == ')')
+                has_body = true;
+            depth++;
+        }
+        else if (ch == '}')
+        {
+            depth--;
+            end = depth == 0 && has_body;
+        }
+        else if (ch == '(') parens++;
+        else if (ch == ')') parens--;
+        else if (ch == ',' && depth == 0 && parens == 0) multiple = true;
+        else if (ch == ';' && depth == 0 && parens == 0) end = true;
+        previous = ch;
+        c++;
+
+        if (end)
+        {
+            bool definition = has_body || (is_const && name && !is_function && !multiple);
+            if (definition && !has_directive)
+            {
+                if (count == max_count)
+                    return -1;
+                defs[count].begin = statement;
+                defs[count].end = c;
+                defs[count].name = name;
+                defs[count].name_len = name_len;
+                count++;
+            }
+            statement = NULL;
+            name = NULL;
+            last = NULL;
+            is_const = false;
+            is_function = false;
+            has_body = false;
+            has_directive = false;
+            multiple = false;
+        }
+    }
+    return count;
 }
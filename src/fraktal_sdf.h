@@ -0,0 +1,181 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+#pragma once
+#include <stdlib.h>
+#include <string.h>
+#include <log.h>
+
+// These must match libf/interpreter.f
+enum { FRAKTAL_SDF_MAX_STACK = 8 };
+enum { FRAKTAL_SDF_MAX_INSTRUCTIONS = 256 };
+enum { FRAKTAL_SDF_FLOATS_PER_OP = 8 }; // two RGBA texels: (op, arg0..arg2), (arg3..arg6)
+
+struct fSdfProgram
+{
+    float *data; // FRAKTAL_SDF_FLOATS_PER_OP floats per operation
+    int count;
+    int capacity;
+    int depth;       // number of distances on the stack after the last operation
+    int point_depth; // number of saved points after the last operation
+};
+
+static int fraktal_sdf_op_args(fSdfOp op)
+{
+    switch (op)
+    {
+        case FRAKTAL_SDF_SPHERE: return 1;
+        case FRAKTAL_SDF_BOX: return 3;
+        case FRAKTAL_SDF_CYLINDER: return 2;
+        case FRAKTAL_SDF_CAPSULE: return 2;
+        case FRAKTAL_SDF_TORUS: return 2;
+        case FRAKTAL_SDF_PLANE: return 4;
+        case FRAKTAL_SDF_CONE: return 2;
+        case FRAKTAL_SDF_HEXAGON: return 2;
+        case FRAKTAL_SDF_OCTAHEDRON: return 1;
+        case FRAKTAL_SDF_DODECAHEDRON: return 1;
+        case FRAKTAL_SDF_ICOSAHEDRON: return 1;
+        case FRAKTAL_SDF_UNION: return 0;
+        case FRAKTAL_SDF_INTERSECTION: return 0;
+        case FRAKTAL_SDF_DIFFERENCE: return 0;
+        case FRAKTAL_SDF_UNION_ROUND: return 1;
+        case FRAKTAL_SDF_INTERSECTION_ROUND: return 1;
+        case FRAKTAL_SDF_DIFFERENCE_ROUND: return 1;
+        case FRAKTAL_SDF_UNION_CHAMFER: return 1;
+        case FRAKTAL_SDF_INTERSECTION_CHAMFER: return 1;
+        case FRAKTAL_SDF_DIFFERENCE_CHAMFER: return 1;
+        case FRAKTAL_SDF_UNION_SOFT: return 1;
+        case FRAKTAL_SDF_UNION_STAIRS: return 2;
+        case FRAKTAL_SDF_UNION_COLUMNS: return 2;
+        case FRAKTAL_SDF_PIPE: return 1;
+        case FRAKTAL_SDF_ENGRAVE: return 1;
+        case FRAKTAL_SDF_GROOVE: return 2;
+        case FRAKTAL_SDF_TONGUE: return 2;
+        case FRAKTAL_SDF_PUSH_POINT: return 0;
+        case FRAKTAL_SDF_POP_POINT: return 0;
+        case FRAKTAL_SDF_TRANSLATE: return 3;
+        case FRAKTAL_SDF_ROTATE_X: return 1;
+        case FRAKTAL_SDF_ROTATE_Y: return 1;
+        case FRAKTAL_SDF_ROTATE_Z: return 1;
+        case FRAKTAL_SDF_MOD1: return 2;
+        case FRAKTAL_SDF_MIRROR: return 2;
+        case FRAKTAL_SDF_MOD_POLAR: return 2;
+        case FRAKTAL_SDF_ROUND: return 1;
+        default: return -1;
+    }
+}
+
+fSdfProgram *fraktal_create_sdf_program()
+{
+    fSdfProgram *p = (fSdfProgram*)calloc(1, sizeof(fSdfProgram));
+    fraktal_assert(p && "Ran out of memory");
+    return p;
+}
+
+void fraktal_destroy_sdf_program(fSdfProgram *p)
+{
+    if (p)
+    {
+        free(p->data);
+        free(p);
+    }
+}
+
+bool fraktal_add_sdf_op(fSdfProgram *p, fSdfOp op, const float *args, int num_args)
+{
+    fraktal_assert(p);
+    int expected_args = fraktal_sdf_op_args(op);
+    if (expected_args < 0)
+    {
+        log_err("Invalid SDF operation %d.\n", op);
+        return false;
+    }
+    if (num_args != expected_args)
+    {
+        log_err("SDF operation %d takes %d arguments, but got %d.\n", op, expected_args, num_args);
+        return false;
+    }
+    fraktal_assert((args || num_args == 0) && "Missing SDF operation arguments");
+
+    int depth = p->depth;
+    int point_depth = p->point_depth;
+    if (op <= FRAKTAL_SDF_ICOSAHEDRON)
+        depth++;
+    else if (op <= FRAKTAL_SDF_TONGUE)
+        depth--;
+    else if (op == FRAKTAL_SDF_PUSH_POINT)
+        point_depth++;
+    else if (op == FRAKTAL_SDF_POP_POINT)
+        point_depth--;
+
+    if ((op > FRAKTAL_SDF_ICOSAHEDRON && op <= FRAKTAL_SDF_TONGUE && p->depth < 2) ||
+        (op == FRAKTAL_SDF_ROUND && p->depth < 1))
+    {
+        log_err("SDF operation %d has no distance to operate on.\n", op);
+        return false;
+    }
+    if (point_depth < 0)
+    {
+        log_err("SDF program pops a point that was not pushed.\n");
+        return false;
+    }
+    if (depth > FRAKTAL_SDF_MAX_STACK || point_depth > FRAKTAL_SDF_MAX_STACK)
+    {
+        log_err("SDF program exceeds the maximum stack size (%d).\n", FRAKTAL_SDF_MAX_STACK);
+        return false;
+    }
+    if (p->count + 1 >= FRAKTAL_SDF_MAX_INSTRUCTIONS) // reserve one for the terminating FRAKTAL_SDF_END
+    {
+        log_err("SDF program exceeds the maximum number of operations (%d).\n", FRAKTAL_SDF_MAX_INSTRUCTIONS - 1);
+        return false;
+    }
+
+    if (p->count == p->capacity)
+    {
+        int capacity = p->capacity ? 2*p->capacity : 16;
+        float *data = (float*)realloc(p->data, capacity*FRAKTAL_SDF_FLOATS_PER_OP*sizeof(float));
+        fraktal_assert(data && "Ran out of memory");
+        p->data = data;
+        p->capacity = capacity;
+    }
+    float *dst = p->data + p->count*FRAKTAL_SDF_FLOATS_PER_OP;
+    memset(dst, 0, FRAKTAL_SDF_FLOATS_PER_OP*sizeof(float));
+    dst[0] = (float)op;
+    for (int i = 0; i < num_args; i++)
+        dst[1 + i] = args[i];
+    p->count++;
+    p->depth = depth;
+    p->point_depth = point_depth;
+    return true;
+}
+
+fArray *fraktal_create_sdf_array(fSdfProgram **programs, int count)
+{
+    fraktal_assert(programs);
+    fraktal_assert(count > 0);
+    int max_count = 0;
+    for (int i = 0; i < count; i++)
+    {
+        fraktal_assert(programs[i]);
+        if (programs[i]->depth != 1)
+        {
+            log_err("SDF program %d must leave exactly one distance on the stack (has %d).\n", i, programs[i]->depth);
+            return NULL;
+        }
+        if (programs[i]->count > max_count)
+            max_count = programs[i]->count;
+    }
+
+    // Every row is terminated by FRAKTAL_SDF_END (zero). The array is
+    // always 2D, since the interpreter samples it as a sampler2D.
+    int width = 2*(max_count + 1);
+    int height = count > 1 ? count : 2;
+    int row_floats = width*4;
+    float *data = (float*)calloc(row_floats*height, sizeof(float));
+    fraktal_assert(data && "Ran out of memory");
+    for (int i = 0; i < count; i++)
+        memcpy(data + i*row_floats, programs[i]->data, programs[i]->count*FRAKTAL_SDF_FLOATS_PER_OP*sizeof(float));
+    fArray *a = fraktal_create_array(data, width, height, 4, FRAKTAL_FLOAT, FRAKTAL_READ_ONLY);
+    free(data);
+    return a;
+}
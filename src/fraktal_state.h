@@ -0,0 +1,250 @@
+// Developed by Simen Haugo.
+// See LICENSE.txt for copyright and licensing details (standard MIT License).
+
+#pragma once
+
+// fraktal keeps an in-memory mirror of the GL state that it modifies, so
+// that binds which are already current can be skipped, and so that the
+// state does not have to be queried from the driver (which may force the
+// driver to synchronize with the GPU).
+//
+// The mirror is only trusted ('valid') while fraktal knows that no one
+// else has touched the GL state: that is, between fraktal_use_kernel(f)
+// and fraktal_use_kernel(NULL), or at all times if the user has declared
+// that fraktal has exclusive ownership of the context.
+//
+// The mirror, and the objects below, belong to the context that was
+// current when they were set up. They are forgotten when that context is
+// destroyed or when another context is made current (see
+// fraktal_ensure_context).
+
+enum { FRAKTAL_MAX_TRACKED_TEXTURE_UNITS = 32 };
+enum { FRAKTAL_GL_UNKNOWN = 0xFFFFFFFF };
+
+struct fGLState
+{
+    bool exclusive;
+    bool valid;
+
+    GLuint program;
+    GLuint framebuffer;
+    GLint viewport[4];
+    GLuint active_texture;
+    GLuint texture_1d[FRAKTAL_MAX_TRACKED_TEXTURE_UNITS];
+    GLuint texture_2d[FRAKTAL_MAX_TRACKED_TEXTURE_UNITS];
+    bool kernel_state;     // blend, depth test, etc. are set up for kernels
+    bool clear_color_zero; // glClearColor(0,0,0,0) has been set
+
+    // These are created once and kept for the lifetime of the context.
+    void *context; // the context they belong to
+    GLuint vao;
+    GLuint quad;
+    GLuint kernel_vs; // vertex shader shared by all kernel programs
+};
+
+static fGLState fraktal_gl = {0};
+
+// Marks every tracked value as unknown, causing the next bind of each
+// value to go through to the driver.
+static void fraktal_gl_reset_mirror()
+{
+    fraktal_gl.program = FRAKTAL_GL_UNKNOWN;
+    fraktal_gl.framebuffer = FRAKTAL_GL_UNKNOWN;
+    fraktal_gl.viewport[0] = -1;
+    fraktal_gl.viewport[1] = -1;
+    fraktal_gl.viewport[2] = -1;
+    fraktal_gl.viewport[3] = -1;
+    fraktal_gl.active_texture = FRAKTAL_GL_UNKNOWN;
+    for (int i = 0; i < FRAKTAL_MAX_TRACKED_TEXTURE_UNITS; i++)
+    {
+        fraktal_gl.texture_1d[i] = FRAKTAL_GL_UNKNOWN;
+        fraktal_gl.texture_2d[i] = FRAKTAL_GL_UNKNOWN;
+    }
+    fraktal_gl.kernel_state = false;
+    fraktal_gl.clear_color_zero = false;
+}
+
+// Forgets the mirror and the objects of the context that fraktal last
+// used. The objects are not deleted, since that context need not be
+// current, and are freed along with it.
+static void fraktal_gl_forget_context()
+{
+    fraktal_gl.context = NULL;
+    fraktal_gl.vao = 0;
+    fraktal_gl.quad = 0;
+    fraktal_gl.kernel_vs = 0;
+    fraktal_gl.valid = false;
+}
+
+// Deletes the objects of the current context, which must be the one that
+// they belong to, before the context is destroyed.
+static void fraktal_gl_delete_objects()
+{
+    if (fraktal_gl.vao)
+        glDeleteVertexArrays(1, &fraktal_gl.vao);
+    if (fraktal_gl.quad)
+        glDeleteBuffers(1, &fraktal_gl.quad);
+    if (fraktal_gl.kernel_vs)
+        glDeleteShader(fraktal_gl.kernel_vs);
+    fraktal_gl_forget_context();
+}
+
+static void fraktal_gl_begin_tracking()
+{
+    if (!fraktal_gl.valid)
+    {
+        fraktal_gl_reset_mirror();
+        fraktal_gl.valid = true;
+    }
+}
+
+static void fraktal_gl_end_tracking()
+{
+    if (!fraktal_gl.exclusive)
+        fraktal_gl.valid = false;
+}
+
+static void fraktal_gl_use_program(GLuint program)
+{
+    if (fraktal_gl.valid && fraktal_gl.program == program)
+        return;
+    glUseProgram(program);
+    if (fraktal_gl.valid)
+        fraktal_gl.program = program;
+}
+
+static void fraktal_gl_bind_framebuffer(GLuint fbo)
+{
+    if (fraktal_gl.valid && fraktal_gl.framebuffer == fbo)
+        return;
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    if (fraktal_gl.valid)
+        fraktal_gl.framebuffer = fbo;
+}
+
+static void fraktal_gl_viewport(GLint x, GLint y, GLint w, GLint h)
+{
+    GLint *v = fraktal_gl.viewport;
+    if (fraktal_gl.valid && v[0] == x && v[1] == y && v[2] == w && v[3] == h)
+        return;
+    glViewport(x, y, w, h);
+    if (fraktal_gl.valid)
+    {
+        v[0] = x;
+        v[1] = y;
+        v[2] = w;
+        v[3] = h;
+    }
+}
+
+static void fraktal_gl_bind_texture(int unit, GLenum target, GLuint texture)
+{
+    fraktal_assert(target == GL_TEXTURE_1D || target == GL_TEXTURE_2D);
+    if (!fraktal_gl.valid || unit >= FRAKTAL_MAX_TRACKED_TEXTURE_UNITS)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        glBindTexture(target, texture);
+        if (fraktal_gl.valid)
+            fraktal_gl.active_texture = unit;
+        return;
+    }
+    GLuint *bound = target == GL_TEXTURE_1D ? fraktal_gl.texture_1d : fraktal_gl.texture_2d;
+    if (bound[unit] == texture)
+        return;
+    if (fraktal_gl.active_texture != (GLuint)unit)
+    {
+        glActiveTexture(GL_TEXTURE0 + unit);
+        fraktal_gl.active_texture = unit;
+    }
+    glBindTexture(target, texture);
+    bound[unit] = texture;
+}
+
+// Binds a texture in order to upload or download its data. Unless the
+// mirror is valid, the texture is bound to the active texture unit (like
+// fraktal did before the state tracker existed) and should be unbound
+// afterward with fraktal_gl_end_transfer_texture.
+static void fraktal_gl_begin_transfer_texture(GLenum target, GLuint texture)
+{
+    if (fraktal_gl.valid)
+        fraktal_gl_bind_texture(0, target, texture);
+    else
+        glBindTexture(target, texture);
+}
+
+static void fraktal_gl_end_transfer_texture(GLenum target)
+{
+    if (!fraktal_gl.valid)
+        glBindTexture(target, 0);
+}
+
+static void fraktal_gl_clear_color_zero()
+{
+    if (fraktal_gl.valid && fraktal_gl.clear_color_zero)
+        return;
+    glClearColor(0,0,0,0);
+    if (fraktal_gl.valid)
+        fraktal_gl.clear_color_zero = true;
+}
+
+// Object names may be reused by the driver after deletion, so the mirror
+// must forget about deleted objects.
+static void fraktal_gl_forget_program(GLuint program)
+{
+    if (fraktal_gl.program == program)
+        fraktal_gl.program = FRAKTAL_GL_UNKNOWN;
+}
+
+static void fraktal_gl_forget_framebuffer(GLuint fbo)
+{
+    if (fraktal_gl.framebuffer == fbo)
+        fraktal_gl.framebuffer = FRAKTAL_GL_UNKNOWN;
+}
+
+static void fraktal_gl_forget_texture(GLuint texture)
+{
+    for (int i = 0; i < FRAKTAL_MAX_TRACKED_TEXTURE_UNITS; i++)
+    {
+        if (fraktal_gl.texture_1d[i] == texture) fraktal_gl.texture_1d[i] = FRAKTAL_GL_UNKNOWN;
+        if (fraktal_gl.texture_2d[i] == texture) fraktal_gl.texture_2d[i] = FRAKTAL_GL_UNKNOWN;
+    }
+}
+
+// Sets the fixed-function state required by fraktal_run_kernel: additive
+// blending, no depth test, culling, scissor test or logic op, and the
+// full-screen quad bound to attribute location 0.
+static void fraktal_gl_kernel_state()
+{
+    if (fraktal_gl.valid && fraktal_gl.kernel_state)
+        return;
+
+    if (!fraktal_gl.quad)
+    {
+        static const float data[] = { -1,-1, +1,-1, +1,+1, +1,+1, -1,+1, -1,-1 };
+        glGenBuffers(1, &fraktal_gl.quad);
+        glBindBuffer(GL_ARRAY_BUFFER, fraktal_gl.quad);
+        glBufferData(GL_ARRAY_BUFFER, sizeof(data), data, GL_STATIC_DRAW);
+    }
+    fraktal_assert(fraktal_gl.quad && "Failed to create vertex buffer");
+
+    if (!fraktal_gl.vao)
+    {
+        glGenVertexArrays(1, &fraktal_gl.vao);
+        glBindVertexArray(fraktal_gl.vao);
+        glBindBuffer(GL_ARRAY_BUFFER, fraktal_gl.quad);
+        glEnableVertexAttribArray(0);
+        glVertexAttribPointer(0, 2, GL_FLOAT, GL_FALSE, sizeof(GLfloat) * 2, 0);
+    }
+    fraktal_assert(fraktal_gl.vao && "Failed to create vertex array");
+
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_DEPTH_TEST);
+    glDisable(GL_SCISSOR_TEST);
+    glDisable(GL_COLOR_LOGIC_OP);
+    glEnable(GL_BLEND);
+    glBlendFunc(GL_ONE, GL_ONE);
+    glBlendEquation(GL_FUNC_ADD);
+    glBindVertexArray(fraktal_gl.vao);
+    if (fraktal_gl.valid)
+        fraktal_gl.kernel_state = true;
+}
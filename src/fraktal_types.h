@@ -1,5 +1,7 @@
 #pragma once
 #include <math.h>
+#include <stdlib.h>
+#include <string.h>
 
 typedef float angle;
 struct int2 { int x,y; };
@@ -27,7 +29,6 @@ static float3 angle2float3(angle2 dir)
     return w;
 }
 
-enum { FRAKTAL_MAX_PARAMS = 1024 };
 enum { FRAKTAL_MAX_PARAM_NAME_LEN = 64 };
 typedef int fParamType;
 enum fParamType_
@@ -46,18 +47,177 @@ enum fParamType_
     FRAKTAL_PARAM_SAMPLER1D,
     FRAKTAL_PARAM_SAMPLER2D,
 };
+// Parameters are stored as parallel arrays, one entry per parameter, that
+// share a single allocation (see fraktal_reserve_params). Names are stored
+// once in a string pool, and 'name' holds the offset of each name in it.
 struct fParams
 {
-    float4 mean[FRAKTAL_MAX_PARAMS];
-    float4 scale[FRAKTAL_MAX_PARAMS];
-    char name[FRAKTAL_MAX_PARAMS][FRAKTAL_MAX_PARAM_NAME_LEN + 1];
-    int offset[FRAKTAL_MAX_PARAMS];
-    fParamType type[FRAKTAL_MAX_PARAMS];
-    int assigned_tex_unit[FRAKTAL_MAX_PARAMS];
+    float4 *mean;
+    float4 *scale;
+    int *name;
+    int *offset;
+    fParamType *type;
+    int *assigned_tex_unit;
+    bool *specialize;
 
-    int std140_offset[FRAKTAL_MAX_PARAMS];
-    int std140_size[FRAKTAL_MAX_PARAMS];
+    int *std140_offset;
+    int *std140_size;
+    int *vector_index; // of the first element in the parameter vector, or -1 (see fraktal_set_param_vector)
+    int vector_length;
+
+    char *names;
+    int names_length;
+    int names_capacity;
+    int *name_table;      // open addressing hash table of (offset + 1) into 'names', or 0
+    int name_table_size;  // power of two
+    int name_table_count;
 
     int sampler_count;
     int count;
+    int capacity;
 };
+
+static const char *fraktal_param_name(const fParams *p, int i)
+{
+    return p->names + p->name[i];
+}
+
+static void fraktal_resize_params(fParams *p, int capacity)
+{
+    fraktal_assert(capacity >= p->count);
+    size_t entry_size = 2*sizeof(float4) + 7*sizeof(int) + sizeof(bool);
+    char *block = (char*)malloc(capacity > 0 ? capacity*entry_size : 1);
+    fraktal_assert(block && "Ran out of memory");
+
+    fParams old = *p;
+    p->mean = (float4*)block;                 block += capacity*sizeof(float4);
+    p->scale = (float4*)block;                block += capacity*sizeof(float4);
+    p->name = (int*)block;                    block += capacity*sizeof(int);
+    p->offset = (int*)block;                  block += capacity*sizeof(int);
+    p->type = (fParamType*)block;             block += capacity*sizeof(fParamType);
+    p->assigned_tex_unit = (int*)block;       block += capacity*sizeof(int);
+    p->std140_offset = (int*)block;           block += capacity*sizeof(int);
+    p->std140_size = (int*)block;             block += capacity*sizeof(int);
+    p->vector_index = (int*)block;            block += capacity*sizeof(int);
+    p->specialize = (bool*)block;
+    p->capacity = capacity;
+    if (old.count > 0)
+    {
+        memcpy(p->mean, old.mean, old.count*sizeof(float4));
+        memcpy(p->scale, old.scale, old.count*sizeof(float4));
+        memcpy(p->name, old.name, old.count*sizeof(int));
+        memcpy(p->offset, old.offset, old.count*sizeof(int));
+        memcpy(p->type, old.type, old.count*sizeof(fParamType));
+        memcpy(p->assigned_tex_unit, old.assigned_tex_unit, old.count*sizeof(int));
+        memcpy(p->std140_offset, old.std140_offset, old.count*sizeof(int));
+        memcpy(p->std140_size, old.std140_size, old.count*sizeof(int));
+        memcpy(p->vector_index, old.vector_index, old.count*sizeof(int));
+        memcpy(p->specialize, old.specialize, old.count*sizeof(bool));
+    }
+    free(old.mean); // start of the block
+}
+
+// Ensures that there is room for 'count' parameters.
+static void fraktal_reserve_params(fParams *p, int count)
+{
+    if (count <= p->capacity)
+        return;
+    int capacity = p->capacity ? 2*p->capacity : 64;
+    while (capacity < count)
+        capacity *= 2;
+    fraktal_resize_params(p, capacity);
+}
+
+static unsigned int fraktal_hash_param_name(const char *name, size_t len)
+{
+    unsigned int hash = 2166136261u; // FNV-1a
+    for (size_t i = 0; i < len; i++)
+        hash = (hash ^ (unsigned char)name[i])*16777619u;
+    return hash;
+}
+
+static void fraktal_insert_param_name(fParams *p, int at)
+{
+    const char *name = p->names + at;
+    unsigned int mask = (unsigned int)p->name_table_size - 1;
+    unsigned int i = fraktal_hash_param_name(name, strlen(name)) & mask;
+    while (p->name_table[i])
+        i = (i + 1) & mask;
+    p->name_table[i] = at + 1;
+    p->name_table_count++;
+}
+
+// Returns the offset of 'name' (of length 'len') in the string pool,
+// adding it to the pool unless an equal name is already there.
+static int fraktal_intern_param_name(fParams *p, const char *name, size_t len)
+{
+    if (2*(p->name_table_count + 1) > p->name_table_size)
+    {
+        free(p->name_table);
+        p->name_table_size = p->name_table_size ? 2*p->name_table_size : 256;
+        p->name_table = (int*)calloc(p->name_table_size, sizeof(int));
+        fraktal_assert(p->name_table && "Ran out of memory");
+        p->name_table_count = 0;
+        for (int at = 0; at < p->names_length; at += (int)strlen(p->names + at) + 1)
+            fraktal_insert_param_name(p, at);
+    }
+
+    unsigned int mask = (unsigned int)p->name_table_size - 1;
+    for (unsigned int i = fraktal_hash_param_name(name, len) & mask; p->name_table[i]; i = (i + 1) & mask)
+    {
+        const char *other = p->names + p->name_table[i] - 1;
+        if (strncmp(other, name, len) == 0 && other[len] == '\0')
+            return p->name_table[i] - 1;
+    }
+
+    if (p->names_length + (int)len + 1 > p->names_capacity)
+    {
+        int capacity = p->names_capacity ? 2*p->names_capacity : 1024;
+        while (capacity < p->names_length + (int)len + 1)
+            capacity *= 2;
+        char *names = (char*)realloc(p->names, capacity);
+        fraktal_assert(names && "Ran out of memory");
+        p->names = names;
+        p->names_capacity = capacity;
+    }
+    int at = p->names_length;
+    memcpy(p->names + at, name, len);
+    p->names[at + len] = '\0';
+    p->names_length += (int)len + 1;
+    fraktal_insert_param_name(p, at);
+    return at;
+}
+
+// Makes 'dst' a right-sized copy of 'src'.
+static void fraktal_copy_params(fParams *dst, const fParams *src)
+{
+    memset(dst, 0, sizeof(fParams));
+    fraktal_resize_params(dst, src->count);
+    dst->count = src->count;
+    dst->sampler_count = src->sampler_count;
+    memcpy(dst->mean, src->mean, src->count*sizeof(float4));
+    memcpy(dst->scale, src->scale, src->count*sizeof(float4));
+    memcpy(dst->name, src->name, src->count*sizeof(int));
+    memcpy(dst->offset, src->offset, src->count*sizeof(int));
+    memcpy(dst->type, src->type, src->count*sizeof(fParamType));
+    memcpy(dst->assigned_tex_unit, src->assigned_tex_unit, src->count*sizeof(int));
+    memcpy(dst->std140_offset, src->std140_offset, src->count*sizeof(int));
+    memcpy(dst->std140_size, src->std140_size, src->count*sizeof(int));
+    memcpy(dst->vector_index, src->vector_index, src->count*sizeof(int));
+    dst->vector_length = src->vector_length;
+    memcpy(dst->specialize, src->specialize, src->count*sizeof(bool));
+    dst->names = (char*)malloc(src->names_length > 0 ? src->names_length : 1);
+    fraktal_assert(dst->names && "Ran out of memory");
+    if (src->names_length > 0)
+        memcpy(dst->names, src->names, src->names_length);
+    dst->names_length = src->names_length;
+    dst->names_capacity = src->names_length;
+}
+
+static void fraktal_free_params(fParams *p)
+{
+    free(p->mean);
+    free(p->names);
+    free(p->name_table);
+    memset(p, 0, sizeof(fParams));
+}
@@ -28,10 +28,19 @@
 
 #include <open_sans_semi_bold.h>
 
-#define ENABLE_CONE_TRACING_OPTIMIZATION 0
-
 enum { MAX_WIDGETS = 128 };
 enum { NUM_PRESETS = 10 };
+enum { NUM_CONE_LEVELS = 2 };
+static const int cone_cells[NUM_CONE_LEVELS] = { 16, 4 }; // pixels per texel side, coarse to fine
+enum { REDUCE_BLOCK = 16 }; // pixels per texel side of the convergence count
+enum { MIN_ADAPTIVE_SAMPLES = 16 }; // samples before a pixel can converge
+enum { CONVERGENCE_INTERVAL = 8 }; // samples between reading back the convergence count
+enum { REPROJECT_HISTORY = 32 }; // samples per pixel kept when the camera moves
+enum { DENOISE_PASSES = 4 }; // a-trous passes, with taps 1, 2, 4 and 8 pixels apart
+enum { BRICK_GRID = 32 };    // cells per side of the brick cache (see libf/brick.f)
+enum { BRICK_SAMPLES = 8 };  // must match libf/brick.f
+enum { BRICK_TILES_X = 64 }; // must match libf/brick.f
+static const float brick_search_size = 32.0f; // side of the box, centered at the origin, that is searched for the surface
 struct Widget;
 struct guiKey
 {
@@ -72,6 +81,11 @@ struct guiPaths
     const char *color;
     const char *geometry;
     const char *compose;
+    const char *moments;
+    const char *reduce;
+    const char *reproject;
+    const char *denoise;
+    const char *bake;
 };
 struct Widget_Camera;
 struct guiState
@@ -85,13 +99,52 @@ struct guiState
 
     fArray *render_buffer;
     fArray *compose_buffer;
+    fArray *cone_buffers[NUM_CONE_LEVELS]; // cone tracing pre-pass (see libf/cone.f)
+    fArray *cone_scratch[NUM_CONE_LEVELS]; // epilogue output of fused pre-passes
+    fArray *moment_buffers[2]; // per-pixel sample moments, alternately read and written (see libf/moments.f)
+    fArray *reduce_buffer;     // blocks of moment_buffers summed by the reduce kernel
+    int moment_index;          // moment_buffers[moment_index] holds the latest moments
+    fArray *history_buffer;    // render_buffer reprojected to a new camera, then swapped with it
+    fArray *depth_buffers[2];  // depth of each pixel center (see libf/reproject.f)
+    int depth_index;           // depth_buffers[depth_index] belongs to the current camera
+    fArray *gbuffer;           // geometry.f's GBuffer output, which guides the denoiser
+    fArray *denoise_buffers[2];
+    fArray *brick_grid;        // brick cache of the model (see libf/brick.f), or NULL if none was baked
+    fArray *brick_atlas;
+    float3 brick_min;
+    float brick_cell;
     fKernel *render_kernel;
     fKernel *compose_kernel;
+    fKernel *moments_kernel;
+    fKernel *reduce_kernel;
+    fKernel *reproject_kernel;
+    fKernel *gbuffer_kernel;   // geometry.f linked with the model, loaded if denoise is on
+    fKernel *denoise_kernel;
+    fKernel *bake_kernel;      // bake.f linked with the model, loaded if brick_cache is on
     bool render_kernel_is_new;
     bool compose_kernel_is_new;
+    bool moments_kernel_is_new;
+    bool reduce_kernel_is_new;
+    bool reproject_kernel_is_new;
+    bool gbuffer_kernel_is_new;
+    bool denoise_kernel_is_new;
+    bool bake_kernel_is_new;
+    bool render_kernel_is_fused; // compose runs as the epilogue of the render kernel
     int samples;
     int max_samples;
+    int frame;             // samples rendered since the last clear, which seeds the renderers' noise
+    float2 camera_center;  // camera that the accumulated samples were rendered from
+    float camera_f;
+    float camera_view[4*4];
+    bool adaptive;         // stop sampling pixels whose error is below error_threshold
+    float error_threshold;
+    float converged;       // fraction of pixels that have converged
+    bool denoise;          // filter the render before composing it (see libf/denoise.f)
+    bool should_render_gbuffer;
+    bool brick_cache;      // trace the model through a baked brick cache
+    bool should_bake;
     bool should_clear;
+    bool should_reproject; // the camera moved, and the accumulated samples can be reprojected
     bool should_exit;
     bool initialized;
     bool auto_render;
@@ -129,48 +182,36 @@ static void save_screenshot(const char *filename, fArray *f)
     free(pixels);
 }
 
-static fKernel *load_render_shader(const char *model_path, const char *render_path)
+// If 'epilogue_path' is given, the kernel is fused with it (if supported)
+// and 'fused' is set to true.
+static fKernel *load_render_shader(const char *model_path, const char *render_path, const char *epilogue_path, bool *fused)
 {
+    *fused = false;
     fLinkState *link = fraktal_create_link();
 
-    static char *hg_sdf = read_file("libf/hg_sdf.f");
-    if (!hg_sdf)
-        log_err("Failed to load hg_sdf: file is corrupt or not in the expected directory (libf/hg_sdf.f)\n");
-
-    if (hg_sdf)
+    // Models are written against hg_sdf.f, which is included ahead of
+    // the model (and is only read and parsed again if it is modified).
+    char *model = read_file(model_path);
+    if (!model)
     {
-        char *model = read_file(model_path);
-        if (!model)
-        {
-            log_err("Failed to load render kernel: error compiling model.\n");
-            fraktal_destroy_link(link);
-            return NULL;
-        }
-        static const char *line_0 = "#line 0\n";
-        char *concat = (char*)malloc(strlen(hg_sdf) + strlen(line_0) + strlen(model) + 1);
-        fraktal_assert(concat);
-        strcpy(concat, hg_sdf);
-        strcat(concat, line_0);
-        strcat(concat, model);
-        free(model);
-        if (!fraktal_add_link_data(link, concat, strlen(concat), model_path))
-        {
-            log_err("Failed to load render kernel: error compiling model.\n");
-            fraktal_destroy_link(link);
-            free(concat);
-            return NULL;
-        }
-        free(concat);
+        log_err("Failed to load render kernel: error compiling model.\n");
+        fraktal_destroy_link(link);
+        return NULL;
     }
-    else
+    static const char *prefix = "#include \"libf/hg_sdf.f\"\n#line 0\n";
+    char *concat = (char*)malloc(strlen(prefix) + strlen(model) + 1);
+    fraktal_assert(concat);
+    strcpy(concat, prefix);
+    strcat(concat, model);
+    free(model);
+    if (!fraktal_add_link_data(link, concat, strlen(concat), model_path))
     {
-        if (!fraktal_add_link_file(link, model_path))
-        {
-            log_err("Failed to load render kernel: error compiling model.\n");
-            fraktal_destroy_link(link);
-            return NULL;
-        }
+        log_err("Failed to load render kernel: error compiling model.\n");
+        fraktal_destroy_link(link);
+        free(concat);
+        return NULL;
     }
+    free(concat);
 
     if (!fraktal_add_link_file(link, render_path))
     {
@@ -179,6 +220,14 @@ static fKernel *load_render_shader(const char *model_path, const char *render_pa
         return NULL;
     }
 
+    if (epilogue_path)
+    {
+        char *epilogue = read_file(epilogue_path);
+        if (epilogue && fraktal_add_link_epilogue(link, epilogue, 0, epilogue_path))
+            *fused = true;
+        free(epilogue);
+    }
+
     fKernel *kernel = fraktal_link_kernel(link);
     fraktal_destroy_link(link);
     return kernel;
@@ -187,10 +236,11 @@ static fKernel *load_render_shader(const char *model_path, const char *render_pa
 static bool load_gui(guiState &g)
 {
     fKernel *render = NULL;
+    bool fused = false;
     if (g.new_mode == guiPreviewMode_Color)
-        render = load_render_shader(g.new_paths.model, g.new_paths.color);
+        render = load_render_shader(g.new_paths.model, g.new_paths.color, g.new_paths.compose, &fused);
     else
-        render = load_render_shader(g.new_paths.model, g.new_paths.geometry);
+        render = load_render_shader(g.new_paths.model, g.new_paths.geometry, NULL, &fused);
 
     if (!render)
     {
@@ -206,6 +256,73 @@ static bool load_gui(guiState &g)
         return false;
     }
 
+    fKernel *moments = fraktal_load_kernel(g.new_paths.moments);
+    fKernel *reduce = fraktal_load_kernel(g.new_paths.reduce);
+    if (!moments || !reduce)
+    {
+        log_err("Failed to load scene: error compiling adaptive sampling kernels.\n");
+        fraktal_destroy_kernel(render);
+        fraktal_destroy_kernel(compose);
+        fraktal_destroy_kernel(moments);
+        fraktal_destroy_kernel(reduce);
+        return false;
+    }
+
+    fKernel *reproject = fraktal_load_kernel(g.new_paths.reproject);
+    if (!reproject)
+    {
+        log_err("Failed to load scene: error compiling reprojection kernel.\n");
+        fraktal_destroy_kernel(render);
+        fraktal_destroy_kernel(compose);
+        fraktal_destroy_kernel(moments);
+        fraktal_destroy_kernel(reduce);
+        return false;
+    }
+
+    // The denoiser is guided by the geometry of the model, which is only
+    // compiled if denoising is on, as that doubles the time to load.
+    fKernel *gbuffer = NULL;
+    fKernel *denoise = NULL;
+    if (g.new_mode == guiPreviewMode_Color && g.denoise)
+    {
+        bool gbuffer_fused;
+        gbuffer = load_render_shader(g.new_paths.model, g.new_paths.geometry, NULL, &gbuffer_fused);
+        denoise = fraktal_load_kernel(g.new_paths.denoise);
+        if (!gbuffer || !denoise)
+        {
+            log_err("Failed to load scene: error compiling denoising kernels.\n");
+            fraktal_destroy_kernel(render);
+            fraktal_destroy_kernel(compose);
+            fraktal_destroy_kernel(moments);
+            fraktal_destroy_kernel(reduce);
+            fraktal_destroy_kernel(reproject);
+            fraktal_destroy_kernel(gbuffer);
+            fraktal_destroy_kernel(denoise);
+            return false;
+        }
+    }
+
+    // The brick cache is baked from the model, so it is baked again on
+    // every reload, which is when the model can have changed.
+    fKernel *bake = NULL;
+    if (g.brick_cache)
+    {
+        bool bake_fused;
+        bake = load_render_shader(g.new_paths.model, g.new_paths.bake, NULL, &bake_fused);
+        if (!bake)
+        {
+            log_err("Failed to load scene: error compiling brick cache kernel.\n");
+            fraktal_destroy_kernel(render);
+            fraktal_destroy_kernel(compose);
+            fraktal_destroy_kernel(moments);
+            fraktal_destroy_kernel(reduce);
+            fraktal_destroy_kernel(reproject);
+            fraktal_destroy_kernel(gbuffer);
+            fraktal_destroy_kernel(denoise);
+            return false;
+        }
+    }
+
     // Refetch uniform offsets
     for (int preset = 0; preset < NUM_PRESETS; preset++)
     for (int widget = 0; widget < g.presets[preset].num_widgets; widget++)
@@ -217,12 +334,32 @@ static bool load_gui(guiState &g)
     // Destroy old state and update to newly loaded state
     fraktal_destroy_kernel(g.render_kernel);
     fraktal_destroy_kernel(g.compose_kernel);
+    fraktal_destroy_kernel(g.moments_kernel);
+    fraktal_destroy_kernel(g.reduce_kernel);
+    fraktal_destroy_kernel(g.reproject_kernel);
+    fraktal_destroy_kernel(g.gbuffer_kernel);
+    fraktal_destroy_kernel(g.denoise_kernel);
+    fraktal_destroy_kernel(g.bake_kernel);
     g.paths = g.new_paths;
     g.mode = g.new_mode;
     g.render_kernel = render;
     g.compose_kernel = compose;
+    g.moments_kernel = moments;
+    g.reduce_kernel = reduce;
+    g.reproject_kernel = reproject;
+    g.gbuffer_kernel = gbuffer;
+    g.denoise_kernel = denoise;
+    g.bake_kernel = bake;
     g.render_kernel_is_new = true;
     g.compose_kernel_is_new = true;
+    g.moments_kernel_is_new = true;
+    g.reduce_kernel_is_new = true;
+    g.reproject_kernel_is_new = true;
+    g.gbuffer_kernel_is_new = true;
+    g.denoise_kernel_is_new = true;
+    g.bake_kernel_is_new = true;
+    g.render_kernel_is_fused = fused;
+    g.should_bake = true;
     g.should_clear = true;
     g.initialized = true;
 
@@ -231,90 +368,442 @@ static bool load_gui(guiState &g)
 
 #define fetch_uniform(kernel, name) static int loc_##name; if (scene.kernel##_is_new) loc_##name = fraktal_get_param_offset(scene.kernel, #name);
 
-#if ENABLE_CONE_TRACING_OPTIMIZATION
-static void render_color(guiState &scene)
+// Runs the cone tracing pre-pass of the render kernel over each level,
+// from coarse to fine, if the scene was cleared, and makes the render
+// pass start its rays at the distances of the finest level. The render
+// kernel must be in use, with its camera parameters set.
+static void render_cone_levels(guiState &scene, bool clear)
 {
-    if (!scene.render_kernel || !scene.compose_kernel)
+    fetch_uniform(render_kernel, iConePass);
+    fetch_uniform(render_kernel, iConeCell);
+    fetch_uniform(render_kernel, iConeInputCell);
+    fetch_uniform(render_kernel, iConeDistance);
+
+    if (clear)
+    {
+        fraktal_param_1i(loc_iConePass, 1);
+        for (int level = 0; level < NUM_CONE_LEVELS; level++)
+        {
+            fArray *out = scene.cone_buffers[level];
+            fraktal_param_1i(loc_iConeCell, cone_cells[level]);
+            if (level > 0)
+            {
+                fraktal_param_1i(loc_iConeInputCell, cone_cells[level - 1]);
+                fraktal_param_array(loc_iConeDistance, scene.cone_buffers[level - 1]);
+            }
+            else
+            {
+                fraktal_param_1i(loc_iConeInputCell, 0);
+            }
+
+            // A fused kernel adds its output to the array, and the
+            // epilogue's result is not needed.
+            fraktal_zero_array(out);
+            if (scene.render_kernel_is_fused)
+                fraktal_run_kernel_fused(out, scene.cone_scratch[level]);
+            else
+                fraktal_run_kernel(out);
+        }
+        fraktal_param_1i(loc_iConePass, 0);
+    }
+
+    fraktal_param_1i(loc_iConeInputCell, cone_cells[NUM_CONE_LEVELS - 1]);
+    fraktal_param_array(loc_iConeDistance, scene.cone_buffers[NUM_CONE_LEVELS - 1]);
+}
+
+// Runs the first pass of the bake kernel over a box, and returns for each
+// cell whether it needs a brick and the distance at its center (see
+// libf/bake.f). The bake kernel must be in use.
+static float *classify_brick_cells(guiState &scene, float3 min, float cell)
+{
+    fetch_uniform(bake_kernel, iBakePass);
+    fetch_uniform(bake_kernel, iBrickMin);
+    fetch_uniform(bake_kernel, iBrickCell);
+    fetch_uniform(bake_kernel, iBrickGridSize);
+
+    const int n = BRICK_GRID;
+    fArray *out = fraktal_create_array(NULL, n, n*n, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+    if (!out)
+        return NULL;
+    fraktal_param_1i(loc_iBakePass, 0);
+    fraktal_param_3f(loc_iBrickMin, min.x, min.y, min.z);
+    fraktal_param_1f(loc_iBrickCell, cell);
+    fraktal_param_1i(loc_iBrickGridSize, n);
+    fraktal_zero_array(out);
+    fraktal_run_kernel(out);
+
+    float *cells = (float*)malloc(n*n*n*4*sizeof(float));
+    fraktal_assert(cells);
+    fraktal_to_cpu(cells, out);
+    fraktal_destroy_array(out);
+    return cells;
+}
+
+// Bakes the brick cache of the model (see libf/brick.f). The surface is
+// first located in a coarse box around the origin, and the cache is then
+// fitted to the cells that it passes near, so that its cells are as small
+// as possible. If the surface is not found, there is no cache.
+static void bake_brick_cache(guiState &scene)
+{
+    fraktal_destroy_array(scene.brick_grid);
+    fraktal_destroy_array(scene.brick_atlas);
+    scene.brick_grid = NULL;
+    scene.brick_atlas = NULL;
+    scene.should_bake = false;
+    scene.should_clear = true;
+    if (!scene.bake_kernel)
         return;
-    assert(scene.render_kernel);
-    assert(scene.compose_kernel);
-    assert(fraktal_is_valid_array(scene.render_buffer));
-    assert(fraktal_is_valid_array(scene.compose_buffer));
 
-    // todo: handle aspect ratio
-    static int t_buffer_width = 16;
-    static int t_buffer_height = 12;
-    static fArray *t_buffer = fraktal_create_array(NULL, t_buffer_width, t_buffer_height, 1, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
-    assert(t_buffer);
+    fraktal_use_kernel(scene.bake_kernel);
+    fetch_uniform(bake_kernel, iBakePass);
+    fetch_uniform(bake_kernel, iBrickMin);
+    fetch_uniform(bake_kernel, iBrickCell);
+    fetch_uniform(bake_kernel, iBrickCells);
+
+    const int n = BRICK_GRID;
+    float cell = brick_search_size/n;
+    float3 min = { -0.5f*brick_search_size, -0.5f*brick_search_size, -0.5f*brick_search_size };
+    float *cells = classify_brick_cells(scene, min, cell);
+    int lo[3] = { n, n, n };
+    int hi[3] = { -1, -1, -1 };
+    for (int z = 0; z < n && cells; z++)
+    for (int y = 0; y < n; y++)
+    for (int x = 0; x < n; x++)
+    {
+        if (cells[4*(x + (y + z*n)*n)] < 0.0f)
+            continue;
+        int xyz[3] = { x, y, z };
+        for (int i = 0; i < 3; i++)
+        {
+            if (xyz[i] < lo[i]) lo[i] = xyz[i];
+            if (xyz[i] > hi[i]) hi[i] = xyz[i];
+        }
+    }
+    free(cells);
+    if (hi[0] < 0)
+    {
+        fraktal_use_kernel(NULL);
+        return;
+    }
 
-    fraktal_use_kernel(scene.render_kernel);
+    // The fitted box is cubic, as cells are
+    int extent = 0;
+    for (int i = 0; i < 3; i++)
+        if (hi[i] - lo[i] + 1 > extent)
+            extent = hi[i] - lo[i] + 1;
+    min.x += lo[0]*cell;
+    min.y += lo[1]*cell;
+    min.z += lo[2]*cell;
+    cell = extent*cell/n;
+    cells = classify_brick_cells(scene, min, cell);
+    if (!cells)
     {
-        fetch_uniform(render_kernel, iLowResolution);
-        fetch_uniform(render_kernel, iResolution);
-        fetch_uniform(render_kernel, iChannel0);
-        fetch_uniform(render_kernel, iMode);
-        fetch_uniform(render_kernel, iSamples);
-        scene.render_kernel_is_new = false;
+        log_err("Failed to bake brick cache: could not create arrays.\n");
+        fraktal_use_kernel(NULL);
+        return;
+    }
+
+    // Number the bricks, replacing the flags of the grid, and list the
+    // cell of each brick in the order of the tiles of the atlas.
+    float *brick_cells = (float*)calloc(n*n*n*4, sizeof(float));
+    fraktal_assert(brick_cells);
+    int bricks = 0;
+    for (int z = 0; z < n; z++)
+    for (int y = 0; y < n; y++)
+    for (int x = 0; x < n; x++)
+    {
+        float *c = cells + 4*(x + (y + z*n)*n);
+        if (c[0] < 0.0f)
+            continue;
+        c[0] = (float)bricks;
+        brick_cells[4*bricks + 0] = (float)x;
+        brick_cells[4*bricks + 1] = (float)y;
+        brick_cells[4*bricks + 2] = (float)z;
+        bricks++;
+    }
+
+    int rows = (bricks + BRICK_TILES_X - 1)/BRICK_TILES_X;
+    fArray *grid = fraktal_create_array(cells, n, n*n, 4, FRAKTAL_FLOAT, FRAKTAL_READ_ONLY);
+    fArray *cell_table = fraktal_create_array(brick_cells, BRICK_TILES_X, rows, 4, FRAKTAL_FLOAT, FRAKTAL_READ_ONLY);
+    fArray *atlas = fraktal_create_array(NULL, BRICK_TILES_X*BRICK_SAMPLES*BRICK_SAMPLES, rows*BRICK_SAMPLES, 1, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+    free(cells);
+    free(brick_cells);
+    if (!grid || !cell_table || !atlas)
+    {
+        log_err("Failed to bake brick cache: could not create arrays.\n");
+        fraktal_destroy_array(grid);
+        fraktal_destroy_array(cell_table);
+        fraktal_destroy_array(atlas);
+        fraktal_use_kernel(NULL);
+        return;
+    }
+
+    fraktal_param_1i(loc_iBakePass, 1);
+    fraktal_param_3f(loc_iBrickMin, min.x, min.y, min.z);
+    fraktal_param_1f(loc_iBrickCell, cell);
+    fraktal_param_array(loc_iBrickCells, cell_table);
+    fraktal_zero_array(atlas);
+    fraktal_run_kernel(atlas);
+    fraktal_destroy_array(cell_table);
+    fraktal_use_kernel(NULL);
+    scene.bake_kernel_is_new = false;
+
+    scene.brick_grid = grid;
+    scene.brick_atlas = atlas;
+    scene.brick_min = min;
+    scene.brick_cell = cell;
+}
+
+// Sets the brick cache parameters of the render kernel, which must be in
+// use. Without a cache, rays are traced through the model itself.
+static void set_brick_params(guiState &scene)
+{
+    fetch_uniform(render_kernel, iBrickCache);
+    fetch_uniform(render_kernel, iBrickGrid);
+    fetch_uniform(render_kernel, iBrickAtlas);
+    fetch_uniform(render_kernel, iBrickMin);
+    fetch_uniform(render_kernel, iBrickCell);
+    fetch_uniform(render_kernel, iBrickGridSize);
+
+    bool cached = scene.brick_cache && scene.brick_atlas;
+    fraktal_param_1i(loc_iBrickCache, cached ? 1 : 0);
+    if (cached)
+    {
+        fraktal_param_array(loc_iBrickGrid, scene.brick_grid);
+        fraktal_param_array(loc_iBrickAtlas, scene.brick_atlas);
+        fraktal_param_3f(loc_iBrickMin, scene.brick_min.x, scene.brick_min.y, scene.brick_min.z);
+        fraktal_param_1f(loc_iBrickCell, scene.brick_cell);
+        fraktal_param_1i(loc_iBrickGridSize, BRICK_GRID);
+    }
+}
+
+// Updates the per-pixel sample moments with the latest accumulated sample,
+// and counts the pixels that have converged. Reading the count back waits
+// for the GPU to finish all the work queued so far, so it is only done
+// every CONVERGENCE_INTERVAL samples (and only the sum over each block of
+// the moments is read back). In between, scene.converged keeps the last
+// count, and auto-render may run a few samples more than needed; these
+// add nothing to the pixels that have converged.
+static void update_convergence(guiState &scene)
+{
+    fraktal_use_kernel(scene.moments_kernel);
+    {
+        fetch_uniform(moments_kernel, iChannel0);
+        fetch_uniform(moments_kernel, iChannel1);
+        fetch_uniform(moments_kernel, iErrorThreshold);
+        fetch_uniform(moments_kernel, iMinSamples);
+        scene.moments_kernel_is_new = false;
+
+        fArray *in = scene.moment_buffers[scene.moment_index];
+        fArray *out = scene.moment_buffers[1 - scene.moment_index];
+        fraktal_param_array(loc_iChannel0, scene.render_buffer);
+        fraktal_param_array(loc_iChannel1, in);
+        fraktal_param_1f(loc_iErrorThreshold, scene.error_threshold);
+        fraktal_param_1i(loc_iMinSamples, MIN_ADAPTIVE_SAMPLES);
+        fraktal_zero_array(out);
+        fraktal_run_kernel(out);
+        scene.moment_index = 1 - scene.moment_index;
+    }
+
+    if (scene.samples % CONVERGENCE_INTERVAL != 0)
+        return;
+
+    fraktal_use_kernel(scene.reduce_kernel);
+    {
+        fetch_uniform(reduce_kernel, iChannel0);
+        fetch_uniform(reduce_kernel, iBlock);
+        scene.reduce_kernel_is_new = false;
+
+        fArray *out = scene.reduce_buffer;
+        fraktal_param_array(loc_iChannel0, scene.moment_buffers[scene.moment_index]);
+        fraktal_param_1i(loc_iBlock, REDUCE_BLOCK);
+        fraktal_zero_array(out);
+        fraktal_run_kernel(out);
 
         int width,height;
-        fraktal_array_size(scene.render_buffer, &width, &height);
+        fraktal_array_size(out, &width, &height);
+        float *sums = (float*)malloc(width*height*4*sizeof(float));
+        fraktal_to_cpu(sums, out);
+        double count = 0.0;
+        for (int i = 0; i < width*height; i++)
+            count += sums[4*i + 3];
+        free(sums);
+        scene.converged = (float)(count/((double)scene.resolution.x*scene.resolution.y));
+    }
+}
 
-        fraktal_param_2f(loc_iResolution, (float)width, (float)height);
-        fraktal_param_2f(loc_iLowResolution, (float)t_buffer_width, (float)t_buffer_height);
+// Returns true if auto-render should accumulate another sample
+static bool wants_more_samples(guiState &scene)
+{
+    if (!scene.auto_render || scene.samples >= scene.max_samples)
+        return false;
+    return !scene.adaptive || scene.converged < 1.0f;
+}
 
-        assert(scene.preset);
+// Reprojects an array of sums of samples, with the number of samples in
+// the given channel, from the previous camera to the current one.
+static void reproject_sums(guiState &scene, fArray *in, fArray *out, int count_channel)
+{
+    fetch_uniform(reproject_kernel, iChannel0);
+    fetch_uniform(reproject_kernel, iCountChannel);
+    fraktal_param_array(loc_iChannel0, in);
+    fraktal_param_1i(loc_iCountChannel, count_channel);
+    fraktal_zero_array(out);
+    fraktal_run_kernel(out);
+}
+
+// Renders the depth of each pixel center from the current camera, after
+// the scene was cleared or the camera moved. If the camera moved, the
+// accumulated samples, and their moments, are then reprojected from the
+// previous camera, so that only the samples of surfaces that were hidden
+// or outside the previous image are lost.
+static void update_camera(guiState &scene, bool reproject)
+{
+    assert(scene.preset);
+    Widget_Camera *camera = (Widget_Camera*)scene.preset->widgets[0];
+    float2 center;
+    float f;
+    float view[4*4];
+    camera->get_camera(scene, &center, &f, view);
+
+    fraktal_use_kernel(scene.render_kernel);
+    {
+        fetch_uniform(render_kernel, iResolution);
+        fetch_uniform(render_kernel, iDepthPass);
+
+        fraktal_param_2f(loc_iResolution, (float)scene.resolution.x, (float)scene.resolution.y);
         for (int i = 0; i < scene.preset->num_widgets; i++)
         {
             if (scene.preset->widgets[i]->is_active())
                 scene.preset->widgets[i]->set_params(scene);
         }
+        set_brick_params(scene);
+        render_cone_levels(scene, true);
+
+        // The epilogue's result of a fused kernel is overwritten by the
+        // render pass that follows.
+        scene.depth_index = 1 - scene.depth_index;
+        fArray *out = scene.depth_buffers[scene.depth_index];
+        fraktal_param_1i(loc_iDepthPass, 1);
+        fraktal_zero_array(out);
+        if (scene.render_kernel_is_fused)
+            fraktal_run_kernel_fused(out, scene.compose_buffer);
+        else
+            fraktal_run_kernel(out);
+        fraktal_param_1i(loc_iDepthPass, 0);
+    }
 
-        // cone tracing pass
-        if (scene.should_clear)
-        {
-            fraktal_param_1i(loc_iMode, 1);
-            fraktal_zero_array(t_buffer);
-            fraktal_run_kernel(t_buffer);
-        }
+    if (reproject)
+    {
+        fraktal_use_kernel(scene.reproject_kernel);
+        fetch_uniform(reproject_kernel, iResolution);
+        fetch_uniform(reproject_kernel, iCameraCenter);
+        fetch_uniform(reproject_kernel, iCameraF);
+        fetch_uniform(reproject_kernel, iView);
+        fetch_uniform(reproject_kernel, iPrevCameraCenter);
+        fetch_uniform(reproject_kernel, iPrevCameraF);
+        fetch_uniform(reproject_kernel, iPrevView);
+        fetch_uniform(reproject_kernel, iDepth);
+        fetch_uniform(reproject_kernel, iPrevDepth);
+        fetch_uniform(reproject_kernel, iHistory);
+
+        fraktal_param_2f(loc_iResolution, (float)scene.resolution.x, (float)scene.resolution.y);
+        fraktal_param_2f(loc_iCameraCenter, center.x, center.y);
+        fraktal_param_1f(loc_iCameraF, f);
+        fraktal_param_transpose_matrix4f(loc_iView, view);
+        fraktal_param_2f(loc_iPrevCameraCenter, scene.camera_center.x, scene.camera_center.y);
+        fraktal_param_1f(loc_iPrevCameraF, scene.camera_f);
+        fraktal_param_transpose_matrix4f(loc_iPrevView, scene.camera_view);
+        fraktal_param_array(loc_iDepth, scene.depth_buffers[scene.depth_index]);
+        fraktal_param_array(loc_iPrevDepth, scene.depth_buffers[1 - scene.depth_index]);
+        fraktal_param_1f(loc_iHistory, (float)REPROJECT_HISTORY);
+
+        fArray *history = scene.history_buffer;
+        reproject_sums(scene, scene.render_buffer, history, 3);
+        scene.history_buffer = scene.render_buffer;
+        scene.render_buffer = history;
+
+        fArray *moments = scene.moment_buffers[scene.moment_index];
+        scene.moment_index = 1 - scene.moment_index;
+        reproject_sums(scene, moments, scene.moment_buffers[scene.moment_index], 2);
+        scene.reproject_kernel_is_new = false;
+    }
 
-        // accumulation pass
-        if (scene.should_clear)
-        {
-            fraktal_zero_array(scene.render_buffer);
-            scene.samples = 0;
-            scene.should_clear = false;
-        }
+    fraktal_use_kernel(NULL);
+    scene.should_render_gbuffer = true;
+    scene.camera_center = center;
+    scene.camera_f = f;
+    for (int i = 0; i < 4*4; i++)
+        scene.camera_view[i] = view[i];
+}
 
-        fraktal_param_1i(loc_iMode, 0);
-        fraktal_param_1i(loc_iSamples, scene.samples);
-        fraktal_param_array(loc_iChannel0, t_buffer);
-        fraktal_run_kernel(scene.render_buffer);
-        scene.samples++;
-    }
+// Renders the GBuffer output of geometry.f from the current camera, for
+// the denoiser. The model is assumed to have no parameters of its own, so
+// only the camera's parameters are set.
+static void render_gbuffer(guiState &scene)
+{
+    assert(scene.preset);
+    Widget_Camera *camera = (Widget_Camera*)scene.preset->widgets[0];
+    float2 center;
+    float f;
+    float view[4*4];
+    camera->get_camera(scene, &center, &f, view);
+
+    fraktal_use_kernel(scene.gbuffer_kernel);
+    fetch_uniform(gbuffer_kernel, iResolution);
+    fetch_uniform(gbuffer_kernel, iCameraCenter);
+    fetch_uniform(gbuffer_kernel, iCameraF);
+    fetch_uniform(gbuffer_kernel, iView);
+    fetch_uniform(gbuffer_kernel, iDrawMode);
+    fetch_uniform(gbuffer_kernel, iMinDistance);
+    fetch_uniform(gbuffer_kernel, iMaxDistance);
+    scene.gbuffer_kernel_is_new = false;
+
+    fraktal_param_2f(loc_iResolution, (float)scene.resolution.x, (float)scene.resolution.y);
+    fraktal_param_2f(loc_iCameraCenter, center.x, center.y);
+    fraktal_param_1f(loc_iCameraF, f);
+    fraktal_param_transpose_matrix4f(loc_iView, view);
+    fraktal_param_1i(loc_iDrawMode, 3);
+    fraktal_param_1f(loc_iMinDistance, 0.0f);
+    fraktal_param_1f(loc_iMaxDistance, 1.0f);
+    fraktal_zero_array(scene.gbuffer);
+    fraktal_run_kernel(scene.gbuffer);
+    fraktal_use_kernel(NULL);
+    scene.should_render_gbuffer = false;
+}
 
-    // compose pass
-    fraktal_use_kernel(scene.compose_kernel);
+// Runs the passes of the denoiser over the accumulated samples, and
+// returns the array that holds the result.
+static fArray *denoise(guiState &scene)
+{
+    if (scene.should_render_gbuffer)
+        render_gbuffer(scene);
+
+    fraktal_use_kernel(scene.denoise_kernel);
+    fetch_uniform(denoise_kernel, iChannel0);
+    fetch_uniform(denoise_kernel, iGBuffer);
+    fetch_uniform(denoise_kernel, iDepth);
+    fetch_uniform(denoise_kernel, iMoments);
+    fetch_uniform(denoise_kernel, iStep);
+    scene.denoise_kernel_is_new = false;
+
+    fraktal_param_array(loc_iGBuffer, scene.gbuffer);
+    fraktal_param_array(loc_iDepth, scene.depth_buffers[scene.depth_index]);
+    fraktal_param_array(loc_iMoments, scene.moment_buffers[scene.moment_index]);
+    fArray *in = scene.render_buffer;
+    for (int pass = 0; pass < DENOISE_PASSES; pass++)
     {
-        fetch_uniform(compose_kernel, iResolution);
-        fetch_uniform(compose_kernel, iChannel0);
-        fetch_uniform(compose_kernel, iSamples);
-        scene.compose_kernel_is_new = false;
-
-        fArray *out = scene.compose_buffer;
-        fArray *in = scene.render_buffer;
-        int width,height;
-        fraktal_array_size(out, &width, &height);
-        fraktal_param_2f(loc_iResolution, (float)width, (float)height);
-        fraktal_param_1i(loc_iSamples, scene.samples);
+        fArray *out = scene.denoise_buffers[pass % 2];
         fraktal_param_array(loc_iChannel0, in);
-
+        fraktal_param_1i(loc_iStep, 1 << pass);
         fraktal_zero_array(out);
         fraktal_run_kernel(out);
+        in = out;
     }
-
     fraktal_use_kernel(NULL);
+    return in;
 }
-#else
+
 static void render_color(guiState &scene)
 {
     if (!scene.render_kernel || !scene.compose_kernel)
@@ -324,51 +813,94 @@ static void render_color(guiState &scene)
     assert(fraktal_is_valid_array(scene.render_buffer));
     assert(fraktal_is_valid_array(scene.compose_buffer));
 
+    // Moving the camera keeps the samples that can be reprojected, unless
+    // the render kernel has no camera parameters.
+    assert(scene.preset);
+    bool clear = scene.should_clear;
+    bool reproject = scene.should_reproject && !clear;
+    if (reproject && !scene.preset->widgets[0]->is_active())
+    {
+        clear = true;
+        reproject = false;
+    }
+    if (clear)
+    {
+        fraktal_zero_array(scene.render_buffer);
+        fraktal_zero_array(scene.moment_buffers[0]);
+        fraktal_zero_array(scene.moment_buffers[1]);
+        scene.frame = 0;
+    }
+    if (clear || reproject)
+    {
+        update_camera(scene, reproject);
+        scene.samples = 0;
+        scene.converged = 0.0f;
+        scene.should_clear = false;
+        scene.should_reproject = false;
+    }
+
     // accumulation pass
     fraktal_use_kernel(scene.render_kernel);
     {
         fetch_uniform(render_kernel, iResolution);
         fetch_uniform(render_kernel, iSamples);
-        scene.render_kernel_is_new = false;
+        fetch_uniform(render_kernel, iMoments);
+        fetch_uniform(render_kernel, iAdaptive);
 
         fArray *out = scene.render_buffer;
-        if (scene.should_clear)
-        {
-            fraktal_zero_array(out);
-            scene.samples = 0;
-            scene.should_clear = false;
-        }
-
         int width,height;
         fraktal_array_size(out, &width, &height);
         fraktal_param_2f(loc_iResolution, (float)width, (float)height);
-        fraktal_param_1i(loc_iSamples, scene.samples);
+        fraktal_param_1i(loc_iSamples, scene.frame);
+        fraktal_param_1i(loc_iAdaptive, scene.adaptive ? 1 : 0);
+        fraktal_param_array(loc_iMoments, scene.moment_buffers[scene.moment_index]);
 
-        assert(scene.preset);
         for (int i = 0; i < scene.preset->num_widgets; i++)
         {
             if (scene.preset->widgets[i]->is_active())
                 scene.preset->widgets[i]->set_params(scene);
         }
+        set_brick_params(scene);
 
-        fraktal_run_kernel(out);
+        render_cone_levels(scene, false);
+        scene.render_kernel_is_new = false;
+
+        if (scene.render_kernel_is_fused)
+        {
+            // The compose pass runs as the epilogue of the render kernel
+            fraktal_zero_array(scene.compose_buffer);
+            fraktal_run_kernel_fused(out, scene.compose_buffer);
+        }
+        else
+        {
+            fraktal_run_kernel(out);
+        }
         scene.samples++;
+        scene.frame++;
     }
 
+    update_convergence(scene);
+
+    // Denoising runs between the render and compose passes, so the
+    // compose pass of a fused render kernel is then run again.
+    fArray *result = scene.render_buffer;
+    bool denoising = scene.denoise && scene.denoise_kernel && scene.gbuffer_kernel;
+    if (denoising)
+        result = denoise(scene);
+
     // compose pass
-    fraktal_use_kernel(scene.compose_kernel);
+    if (!scene.render_kernel_is_fused || denoising)
     {
+        fraktal_use_kernel(scene.compose_kernel);
         fetch_uniform(compose_kernel, iResolution);
         fetch_uniform(compose_kernel, iChannel0);
-        fetch_uniform(compose_kernel, iSamples);
         scene.compose_kernel_is_new = false;
 
         fArray *out = scene.compose_buffer;
-        fArray *in = scene.render_buffer;
+        fArray *in = result;
         int width,height;
         fraktal_array_size(out, &width, &height);
         fraktal_param_2f(loc_iResolution, (float)width, (float)height);
-        fraktal_param_1i(loc_iSamples, scene.samples);
         fraktal_param_array(loc_iChannel0, in);
 
         fraktal_zero_array(out);
@@ -377,7 +909,6 @@ static void render_color(guiState &scene)
 
     fraktal_use_kernel(NULL);
 }
-#endif
 
 static void render_geometry(guiState &scene)
 {
@@ -391,17 +922,16 @@ static void render_geometry(guiState &scene)
     {
         fetch_uniform(render_kernel, iResolution);
         fetch_uniform(render_kernel, iDrawMode);
-        scene.render_kernel_is_new = false;
 
         fArray *out = scene.compose_buffer;
 
         int width,height;
         fraktal_array_size(out, &width, &height);
         fraktal_param_2f(loc_iResolution, (float)width, (float)height);
-        if      (scene.mode == guiPreviewMode_Normals) glUniform1i(loc_iDrawMode, 0);
-        else if (scene.mode == guiPreviewMode_Depth) glUniform1i(loc_iDrawMode, 1);
-        else if (scene.mode == guiPreviewMode_Thickness) glUniform1i(loc_iDrawMode, 2);
-        else if (scene.mode == guiPreviewMode_GBuffer) glUniform1i(loc_iDrawMode, 3);
+        if      (scene.mode == guiPreviewMode_Normals) fraktal_param_1i(loc_iDrawMode, 0);
+        else if (scene.mode == guiPreviewMode_Depth) fraktal_param_1i(loc_iDrawMode, 1);
+        else if (scene.mode == guiPreviewMode_Thickness) fraktal_param_1i(loc_iDrawMode, 2);
+        else if (scene.mode == guiPreviewMode_GBuffer) fraktal_param_1i(loc_iDrawMode, 3);
         else assert(false);
 
         assert(scene.preset);
@@ -410,11 +940,16 @@ static void render_geometry(guiState &scene)
             if (scene.preset->widgets[i]->is_active())
                 scene.preset->widgets[i]->set_params(scene);
         }
+        set_brick_params(scene);
+
+        render_cone_levels(scene, true);
+        scene.render_kernel_is_new = false;
 
         fraktal_zero_array(out);
         fraktal_run_kernel(out);
         scene.samples = 0;
         scene.should_clear = false;
+        scene.should_reproject = false;
     }
     fraktal_use_kernel(NULL);
 }
@@ -470,6 +1005,42 @@ static void allocate_or_resize_buffers(guiState &g)
         g.resolution.y = g.new_resolution.y;
         g.render_buffer =  fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
         g.compose_buffer = fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_UINT8, FRAKTAL_READ_WRITE);
+
+        // Each texel of a cone level covers a square block of pixels, so
+        // that the cones are correct for any aspect ratio. The arrays are
+        // 4-channel float arrays so that fused kernels can also write them,
+        // and at least 2x2 so that they are 2D arrays (as cone.f samples
+        // them as such) for any resolution.
+        for (int level = 0; level < NUM_CONE_LEVELS; level++)
+        {
+            fraktal_destroy_array(g.cone_buffers[level]);
+            fraktal_destroy_array(g.cone_scratch[level]);
+            int cell = cone_cells[level];
+            int width = (g.resolution.x + cell - 1)/cell;
+            int height = (g.resolution.y + cell - 1)/cell;
+            if (width < 2) width = 2;
+            if (height < 2) height = 2;
+            g.cone_buffers[level] = fraktal_create_array(NULL, width, height, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+            g.cone_scratch[level] = fraktal_create_array(NULL, width, height, 4, FRAKTAL_UINT8, FRAKTAL_READ_WRITE);
+        }
+
+        fraktal_destroy_array(g.history_buffer);
+        g.history_buffer = fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+        fraktal_destroy_array(g.gbuffer);
+        g.gbuffer = fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+        for (int i = 0; i < 2; i++)
+        {
+            fraktal_destroy_array(g.moment_buffers[i]);
+            fraktal_destroy_array(g.depth_buffers[i]);
+            fraktal_destroy_array(g.denoise_buffers[i]);
+            g.moment_buffers[i] = fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+            g.depth_buffers[i] = fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+            g.denoise_buffers[i] = fraktal_create_array(NULL, g.resolution.x, g.resolution.y, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
+        }
+        fraktal_destroy_array(g.reduce_buffer);
+        int width = (g.resolution.x + REDUCE_BLOCK - 1)/REDUCE_BLOCK;
+        int height = (g.resolution.y + REDUCE_BLOCK - 1)/REDUCE_BLOCK;
+        g.reduce_buffer = fraktal_create_array(NULL, width, height, 4, FRAKTAL_FLOAT, FRAKTAL_READ_WRITE);
         g.should_clear = true;
     }
 }
@@ -481,6 +1052,10 @@ static void update_and_render_gui(guiState &scene)
 
     if (scene.new_mode != scene.mode)
         reload_request = true;
+    if (scene.mode == guiPreviewMode_Color && scene.denoise && !scene.gbuffer_kernel)
+        reload_request = true;
+    if (scene.brick_cache && !scene.bake_kernel)
+        reload_request = true;
 
     if (reload_key || (reload_request && !scene.got_error))
     {
@@ -508,19 +1083,21 @@ static void update_and_render_gui(guiState &scene)
     }
 
     allocate_or_resize_buffers(scene);
+    if (scene.should_bake)
+        bake_brick_cache(scene);
 
     if (scene.mode == guiPreviewMode_Color)
     {
         if (!scene.keys.Alt.down && scene.keys.Enter.pressed)
             scene.auto_render = !scene.auto_render;
-        if (scene.auto_render && scene.samples < scene.max_samples)
+        if (wants_more_samples(scene))
             render_color(scene);
-        else if (scene.should_clear)
+        else if (scene.should_clear || scene.should_reproject)
             render_color(scene);
     }
     else
     {
-        if (scene.should_clear)
+        if (scene.should_clear || scene.should_reproject)
             render_geometry(scene);
     }
 
@@ -671,8 +1248,16 @@ static void update_and_render_gui(guiState &scene)
         assert(scene.preset);
         for (int i = 0; i < scene.preset->num_widgets; i++)
         {
-            if (scene.preset->widgets[i]->is_active())
-                scene.should_clear |= scene.preset->widgets[i]->update(scene);
+            if (!scene.preset->widgets[i]->is_active())
+                continue;
+
+            // Moving the camera (always the first widget) need not throw
+            // away the accumulated samples, unlike other changes.
+            bool changed = scene.preset->widgets[i]->update(scene);
+            if (i == 0)
+                scene.should_reproject |= changed;
+            else
+                scene.should_clear |= changed;
         }
 
         ImGui::End();
@@ -764,6 +1349,9 @@ static void update_and_render_gui(guiState &scene)
                     ImGui::EndMenu();
                 }
                 ImGui::PopStyleVar();
+                ImGui::Separator();
+                if (ImGui::Checkbox("Cache", &scene.brick_cache))
+                    scene.should_clear = true;
                 if (scene.mode == guiPreviewMode_Color)
                 {
                     ImGui::Separator();
@@ -772,6 +1360,20 @@ static void update_and_render_gui(guiState &scene)
                     if (ImGui::DragInt("##max_samples", &scene.max_samples, 1.0f, 1, 2048))
                         scene.should_clear = true;
                     ImGui::PopItemWidth();
+                    ImGui::Separator();
+                    if (ImGui::Checkbox("Denoise", &scene.denoise))
+                        scene.should_clear = true;
+                    ImGui::Separator();
+                    if (ImGui::Checkbox("Adaptive", &scene.adaptive))
+                        scene.should_clear = true;
+                    if (scene.adaptive)
+                    {
+                        ImGui::Text("%.0f%% converged, error <", 100.0f*scene.converged);
+                        ImGui::PushItemWidth(64.0f);
+                        if (ImGui::DragFloat("##error_threshold", &scene.error_threshold, 0.0001f, 0.0001f, 0.1f, "%.4f"))
+                            scene.should_clear = true;
+                        ImGui::PopItemWidth();
+                    }
                 }
             }
             ImGui::EndMenuBar();
@@ -1061,6 +1663,8 @@ static void default_settings(guiState &g)
     g.settings.y = -1;
     g.settings.ui_scale = 1.0f;
     g.max_samples = 128;
+    g.adaptive = true;
+    g.error_threshold = 0.005f;
 }
 
 static void sanitize_settings(guiState &g)
@@ -1076,13 +1680,18 @@ static void sanitize_settings(guiState &g)
 int main(int argc, char **argv)
 {
     const char *ini_filename = "fraktal.ini";
-    g_scene.new_paths.model    = "examples/vase.f";
-    g_scene.new_paths.color    = "libf/publication.f";
-    g_scene.new_paths.geometry = "libf/geometry.f";
-    g_scene.new_paths.compose  = "libf/compose.f";
-    g_scene.new_resolution.x   = 320;
-    g_scene.new_resolution.y   = 240;
-    g_scene.new_mode           = guiPreviewMode_Color;
+    g_scene.new_paths.model     = "examples/vase.f";
+    g_scene.new_paths.color     = "libf/publication.f";
+    g_scene.new_paths.geometry  = "libf/geometry.f";
+    g_scene.new_paths.compose   = "libf/compose.f";
+    g_scene.new_paths.moments   = "libf/moments.f";
+    g_scene.new_paths.reduce    = "libf/reduce.f";
+    g_scene.new_paths.reproject = "libf/reproject.f";
+    g_scene.new_paths.denoise   = "libf/denoise.f";
+    g_scene.new_paths.bake      = "libf/bake.f";
+    g_scene.new_resolution.x    = 320;
+    g_scene.new_resolution.y    = 240;
+    g_scene.new_mode            = guiPreviewMode_Color;
 
     fraktal_create_context();
 
@@ -1165,7 +1774,7 @@ int main(int argc, char **argv)
     while (!glfwWindowShouldClose(fraktal_context) && !g_scene.should_exit)
     {
         static int settle_frames = 10;
-        if ((g_scene.auto_render && g_scene.samples < g_scene.max_samples) || settle_frames > 0)
+        if (wants_more_samples(g_scene) || settle_frames > 0)
         {
             glfwPollEvents();
         }
@@ -6,13 +6,17 @@
 #include <stdlib.h>
 #include <stdarg.h>
 #include <assert.h>
+#include <mutex>
 
+// The log may be written from several threads (e.g. threads preparing
+// links in parallel), so log_err and log_clear hold the lock.
 static struct logfile_t
 {
     size_t bytes;
     size_t capacity;
     char *begin;
     char *str;
+    std::mutex lock;
 } logfile;
 
 static void log_init()
@@ -26,6 +30,7 @@ static void log_init()
 
 static void log_clear()
 {
+    std::lock_guard<std::mutex> guard(logfile.lock);
     if (!logfile.begin)
         log_init();
     assert(logfile.begin);
@@ -36,6 +41,7 @@ static void log_clear()
 
 static void log_err(const char *fmt, ...)
 {
+    std::lock_guard<std::mutex> guard(logfile.lock);
     va_list args;
     va_start(args, fmt);
     int bytes = vfprintf(stderr, fmt, args);
@@ -60,14 +60,14 @@ struct Widget_Camera : Widget
         camera_shift.x = 0.0f;
         camera_shift.y = 0.0f;
     }
-    virtual void deserialize(const char **cc)
+    virtual void deserialize(fParser *p)
     {
-        while (parse_next_in_list(cc)) {
-            if (parse_argument_float(cc, "yfov", &camera_yfov)) ;
-            else if (parse_argument_float2(cc, "shift", &camera_shift)) ;
-            else if (parse_argument_angle2(cc, "dir", &dir)) ;
-            else if (parse_argument_float3(cc, "pos", &pos)) ;
-            else parse_list_unexpected();
+        while (parse_next_in_list(p)) {
+            if (parse_argument_float(p, "yfov", &camera_yfov)) ;
+            else if (parse_argument_float2(p, "shift", &camera_shift)) ;
+            else if (parse_argument_angle2(p, "dir", &dir)) ;
+            else if (parse_argument_float3(p, "pos", &pos)) ;
+            else parse_list_unexpected(p);
         }
     }
     virtual void serialize(FILE *f)
@@ -139,20 +139,26 @@ struct Widget_Camera : Widget
 
         return changed;
     }
-    virtual void set_params(guiState &g)
+    void get_camera(guiState &g, float2 *center, float *f, float view[4*4])
     {
-        float cx = (0.5f + 0.5f*camera_shift.x)*g.resolution.x;
-        float cy = (0.5f + 0.5f*camera_shift.y)*g.resolution.y;
-        float f = yfov2pinhole_f(camera_yfov, (float)g.resolution.y);
-        fraktal_param_2f(loc_iCameraCenter, cx, cy);
-        fraktal_param_1f(loc_iCameraF, f);
-        float iView[4*4];
+        center->x = (0.5f + 0.5f*camera_shift.x)*g.resolution.x;
+        center->y = (0.5f + 0.5f*camera_shift.y)*g.resolution.y;
+        *f = yfov2pinhole_f(camera_yfov, (float)g.resolution.y);
         float3 r = {
             deg2rad(dir.theta),
             deg2rad(dir.phi),
             0.0f
         };
-        compute_view_matrix(iView, pos, r);
+        compute_view_matrix(view, pos, r);
+    }
+    virtual void set_params(guiState &g)
+    {
+        float2 center;
+        float f;
+        float iView[4*4];
+        get_camera(g, &center, &f, iView);
+        fraktal_param_2f(loc_iCameraCenter, center.x, center.y);
+        fraktal_param_1f(loc_iCameraF, f);
         fraktal_param_transpose_matrix4f(loc_iView, iView);
     }
 };
@@ -39,15 +39,15 @@ struct Widget_Geometry : Widget
         }
 
     }
-    virtual void deserialize(const char **cc)
+    virtual void deserialize(fParser *p)
     {
-        while (parse_next_in_list(cc)) {
-            if (parse_argument_float(cc, "min_distance", &min_distance)) ;
-            else if (parse_argument_float(cc, "max_distance", &max_distance)) ;
-            else if (parse_argument_float(cc, "min_thickness", &min_thickness)) ;
-            else if (parse_argument_float(cc, "max_thickness", &max_thickness)) ;
-            else if (parse_argument_bool(cc, "apply_colormap", &apply_colormap)) ;
-            else parse_list_unexpected();
+        while (parse_next_in_list(p)) {
+            if (parse_argument_float(p, "min_distance", &min_distance)) ;
+            else if (parse_argument_float(p, "max_distance", &max_distance)) ;
+            else if (parse_argument_float(p, "min_thickness", &min_thickness)) ;
+            else if (parse_argument_float(p, "max_thickness", &max_thickness)) ;
+            else if (parse_argument_bool(p, "apply_colormap", &apply_colormap)) ;
+            else parse_list_unexpected(p);
         }
     }
     virtual void serialize(FILE *f)
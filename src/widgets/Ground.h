@@ -37,18 +37,18 @@ struct Widget_Ground : Widget
         ground_reflectivity = 0.6f;
 
     }
-    virtual void deserialize(const char **cc)
+    virtual void deserialize(fParser *p)
     {
-        while (parse_next_in_list(cc)) {
-            if (parse_argument_float3(cc, "isolines_color", &isolines_color)) ;
-            else if (parse_argument_bool(cc, "draw_isolines", &isolines_enabled)) ;
-            else if (parse_argument_float(cc, "isolines_thickness", &isolines_thickness)) ;
-            else if (parse_argument_float(cc, "isolines_spacing", &isolines_spacing)) ;
-            else if (parse_argument_int(cc, "isolines_count", &isolines_count)) ;
-            else if (parse_argument_float(cc, "height", &ground_height)) ;
-            else if (parse_argument_float(cc, "specular_exponent", &ground_specular_exponent)) ;
-            else if (parse_argument_float(cc, "reflectivity", &ground_reflectivity)) ;
-            else parse_list_unexpected();
+        while (parse_next_in_list(p)) {
+            if (parse_argument_float3(p, "isolines_color", &isolines_color)) ;
+            else if (parse_argument_bool(p, "draw_isolines", &isolines_enabled)) ;
+            else if (parse_argument_float(p, "isolines_thickness", &isolines_thickness)) ;
+            else if (parse_argument_float(p, "isolines_spacing", &isolines_spacing)) ;
+            else if (parse_argument_int(p, "isolines_count", &isolines_count)) ;
+            else if (parse_argument_float(p, "height", &ground_height)) ;
+            else if (parse_argument_float(p, "specular_exponent", &ground_specular_exponent)) ;
+            else if (parse_argument_float(p, "reflectivity", &ground_reflectivity)) ;
+            else parse_list_unexpected(p);
         }
     }
     virtual void serialize(FILE *f)
@@ -23,14 +23,14 @@ struct Widget_Material : Widget
         albedo.z = 0.1f;
 
     }
-    virtual void deserialize(const char **cc)
+    virtual void deserialize(fParser *p)
     {
-        while (parse_next_in_list(cc)) {
-            if (parse_argument_float3(cc, "albedo", &albedo)) ;
-            else if (parse_argument_float3(cc, "specular_albedo", &specular_albedo)) ;
-            else if (parse_argument_float(cc, "specular_exponent", &specular_exponent)) ;
-            else if (parse_argument_bool(cc, "glossy", &glossy)) ;
-            else parse_list_unexpected();
+        while (parse_next_in_list(p)) {
+            if (parse_argument_float3(p, "albedo", &albedo)) ;
+            else if (parse_argument_float3(p, "specular_albedo", &specular_albedo)) ;
+            else if (parse_argument_float(p, "specular_exponent", &specular_exponent)) ;
+            else if (parse_argument_bool(p, "glossy", &glossy)) ;
+            else parse_list_unexpected(p);
         }
     }
     virtual void serialize(FILE *f)
@@ -20,14 +20,14 @@ struct Widget_Sun : Widget
         color.z = 0.8f;
         intensity = 250.0f;
     }
-    virtual void deserialize(const char **cc)
+    virtual void deserialize(fParser *p)
     {
-        while (parse_next_in_list(cc)) {
-            if (parse_argument_angle(cc, "size", &size)) ;
-            else if (parse_argument_angle2(cc, "dir", &dir)) ;
-            else if (parse_argument_float3(cc, "color", &color)) ;
-            else if (parse_argument_float(cc, "intensity", &intensity)) ;
-            else parse_list_unexpected();
+        while (parse_next_in_list(p)) {
+            if (parse_argument_angle(p, "size", &size)) ;
+            else if (parse_argument_angle2(p, "dir", &dir)) ;
+            else if (parse_argument_float3(p, "color", &color)) ;
+            else if (parse_argument_float(p, "intensity", &intensity)) ;
+            else parse_list_unexpected(p);
         }
     }
     virtual void serialize(FILE *f)
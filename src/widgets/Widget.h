@@ -3,7 +3,7 @@
 struct Widget
 {
     virtual void default_values() = 0;
-    virtual void deserialize(const char **cc) = 0;
+    virtual void deserialize(fParser *p) = 0;
     virtual void serialize(FILE *f) = 0;
     virtual void get_param_offsets(fKernel *f) = 0;
     virtual bool is_active() = 0;